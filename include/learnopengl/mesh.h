@@ -7,7 +7,13 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <rg/GeometryArena.h>
+#include <rg/MeshSimplifier.h>
+#include <rg/Meshlets.h>
+#include <rg/TextureArrays.h>
+#include <rg/VertexPacking.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 using namespace std;
@@ -24,6 +30,7 @@ struct Vertex {
     // bitangent
     glm::vec3 Bitangent;
 };
+static_assert(sizeof(Vertex) == 14 * sizeof(float), "rg::GeometryArena sets up this layout for FLOAT32 meshes");
 
 
 
@@ -31,6 +38,8 @@ struct Texture {
     unsigned int id;
     string type;
     string path;
+    // the layer when id is a GL_TEXTURE_2D_ARRAY, see rg::TextureArrayPacker
+    int layer = -1;
 };
 
 class Mesh {
@@ -42,20 +51,201 @@ public:
 
     unsigned int VAO;
     std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor; lods are the index lists of LOD 1 and up over the same vertices, lodErrors
+    // how far each one is off the full mesh in model units
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures,
+         vector<vector<unsigned int>> lods = {}, vector<float> lodErrors = {})
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        this->lodIndices = lods;
+        this->lodErrors = lodErrors;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    // re-uploads the vertices in another layout; shaders need PACKED_VERTICES for packed ones
+    void SetVertexLayout(const rg::VertexLayout& layout)
     {
+        if (layout == vertexLayout)
+            return;
+        rg::GeometryArena& arena = rg::GeometryArena::forLayout(vertexLayout);
+        arena.releaseVertices(vertexRange);
+        releaseIndices(arena);
+        vertexLayout = layout;
+        setupMesh();
+    }
+
+    const rg::VertexLayout& GetVertexLayout() const
+    {
+        return vertexLayout;
+    }
+
+    size_t VertexBufferBytes() const
+    {
+        return vertexBufferBytes;
+    }
+
+    // false keeps the 32-bit indices, to compare against the 16-bit ones
+    void SetCompactIndices(bool compact)
+    {
+        if (compact == compactIndices)
+            return;
+        compactIndices = compact;
+        rg::GeometryArena& arena = rg::GeometryArena::forLayout(vertexLayout);
+        releaseIndices(arena);
+        setupIndices(arena);
+    }
+
+    // all LODs together
+    size_t IndexBufferBytes() const
+    {
+        size_t bytes = 0;
+        for (const IndexBuffer& buffer : indexBuffers)
+            bytes += buffer.bytes;
+        return bytes;
+    }
+
+    // LOD 0 is the full mesh
+    int LodCount() const
+    {
+        return (int) lodIndices.size() + 1;
+    }
+
+    float LodError(int level) const
+    {
+        return rg::lodError(lodErrors, level);
+    }
+
+    // levels past the mesh's last LOD draw the last one
+    void SetLod(int level)
+    {
+        lod = std::max(0, std::min(level, LodCount() - 1));
+    }
+
+    int Lod() const
+    {
+        return lod;
+    }
+
+    size_t TriangleCount() const
+    {
+        return (lod == 0 ? indices.size() : lodIndices[lod - 1].size()) / 3;
+    }
+
+    // the index buffer of the selected LOD from here on
+    GLenum IndexType() const
+    {
+        return indexBuffers[lod].type;
+    }
+
+    size_t IndexRangeCount() const
+    {
+        return indexBuffers[lod].ranges.size();
+    }
+
+    // where the mesh lives in its arena and how to undo its quantization, for batched draws that bypass Draw
+    unsigned int BaseVertex() const
+    {
+        return (unsigned int) vertexRange.offset;
+    }
+
+    // in bytes
+    size_t IndexOffset() const
+    {
+        return indexBuffers[lod].range.offset;
+    }
+
+    const vector<rg::IndexRange>& IndexRanges() const
+    {
+        return indexBuffers[lod].ranges;
+    }
+
+    const glm::vec3& PositionOffset() const
+    {
+        return positionOffset;
+    }
+
+    const glm::vec3& PositionScale() const
+    {
+        return positionScale;
+    }
+
+    // splits LOD 0 into meshlets for DrawCulled, false drops them again
+    void SetMeshlets(bool enable)
+    {
+        useMeshlets = enable;
+        if (enable)
+            buildMeshlets();
+        else
+            meshlets.clear();
+    }
+
+    size_t MeshletCount() const
+    {
+        return meshlets.count();
+    }
+
+    // the same textures as layers of texture arrays, drawn instead of them when enabled
+    void SetTextureArrays(const vector<Texture>& layered)
+    {
+        layeredTextures = layered;
+    }
+
+    void UseTextureArrays(bool enable)
+    {
+        textureArrays = enable && !layeredTextures.empty();
+    }
+
+    // what BindTextures binds: texture arrays or single textures
+    const vector<Texture>& MaterialTextures() const
+    {
+        return textureArrays ? layeredTextures : textures;
+    }
+
+    // diffuse and specular layer; -1 without a specular map, shaders use the diffuse one then
+    glm::vec2 MaterialLayers() const
+    {
+        glm::vec2 layers(0.0f, -1.0f);
+        if (textureArrays)
+        {
+            for (const Texture& texture : layeredTextures)
+            {
+                if (texture.type == "texture_diffuse")
+                    layers.x = (float) texture.layer;
+                else if (texture.type == "texture_specular")
+                    layers.y = (float) texture.layer;
+            }
+        }
+        return layers;
+    }
+
+    void BindTextures(Shader &shader)
+    {
+        rg::TextureBindings& bindings = rg::TextureBindings::instance();
+        if (textureArrays)
+        {
+            // diffuse on unit 0 and specular on unit 1; consecutive meshes in the same arrays only set their layers
+            GLuint diffuse = 0, specular = 0;
+            for (const Texture& texture : layeredTextures)
+            {
+                if (texture.type == "texture_diffuse")
+                    diffuse = texture.id;
+                else if (texture.type == "texture_specular")
+                    specular = texture.id;
+            }
+            bindings.bindCached(0, GL_TEXTURE_2D_ARRAY, diffuse);
+            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + "texture_diffuse_array").c_str()), 0);
+            if (specular)
+                bindings.bindCached(1, GL_TEXTURE_2D_ARRAY, specular);
+            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + "texture_specular_array").c_str()), specular ? 1 : 0);
+            glm::vec2 layers = MaterialLayers();
+            glUniform2fv(glGetUniformLocation(shader.ID, "materialLayers"), 1, &layers[0]);
+            return;
+        }
+
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
@@ -63,7 +253,6 @@ public:
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -78,62 +267,207 @@ public:
 
             // now set the sampler to the correct texture unit
             glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            // and finally bind the texture, on its own texture unit
+            bindings.bind(i, GL_TEXTURE_2D, textures[i].id);
+        }
+    }
+
+    // render the mesh; Model binds the arena's VAO once for all its meshes and passes false, it
+    // also forgets the texture bindings before its first mesh
+    void Draw(Shader &shader, bool bindVertexArray = true)
+    {
+        prepareDraw(shader, bindVertexArray);
+        // the indices are relative to the mesh, its vertices start at vertexRange.offset in the arena
+        const IndexBuffer& buffer = indexBuffers[lod];
+        size_t indexSize = buffer.type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+        for (const rg::IndexRange& range : buffer.ranges)
+        {
+            void* offset = (void*)(buffer.range.offset + range.first * indexSize);
+            glDrawElementsBaseVertex(GL_TRIANGLES, range.count, buffer.type, offset, (GLint)(vertexRange.offset + range.baseVertex));
+        }
+        finishDraw(bindVertexArray);
+    }
+
+    // the culling half of DrawCulled; false when the mesh draws everything at its current LOD
+    bool CullMeshlets(const rg::MeshletView& view, rg::MeshletStats& stats, bool simd = true)
+    {
+        if (lod != 0 || meshlets.empty())
+        {
+            stats.triangles += TriangleCount();
+            stats.trianglesDrawn += TriangleCount();
+            return false;
+        }
+        meshlets.cull(view, visibleRanges, stats, simd);
+        return true;
+    }
+
+    // draws only the meshlets in view and facing the camera, in one glMultiDrawElementsBaseVertex;
+    // view is in model space. Other LODs and meshes without meshlets draw everything.
+    void DrawCulled(Shader &shader, const rg::MeshletView& view, rg::MeshletStats& stats, bool simd = true,
+                    bool bindVertexArray = true)
+    {
+        if (!CullMeshlets(view, stats, simd))
+        {
+            Draw(shader, bindVertexArray);
+            return;
         }
+        if (visibleRanges.empty())
+            return;
 
+        const IndexBuffer& buffer = indexBuffers[0];
+        size_t indexSize = buffer.type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+        drawCounts.resize(visibleRanges.size());
+        drawOffsets.resize(visibleRanges.size());
+        drawBaseVertices.resize(visibleRanges.size());
+        for (size_t i = 0; i < visibleRanges.size(); i++)
+        {
+            drawCounts[i] = (GLsizei) visibleRanges[i].count;
+            drawOffsets[i] = (void*)(buffer.range.offset + visibleRanges[i].first * indexSize);
+            drawBaseVertices[i] = (GLint)(vertexRange.offset + visibleRanges[i].baseVertex);
+        }
+        prepareDraw(shader, bindVertexArray);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), buffer.type, drawOffsets.data(),
+                                      (GLsizei) visibleRanges.size(), drawBaseVertices.data());
+        finishDraw(bindVertexArray);
+    }
+
+private:
+    // render data, suballocated from the arena of the mesh's vertex layout
+    struct IndexBuffer {
+        rg::GeometryArena::Range range;
+        GLenum type = GL_UNSIGNED_INT;
+        vector<rg::IndexRange> ranges;
+        size_t bytes = 0;
+    };
+
+    rg::GeometryArena::Range vertexRange;
+    // one per LOD
+    vector<IndexBuffer> indexBuffers;
+    vector<vector<unsigned int>> lodIndices;
+    vector<float> lodErrors;
+    int lod = 0;
+    rg::VertexLayout vertexLayout;
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    size_t vertexBufferBytes = 0;
+    bool compactIndices = true;
+    // LOD 0 in meshlets, over the ranges of its index buffer; the rest is scratch for DrawCulled
+    rg::MeshletSet meshlets;
+    bool useMeshlets = false;
+    vector<rg::IndexRange> visibleRanges;
+    vector<GLsizei> drawCounts;
+    vector<void*> drawOffsets;
+    vector<GLint> drawBaseVertices;
+    vector<Texture> layeredTextures;
+    bool textureArrays = false;
 
+    void prepareDraw(Shader &shader, bool bindVertexArray)
+    {
+        if (bindVertexArray)
+            rg::TextureBindings::instance().invalidate();
+        BindTextures(shader);
+
+        // undo the position quantization of packed layouts
+        if (vertexLayout.packed())
+        {
+            glUniform3fv(glGetUniformLocation(shader.ID, "positionOffset"), 1, &positionOffset[0]);
+            glUniform3fv(glGetUniformLocation(shader.ID, "positionScale"), 1, &positionScale[0]);
+        }
 
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        if (bindVertexArray)
+            glBindVertexArray(VAO);
+    }
+
+    void finishDraw(bool bindVertexArray)
+    {
+        if (bindVertexArray)
+            glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    // render data
-    unsigned int VBO, EBO;
+    // the meshlets follow the 16-bit ranges, so they are rebuilt whenever those change
+    void buildMeshlets()
+    {
+        vector<glm::vec3> positions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            positions[i] = vertices[i].Position;
+        meshlets.build(positions, indices, indexBuffers[0].ranges);
+    }
 
-    // initializes all the buffer objects/arrays
+    // uploads the vertices and indices into the arena of the vertex layout
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        rg::GeometryArena& arena = rg::GeometryArena::forLayout(vertexLayout);
+        VAO = arena.vao();
+        setupIndices(arena);
+
+        if (vertexLayout.packed())
+            setupPackedStreams(arena);
+        else
+            setupInterleaved(arena);
+    }
+
+    // every LOD at 16 bits where its vertex ranges allow it, see rg::packIndices
+    void setupIndices(rg::GeometryArena& arena)
+    {
+        indexBuffers.resize(LodCount());
+        for (int level = 0; level < LodCount(); level++)
+        {
+            const vector<unsigned int>& source = level == 0 ? indices : lodIndices[level - 1];
+            IndexBuffer& buffer = indexBuffers[level];
+            rg::PackedIndices packed = rg::packIndices(source, compactIndices);
+            buffer.ranges = packed.ranges;
+            if (packed.wide)
+            {
+                buffer.type = GL_UNSIGNED_INT;
+                buffer.bytes = source.size() * sizeof(unsigned int);
+                buffer.range = arena.allocateIndices(buffer.bytes, source.data());
+            }
+            else
+            {
+                buffer.type = GL_UNSIGNED_SHORT;
+                buffer.bytes = packed.indices.size() * sizeof(uint16_t);
+                buffer.range = arena.allocateIndices(buffer.bytes, packed.indices.data());
+            }
+        }
+        if (useMeshlets)
+            buildMeshlets();
+    }
 
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    void releaseIndices(rg::GeometryArena& arena)
+    {
+        for (IndexBuffer& buffer : indexBuffers)
+            arena.releaseIndices(buffer.range);
+    }
+
+    // one stream per group of attributes that is read together, see rg::VertexLayout
+    void setupPackedStreams(rg::GeometryArena& arena)
+    {
+        rg::PackedVertices packed = rg::packVertices(vertices, vertexLayout);
+        positionOffset = packed.offset;
+        positionScale = packed.scale;
+        // positions with the bitangent sign in w, octahedral normal and uv, octahedral tangent
+        const void* streams[3] = {
+            vertexLayout.positions == rg::VertexLayout::SNORM16 ? (const void*) packed.positions.data()
+                                                                : (const void*) packed.halfPositions.data(),
+            packed.attributes.data(),
+            packed.tangents.data()
+        };
+        vertexRange = arena.allocateVertices(vertices.size(), streams);
+        vertexBufferBytes = vertices.size() * (8 + 8 + (vertexLayout.tangents ? 4 : 0));
+    }
+
+    void setupInterleaved(rg::GeometryArena& arena)
+    {
+        vertexBufferBytes = vertices.size() * sizeof(Vertex);
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+        const void* stream = &vertices[0];
+        vertexRange = arena.allocateVertices(vertices.size(), &stream);
     }
 };
 #endif
\ No newline at end of file
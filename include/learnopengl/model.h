@@ -12,17 +12,27 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
+#include <rg/MeshCache.h>
+#include <rg/MeshOptimizer.h>
+#include <rg/MeshSimplifier.h>
+#include <rg/TextureArrays.h>
+#include <rg/TextureCache.h>
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// model textures are decoded flipped, as learnopengl loads them (aiProcess_FlipUVs flips the UVs to match)
+const bool MODEL_TEXTURE_FLIP = true;
+
 
 
 class Model
@@ -40,11 +50,89 @@ public:
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
+    // draws the model, and thus all its meshes; meshes of one vertex layout share a VAO, it is only bound once
     void Draw(Shader &shader)
     {
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        rg::TextureBindings::instance().invalidate();
+        unsigned int bound = 0;
+        for(unsigned int i : drawOrder)
+        {
+            if (meshes[i].VAO != bound)
+            {
+                bound = meshes[i].VAO;
+                glBindVertexArray(bound);
+            }
+            meshes[i].Draw(shader, false);
+        }
+        glBindVertexArray(0);
+    }
+
+    // like Draw, but meshes at LOD 0 only draw the meshlets that are inside the frustum and not
+    // facing away from camera; projectionView and camera are in world space
+    void DrawCulled(Shader &shader, const glm::mat4& projectionView, const glm::mat4& model, const glm::vec3& camera,
+                    rg::MeshletStats& stats, bool simd = true)
+    {
+        rg::MeshletView view = meshletView(projectionView, model, camera);
+        rg::TextureBindings::instance().invalidate();
+        unsigned int bound = 0;
+        for(unsigned int i : drawOrder)
+        {
+            if (meshes[i].VAO != bound)
+            {
+                bound = meshes[i].VAO;
+                glBindVertexArray(bound);
+            }
+            meshes[i].DrawCulled(shader, view, stats, simd, false);
+        }
+        glBindVertexArray(0);
+    }
+
+    // only the culling of DrawCulled, nothing is drawn
+    void CullMeshlets(const glm::mat4& projectionView, const glm::mat4& model, const glm::vec3& camera,
+                      rg::MeshletStats& stats, bool simd = true)
+    {
+        rg::MeshletView view = meshletView(projectionView, model, camera);
+        for (Mesh& mesh: meshes)
+            mesh.CullMeshlets(view, stats, simd);
+    }
+
+    void SetMeshlets(bool enable)
+    {
+        for (Mesh& mesh: meshes)
+            mesh.SetMeshlets(enable);
+    }
+
+    size_t MeshletCount() const
+    {
+        size_t count = 0;
+        for (const Mesh& mesh: meshes)
+            count += mesh.MeshletCount();
+        return count;
+    }
+
+    // draws the diffuse and specular maps from texture arrays, one per image size, packed on
+    // first use; shaders need TEXTURE_ARRAYS. Meshes then draw grouped by array.
+    void SetTextureArrays(bool enable)
+    {
+        if (enable && textureArrays.empty())
+            packTextureArrays();
+        for (Mesh& mesh: meshes)
+            mesh.UseTextureArrays(enable);
+        sortDrawOrder(enable);
+    }
+
+    size_t TextureArrayCount() const
+    {
+        return textureArrays.size();
+    }
+
+    // hands the model's textures back to rg::TextureCache, for models dropped before the context ends
+    void ReleaseTextures()
+    {
+        for (const Texture& texture : textures_loaded)
+            rg::TextureCache::instance().release(texture.id);
+        textures_loaded.clear();
+        loadedTextureIndices.clear();
     }
 
     void SetShaderTextureNamePrefix(std::string prefix) {
@@ -52,28 +140,188 @@ public:
             mesh.glslIdentifierPrefix = prefix;
         }
     }
+
+    // re-uploads every mesh in another vertex layout
+    void SetVertexLayout(const rg::VertexLayout& layout)
+    {
+        for (Mesh& mesh: meshes)
+            mesh.SetVertexLayout(layout);
+    }
+
+    size_t VertexBufferBytes() const
+    {
+        size_t bytes = 0;
+        for (const Mesh& mesh: meshes)
+            bytes += mesh.VertexBufferBytes();
+        return bytes;
+    }
+
+    void SetCompactIndices(bool compact)
+    {
+        for (Mesh& mesh: meshes)
+            mesh.SetCompactIndices(compact);
+    }
+
+    size_t IndexBufferBytes() const
+    {
+        size_t bytes = 0;
+        for (const Mesh& mesh: meshes)
+            bytes += mesh.IndexBufferBytes();
+        return bytes;
+    }
+
+    // the most LODs any mesh has, LOD 0 is the full model
+    int LodCount() const
+    {
+        int count = 1;
+        for (const Mesh& mesh: meshes)
+            count = std::max(count, mesh.LodCount());
+        return count;
+    }
+
+    // the largest error of any mesh at that LOD, in model units
+    float LodError(int level) const
+    {
+        return rg::largestLodError(meshes, level);
+    }
+
+    void SetLod(int level)
+    {
+        for (Mesh& mesh: meshes)
+            mesh.SetLod(level);
+    }
+
+    // triangles one draw of the model renders at the selected LOD
+    size_t TriangleCount() const
+    {
+        size_t triangles = 0;
+        for (const Mesh& mesh: meshes)
+            triangles += mesh.TriangleCount();
+        return triangles;
+    }
+
+    // sphere around all vertices in model space: xyz center of the bounding box, w radius
+    glm::vec4 BoundingSphere() const {
+        glm::vec3 lo(1e30f), hi(-1e30f);
+        for (const Mesh& mesh: meshes) {
+            for (const Vertex& vertex: mesh.vertices) {
+                lo = glm::min(lo, vertex.Position);
+                hi = glm::max(hi, vertex.Position);
+            }
+        }
+        glm::vec3 center = (lo + hi) * 0.5f;
+        float radius = 0.0f;
+        for (const Mesh& mesh: meshes) {
+            for (const Vertex& vertex: mesh.vertices) {
+                radius = std::max(radius, glm::length(vertex.Position - center));
+            }
+        }
+        return glm::vec4(center, radius);
+    }
 private:
+    // the order Draw goes through the meshes
+    vector<unsigned int> drawOrder;
+    vector<GLuint> textureArrays;
+    // path to its index in textures_loaded
+    unordered_map<string, size_t> loadedTextureIndices;
+
+    // bounding spheres and normal cones stay in model space, the frustum and camera move there instead
+    static rg::MeshletView meshletView(const glm::mat4& projectionView, const glm::mat4& model, const glm::vec3& camera)
+    {
+        glm::vec3 modelCamera = glm::vec3(glm::inverse(model) * glm::vec4(camera, 1.0f));
+        return rg::MeshletView::fromMatrix(projectionView * model, modelCamera);
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // The imported and optimized meshes are kept in the mesh cache, later runs skip Assimp.
     void loadModel(string const &path)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
-        }
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        rg::MeshCache& cache = rg::MeshCache::instance();
+        string key = cache.key(path);
+        vector<rg::CachedMesh> imported;
+        if (cache.load(key, imported))
+        {
+            cout << "Mesh cache hit " << path << " (" << imported.size() << " meshes)" << endl;
+        }
+        else
+        {
+            // read file via ASSIMP
+            Assimp::Importer importer;
+            // identical vertices have to be joined, obj faces otherwise never share a vertex and no order helps the cache
+            const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices);
+            // check for errors
+            if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return;
+            }
+            // process ASSIMP's root node recursively
+            processNode(scene->mRootNode, scene, imported);
+            for (unsigned int i = 0; i < imported.size(); i++)
+                optimizeMesh(imported[i], path, i);
+            cache.store(key, imported);
+        }
+
+        for (const rg::CachedMesh& mesh : imported)
+            meshes.push_back(buildMesh(mesh));
+        sortDrawOrder(false);
+    }
+
+    // every diffuse and specular map the meshes use, in arrays of same-sized images
+    void packTextureArrays()
+    {
+        rg::TextureArrayPacker packer;
+        vector<vector<int>> images(meshes.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            for (const Texture& texture : meshes[i].textures)
+                images[i].push_back(texture.type == "texture_diffuse" || texture.type == "texture_specular"
+                                    ? packer.add(directory + '/' + texture.path, MODEL_TEXTURE_FLIP) : -1);
+        packer.build();
+        textureArrays = packer.arrays();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            vector<Texture> layered;
+            for (unsigned int t = 0; t < meshes[i].textures.size(); t++)
+            {
+                rg::TextureArrayPacker::Placement placement = packer.placement(images[i][t]);
+                if (placement.layer < 0)
+                    continue;
+                Texture texture = meshes[i].textures[t];
+                texture.id = placement.array;
+                texture.layer = placement.layer;
+                layered.push_back(texture);
+            }
+            meshes[i].SetTextureArrays(layered);
+        }
+        cout << "Texture arrays " << directory << ": " << packer.imageCount() << " textures in "
+             << textureArrays.size() << " arrays" << endl;
+    }
+
+    // meshes in load order, or with texture arrays grouped by VAO and array so that
+    // neighbours don't rebind
+    void sortDrawOrder(bool byMaterial)
+    {
+        drawOrder.resize(meshes.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            drawOrder[i] = i;
+        if (!byMaterial)
+            return;
+        auto key = [this](unsigned int i) {
+            vector<unsigned int> ids(1, meshes[i].VAO);
+            for (const Texture& texture : meshes[i].MaterialTextures())
+                ids.push_back(texture.id);
+            return ids;
+        };
+        std::stable_sort(drawOrder.begin(), drawOrder.end(), [&key](unsigned int a, unsigned int b) {
+            return key(a) < key(b);
+        });
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    void processNode(aiNode *node, const aiScene *scene, vector<rg::CachedMesh> &imported)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -81,22 +329,22 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            imported.push_back(processMesh(mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, imported);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    rg::CachedMesh processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        rg::CachedMesh result;
+        vector<Vertex> &vertices = result.vertices;
+        vector<unsigned int> &indices = result.indices;
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -164,55 +412,110 @@ private:
 
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        materialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", result.textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        materialTextures(material, aiTextureType_SPECULAR, "texture_specular", result.textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        materialTextures(material, aiTextureType_HEIGHT, "texture_normal", result.textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        materialTextures(material, aiTextureType_AMBIENT, "texture_height", result.textures);
 
+        return result;
+    }
 
+    // Assimp emits triangles in face order. Reorder them for the post-transform cache, then
+    // clusters for less overdraw, then the vertices in the order the indices first use them.
+    void optimizeMesh(rg::CachedMesh &mesh, const string &path, unsigned int index)
+    {
+        rg::VertexCacheStats before = rg::analyzeVertexCache(mesh.indices, mesh.vertices.size());
+        rg::optimizeVertexCache(mesh.indices, mesh.vertices.size());
+        vector<glm::vec3> positions(mesh.vertices.size());
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+            positions[i] = mesh.vertices[i].Position;
+        rg::optimizeOverdraw(mesh.indices, positions);
+        rg::optimizeVertexFetch(mesh.vertices, mesh.indices);
+        rg::VertexCacheStats after = rg::analyzeVertexCache(mesh.indices, mesh.vertices.size());
+        cout << "Mesh " << path << " #" << index << ": " << mesh.vertices.size() << " vertices, "
+             << mesh.indices.size() / 3 << " triangles, ACMR " << before.acmr << " -> " << after.acmr
+             << ", ATVR " << before.atvr << " -> " << after.atvr << endl;
+        generateLods(mesh);
+    }
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+    // Up to three LODs, each simplified from the one before to half its triangles. A LOD stops the
+    // chain when the error limit keeps it above 85% of the previous one. The errors add up along
+    // the chain, each LOD's error is an upper bound of its distance from the full mesh.
+    void generateLods(rg::CachedMesh &mesh)
+    {
+        const int maxLods = 3;
+        vector<glm::vec3> positions(mesh.vertices.size()), normals(mesh.vertices.size());
+        glm::vec3 lo(1e30f), hi(-1e30f);
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+        {
+            positions[i] = mesh.vertices[i].Position;
+            normals[i] = mesh.vertices[i].Normal;
+            lo = glm::min(lo, positions[i]);
+            hi = glm::max(hi, positions[i]);
+        }
+        // a LOD may move the surface by at most 2% of the mesh's size
+        float maxError = glm::length(hi - lo) * 0.5f * 0.02f;
+
+        mesh.lods.reserve(maxLods);
+        const vector<unsigned int>* previous = &mesh.indices;
+        float error = 0.0f;
+        cout << "    LODs: " << mesh.indices.size() / 3;
+        for (int level = 1; level <= maxLods; level++)
+        {
+            float levelError = 0.0f;
+            size_t target = previous->size() / 6 * 3;
+            vector<unsigned int> lod = rg::simplifyMesh(positions, normals, *previous, target, maxError, &levelError);
+            if (lod.empty() || lod.size() > previous->size() * 85 / 100)
+                break;
+            rg::optimizeVertexCache(lod, mesh.vertices.size());
+            error += levelError;
+            mesh.lods.push_back(lod);
+            mesh.lodErrors.push_back(error);
+            previous = &mesh.lods.back();
+            cout << " -> " << lod.size() / 3;
+        }
+        cout << " triangles" << endl;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    Mesh buildMesh(const rg::CachedMesh &mesh)
     {
         vector<Texture> textures;
+        for (const auto &texture : mesh.textures)
+            textures.push_back(textureFor(texture.second, texture.first));
+        // return a mesh object created from the extracted mesh data
+        return Mesh(mesh.vertices, mesh.indices, textures, mesh.lods, mesh.lodErrors);
+    }
+
+    // collects all material textures of a given type as (type, path) pairs
+    void materialTextures(aiMaterial *mat, aiTextureType type, string typeName, vector<pair<string, string>> &textures)
+    {
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(make_pair(typeName, string(str.C_Str())));
         }
-        return textures;
+    }
+
+    // loads a texture if it's not loaded yet, the required info is returned as a Texture struct.
+    // Textures other models loaded already come from rg::TextureCache.
+    Texture textureFor(const string &path, const string &typeName)
+    {
+        // check if texture was loaded before and if so, reuse it: skip loading a new texture
+        auto loaded = loadedTextureIndices.find(path);
+        if (loaded != loadedTextureIndices.end())
+            return textures_loaded[loaded->second];
+        // if texture hasn't been loaded already, load it
+        Texture texture;
+        texture.id = TextureFromFile(path.c_str(), this->directory);
+        texture.type = typeName;
+        texture.path = path;
+        loadedTextureIndices[path] = textures_loaded.size();
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
     }
 };
 
@@ -222,38 +525,9 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-//        std::cout << "Texture failed to load at path:: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    rg::TextureSettings settings;
+    settings.srgb = gamma;
+    settings.flip = MODEL_TEXTURE_FLIP;
+    return rg::TextureCache::instance().acquire(filename, settings);
 }
 #endif
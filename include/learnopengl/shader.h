@@ -8,101 +8,87 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
 #include <common.h>
+#include <rg/ShaderCache.h>
+#include <rg/ShaderPreprocessor.h>
 class Shader
 {
 public:
     unsigned int ID;
     // constructor generates the shader on the fly
+    // defines are injected right after the #version line, e.g. {"BLINN", "SHININESS 16.0"}
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const std::vector<std::string>& defines = {})
+        : vertexPath(vertexPath)
+        , fragmentPath(fragmentPath)
+        , geometryPath(geometryPath != nullptr ? geometryPath : "")
+        , defines(defines)
     {
-        std::string vertexPathString(vertexPath);
-        std::string fragmentPathString(fragmentPath);
+        std::sort(this->defines.begin(), this->defines.end());
+        bool linked;
+        ID = build(linked);
+    }
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
 
-        vertexPath = vertexPathString.c_str();
-        fragmentPath= fragmentPathString.c_str();
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                std::string geometryPathString(geometryPath);
-                geometryPath = geometryPathString.c_str();
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
+    // returns the permutation of this shader compiled with the given defines instead of its own.
+    // Permutations are compiled the first time they are asked for and kept for the lifetime of
+    // the shader, so selecting one every frame only costs a map lookup.
+    // ------------------------------------------------------------------------
+    Shader& variant(std::vector<std::string> variantDefines)
+    {
+        std::sort(variantDefines.begin(), variantDefines.end());
+        if (variantDefines == defines)
+            return *this;
+        std::string key;
+        for (const std::string& define : variantDefines)
+            key += define + ';';
+        std::unique_ptr<Shader>& shader = variants[key];
+        if (!shader)
+            shader.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(),
+                                    hasGeometryShader() ? geometryPath.c_str() : nullptr, variantDefines));
+        return *shader;
+    }
+    // recompiles this shader and all of its permutations from the files on disk. A program
+    // that fails to compile or link is thrown away and the previous one stays in use.
+    // ------------------------------------------------------------------------
+    bool reload()
+    {
+        bool allLinked = true;
+        bool linked;
+        GLuint program = build(linked);
+        if (linked)
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            copyUniforms(ID, program);
+            glDeleteProgram(ID);
+            ID = program;
+            std::cout << "Reloaded shader " << fragmentPath << describeDefines() << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
+        else
         {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            glDeleteProgram(program);
+            std::cout << "Keeping previous program for " << fragmentPath << describeDefines() << std::endl;
+            allLinked = false;
         }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
+        for (auto& variant : variants)
+            allLinked = variant.second->reload() && allLinked;
+        return allLinked;
+    }
 
+    // true if the given source file goes into this shader, directly or through #include
+    // ------------------------------------------------------------------------
+    bool dependsOn(const std::string& path) const
+    {
+        return dependencies.count(rg::ShaderPreprocessor::normalizePath(path)) > 0;
     }
+
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
@@ -169,6 +155,255 @@ public:
     }
 
 private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string geometryPath;
+    std::vector<std::string> defines;
+    std::map<std::string, std::unique_ptr<Shader>> variants;
+    std::set<std::string> dependencies;
+
+    // include paths are searched after the directory of the including file
+    static const rg::ShaderPreprocessor& preprocessor()
+    {
+        static rg::ShaderPreprocessor instance({"resources/shaders"});
+        return instance;
+    }
+
+    std::string loadSource(const std::string& path, std::set<std::string>& sourceFiles) const
+    {
+        rg::PreprocessedSource source = preprocessor().process(path);
+        sourceFiles.insert(rg::ShaderPreprocessor::normalizePath(path));
+        sourceFiles.insert(source.dependencies.begin(), source.dependencies.end());
+        if (!source.ok)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << source.error << std::endl;
+            return std::string();
+        }
+        return injectDefines(source.code);
+    }
+
+    std::string describeDefines() const
+    {
+        std::string result;
+        for (const std::string& define : defines)
+            result += " [" + define + "]";
+        return result;
+    }
+
+    bool hasGeometryShader() const
+    {
+        return !geometryPath.empty();
+    }
+
+    // the #version directive has to stay the first line, so defines go right after it
+    // ------------------------------------------------------------------------
+    std::string injectDefines(const std::string& source) const
+    {
+        if (defines.empty())
+            return source;
+        std::string block;
+        for (const std::string& define : defines)
+            block += "#define " + define + "\n";
+        size_t insertAt = 0;
+        if (source.compare(0, 8, "#version") == 0)
+        {
+            size_t lineEnd = source.find('\n');
+            insertAt = lineEnd == std::string::npos ? source.size() : lineEnd + 1;
+            // keep compiler error line numbers matching the file (GLSL 3.30 numbers the
+            // line after "#line 1" as line 2)
+            block += "#line 1\n";
+        }
+        return source.substr(0, insertAt) + block + source.substr(insertAt);
+    }
+
+    // reads the sources and creates a new program from them, from the binary cache if possible
+    // ------------------------------------------------------------------------
+    GLuint build(bool& linked)
+    {
+        auto start = std::chrono::steady_clock::now();
+        // 1. retrieve the source code from filePath and expand #include directives
+        std::set<std::string> sourceFiles;
+        std::string vertexCode = loadSource(vertexPath, sourceFiles);
+        std::string fragmentCode = loadSource(fragmentPath, sourceFiles);
+        std::string geometryCode;
+        // if geometry shader path is present, also load a geometry shader
+        if(hasGeometryShader())
+            geometryCode = loadSource(geometryPath, sourceFiles);
+        // 2. reuse the program binary from an earlier run if the sources and driver are unchanged
+        rg::ShaderCache& cache = rg::ShaderCache::instance();
+        std::string cacheKey = cache.key({vertexCode, fragmentCode, geometryCode});
+        GLuint program = glCreateProgram();
+        linked = cache.load(program, cacheKey);
+        if (!linked)
+        {
+            linked = compileAndLink(program, vertexCode, fragmentCode, hasGeometryShader() ? &geometryCode : nullptr);
+            if (linked)
+                cache.store(program, cacheKey);
+        }
+        // after a failed build also keep watching the files of the last good one
+        if (!linked)
+            sourceFiles.insert(dependencies.begin(), dependencies.end());
+        dependencies = sourceFiles;
+        cache.addTime(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        return program;
+    }
+
+    // copies the current value of every uniform that also exists in `to`, so a reloaded
+    // program keeps samplers and other state that was only set once at startup
+    // ------------------------------------------------------------------------
+    static void copyUniforms(GLuint from, GLuint to)
+    {
+        GLint previous = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+        glUseProgram(to);
+        GLint count = 0;
+        glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLchar name[256];
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(from, i, sizeof(name), NULL, &size, &type, name);
+            std::string base(name);
+            if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+                base.erase(base.size() - 3);
+            for (GLint element = 0; element < size; ++element)
+            {
+                std::string elementName = size > 1 ? base + "[" + std::to_string(element) + "]" : base;
+                GLint source = glGetUniformLocation(from, elementName.c_str());
+                GLint target = glGetUniformLocation(to, elementName.c_str());
+                if (source < 0 || target < 0)
+                    continue;
+                GLfloat f[16];
+                GLint n[4];
+                GLuint u[4];
+                switch (type)
+                {
+                    case GL_FLOAT:      glGetUniformfv(from, source, f); glUniform1fv(target, 1, f); break;
+                    case GL_FLOAT_VEC2: glGetUniformfv(from, source, f); glUniform2fv(target, 1, f); break;
+                    case GL_FLOAT_VEC3: glGetUniformfv(from, source, f); glUniform3fv(target, 1, f); break;
+                    case GL_FLOAT_VEC4: glGetUniformfv(from, source, f); glUniform4fv(target, 1, f); break;
+                    case GL_FLOAT_MAT2: glGetUniformfv(from, source, f); glUniformMatrix2fv(target, 1, GL_FALSE, f); break;
+                    case GL_FLOAT_MAT3: glGetUniformfv(from, source, f); glUniformMatrix3fv(target, 1, GL_FALSE, f); break;
+                    case GL_FLOAT_MAT4: glGetUniformfv(from, source, f); glUniformMatrix4fv(target, 1, GL_FALSE, f); break;
+                    case GL_FLOAT_MAT2x3: glGetUniformfv(from, source, f); glUniformMatrix2x3fv(target, 1, GL_FALSE, f); break;
+                    case GL_FLOAT_MAT2x4: glGetUniformfv(from, source, f); glUniformMatrix2x4fv(target, 1, GL_FALSE, f); break;
+                    case GL_FLOAT_MAT3x2: glGetUniformfv(from, source, f); glUniformMatrix3x2fv(target, 1, GL_FALSE, f); break;
+                    case GL_FLOAT_MAT3x4: glGetUniformfv(from, source, f); glUniformMatrix3x4fv(target, 1, GL_FALSE, f); break;
+                    case GL_FLOAT_MAT4x2: glGetUniformfv(from, source, f); glUniformMatrix4x2fv(target, 1, GL_FALSE, f); break;
+                    case GL_FLOAT_MAT4x3: glGetUniformfv(from, source, f); glUniformMatrix4x3fv(target, 1, GL_FALSE, f); break;
+                    case GL_INT_VEC2:
+                    case GL_BOOL_VEC2:  glGetUniformiv(from, source, n); glUniform2iv(target, 1, n); break;
+                    case GL_INT_VEC3:
+                    case GL_BOOL_VEC3:  glGetUniformiv(from, source, n); glUniform3iv(target, 1, n); break;
+                    case GL_INT_VEC4:
+                    case GL_BOOL_VEC4:  glGetUniformiv(from, source, n); glUniform4iv(target, 1, n); break;
+                    case GL_UNSIGNED_INT:      glGetUniformuiv(from, source, u); glUniform1uiv(target, 1, u); break;
+                    case GL_UNSIGNED_INT_VEC2: glGetUniformuiv(from, source, u); glUniform2uiv(target, 1, u); break;
+                    case GL_UNSIGNED_INT_VEC3: glGetUniformuiv(from, source, u); glUniform3uiv(target, 1, u); break;
+                    case GL_UNSIGNED_INT_VEC4: glGetUniformuiv(from, source, u); glUniform4uiv(target, 1, u); break;
+                    case GL_INT:
+                    case GL_BOOL:
+                        glGetUniformiv(from, source, n); glUniform1iv(target, 1, n); break;
+                    default:
+                        // samplers hold their texture unit as an int; anything else this GL 3.3
+                        // loader has no setter for (doubles need GL 4.0) keeps its default
+                        if (isSamplerType(type))
+                        {
+                            glGetUniformiv(from, source, n);
+                            glUniform1iv(target, 1, n);
+                        }
+                        else
+                        {
+                            std::cout << "WARNING::SHADER::UNIFORM_NOT_COPIED " << elementName << " of type 0x"
+                                      << std::hex << type << std::dec << std::endl;
+                        }
+                        break;
+                }
+            }
+        }
+        glUseProgram(previous);
+    }
+
+    // the GL 3.3 sampler types, whose uniforms hold a texture unit
+    // ------------------------------------------------------------------------
+    static bool isSamplerType(GLenum type)
+    {
+        switch (type)
+        {
+            case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+            case GL_SAMPLER_1D_SHADOW: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_CUBE_SHADOW:
+            case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY:
+            case GL_SAMPLER_1D_ARRAY_SHADOW: case GL_SAMPLER_2D_ARRAY_SHADOW:
+            case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+            case GL_SAMPLER_BUFFER: case GL_SAMPLER_2D_RECT: case GL_SAMPLER_2D_RECT_SHADOW:
+            case GL_INT_SAMPLER_1D: case GL_INT_SAMPLER_2D: case GL_INT_SAMPLER_3D: case GL_INT_SAMPLER_CUBE:
+            case GL_INT_SAMPLER_1D_ARRAY: case GL_INT_SAMPLER_2D_ARRAY:
+            case GL_INT_SAMPLER_2D_MULTISAMPLE: case GL_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+            case GL_INT_SAMPLER_BUFFER: case GL_INT_SAMPLER_2D_RECT:
+            case GL_UNSIGNED_INT_SAMPLER_1D: case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_3D:
+            case GL_UNSIGNED_INT_SAMPLER_CUBE: case GL_UNSIGNED_INT_SAMPLER_1D_ARRAY:
+            case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY: case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE:
+            case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY: case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+            case GL_UNSIGNED_INT_SAMPLER_2D_RECT:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // compiles the given sources and links them into program, returns the link status
+    // ------------------------------------------------------------------------
+    bool compileAndLink(GLuint program, const std::string& vertexCode, const std::string& fragmentCode, const std::string* geometryCode)
+    {
+        const char* vShaderCode = vertexCode.c_str();
+        const char * fShaderCode = fragmentCode.c_str();
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+        // if geometry shader is given, compile geometry shader
+        unsigned int geometry;
+        if(geometryCode != nullptr)
+        {
+            const char * gShaderCode = geometryCode->c_str();
+            geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(geometry, 1, &gShaderCode, NULL);
+            glCompileShader(geometry);
+            checkCompileErrors(geometry, "GEOMETRY");
+        }
+        // shader Program
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        if(geometryCode != nullptr)
+            glAttachShader(program, geometry);
+        // the driver only keeps a retrievable binary around if asked before linking
+        if(rg::ShaderCache::instance().enabled())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+        checkCompileErrors(program, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessery
+        glDetachShader(program, vertex);
+        glDetachShader(program, fragment);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        if(geometryCode != nullptr)
+        {
+            glDetachShader(program, geometry);
+            glDeleteShader(geometry);
+        }
+        GLint success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success;
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
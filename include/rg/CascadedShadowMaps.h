@@ -0,0 +1,225 @@
+#ifndef PROJECT_BASE_CASCADEDSHADOWMAPS_H
+#define PROJECT_BASE_CASCADEDSHADOWMAPS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <learnopengl/shader.h>
+#include <rg/GpuMemory.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+namespace rg {
+
+// Cascaded shadow maps for one directional light. The view frustum up to shadowDistance is
+// split into cascades (a blend of logarithmic and uniform splits) and every cascade gets an
+// orthographic projection around the bounding sphere of its frustum slice. The sphere does
+// not change size when the camera turns, and its center is snapped to whole shadow map
+// texels, so the shadow edges do not swim while the camera moves. All cascades live in one
+// depth texture array that lib/shadows.glsl samples with hardware comparison and PCF.
+class CascadedShadowMaps {
+public:
+    static const int MAX_CASCADES = 4;
+
+    CascadedShadowMaps(int cascadeCount, int resolution) {
+        glGenFramebuffers(1, &m_Framebuffer);
+        configure(cascadeCount, resolution);
+    }
+
+    ~CascadedShadowMaps() {
+        GpuMemory::instance().forget(GpuMemory::TEXTURE, m_Texture);
+        glDeleteTextures(1, &m_Texture);
+        glDeleteFramebuffers(1, &m_Framebuffer);
+    }
+
+    CascadedShadowMaps(const CascadedShadowMaps&) = delete;
+    CascadedShadowMaps& operator=(const CascadedShadowMaps&) = delete;
+
+    // reallocates the depth array when the cascade count or resolution changes
+    void configure(int cascadeCount, int resolution) {
+        cascadeCount = std::min(std::max(cascadeCount, 1), (int) MAX_CASCADES);
+        if (m_Texture && cascadeCount == m_CascadeCount && resolution == m_Resolution) {
+            return;
+        }
+        m_CascadeCount = cascadeCount;
+        m_Resolution = resolution;
+        GpuMemory::instance().forget(GpuMemory::TEXTURE, m_Texture);
+        glDeleteTextures(1, &m_Texture);
+        glGenTextures(1, &m_Texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_Texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, cascadeCount, 0,
+                     GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        GpuMemory::instance().track(GpuMemory::TEXTURE, m_Texture, textureBytes(resolution, resolution, 4, 1, cascadeCount),
+                                    "cascaded shadows");
+        // linear filtering on a comparison sampler gives a 2x2 PCF tap for free
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_Texture, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::CASCADED_SHADOW_MAPS::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void setShadowDistance(float distance) {
+        m_ShadowDistance = distance;
+    }
+    // 0 gives uniform splits, 1 logarithmic ones
+    void setSplitLambda(float lambda) {
+        m_SplitLambda = lambda;
+    }
+
+    // direction is the direction the light travels in, as in DirLight.direction
+    void update(const glm::mat4& view, float fovY, float aspect, float nearPlane, const glm::vec3& direction) {
+        m_View = view;
+        glm::mat4 inverseView = glm::inverse(view);
+        glm::vec3 lightDir = glm::normalize(direction);
+        glm::vec3 up = std::fabs(lightDir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        float tanY = std::tan(fovY * 0.5f);
+        float tanX = tanY * aspect;
+
+        float sliceNear = nearPlane;
+        for (int i = 0; i < m_CascadeCount; ++i) {
+            float t = (float) (i + 1) / m_CascadeCount;
+            float logSplit = nearPlane * std::pow(m_ShadowDistance / nearPlane, t);
+            float uniformSplit = nearPlane + (m_ShadowDistance - nearPlane) * t;
+            float sliceFar = m_SplitLambda * logSplit + (1.0f - m_SplitLambda) * uniformSplit;
+            m_Splits[i] = sliceFar;
+
+            // bounding sphere of the slice, computed in view space so it only depends on the
+            // slice depths and the projection, not on where the camera is looking
+            glm::vec3 corners[8];
+            glm::vec3 center(0.0f);
+            for (int c = 0; c < 8; ++c) {
+                float depth = (c & 4) ? sliceFar : sliceNear;
+                corners[c] = glm::vec3(((c & 1) ? 1.0f : -1.0f) * tanX * depth,
+                                       ((c & 2) ? 1.0f : -1.0f) * tanY * depth, -depth);
+                center += corners[c];
+            }
+            center /= 8.0f;
+            float radius = 0.0f;
+            for (int c = 0; c < 8; ++c) {
+                radius = std::max(radius, glm::length(corners[c] - center));
+            }
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+            glm::vec3 worldCenter = glm::vec3(inverseView * glm::vec4(center, 1.0f));
+
+            // the light looks at the sphere from its surface; casters between the light and the
+            // near plane are flattened onto it by depth clamping in the shadow pass
+            Cascade& cascade = m_Cascades[i];
+            cascade.radius = radius;
+            cascade.lightView = glm::lookAt(worldCenter - lightDir * radius, worldCenter, up);
+            glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius);
+
+            // move the projection by less than a texel so the world origin falls on a texel corner
+            glm::vec4 origin = projection * cascade.lightView * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            float texelsPerUnit = m_Resolution * 0.5f;
+            glm::vec2 texel = glm::vec2(origin.x, origin.y) * texelsPerUnit;
+            projection[3][0] += (std::round(texel.x) - texel.x) / texelsPerUnit;
+            projection[3][1] += (std::round(texel.y) - texel.y) / texelsPerUnit;
+
+            cascade.matrix = projection * cascade.lightView;
+            cascade.texelSize = 2.0f * radius / m_Resolution;
+            sliceNear = sliceFar;
+        }
+    }
+
+    // binds the layer of one cascade and clears it; draw the casters with matrix(cascade)
+    void beginCascade(int cascade) {
+        if (cascade == 0) {
+            glGetIntegerv(GL_VIEWPORT, m_SavedViewport);
+            glViewport(0, 0, m_Resolution, m_Resolution);
+            // casters in front of the light's near plane still have to land in the map
+            glEnable(GL_DEPTH_CLAMP);
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(2.0f, 4.0f);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_Texture, 0, cascade);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    // restores the state beginCascade changed and binds target
+    void endPass(GLuint target) {
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glDisable(GL_DEPTH_CLAMP);
+        glViewport(m_SavedViewport[0], m_SavedViewport[1], m_SavedViewport[2], m_SavedViewport[3]);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+
+    // bounding sphere against the cascade's box, so each cascade only draws its own casters;
+    // nothing is culled on the light's side, those casters are clamped onto the near plane
+    bool casterVisible(int cascade, const glm::vec3& center, float radius) const {
+        const Cascade& c = m_Cascades[cascade];
+        glm::vec3 p = glm::vec3(c.lightView * glm::vec4(center, 1.0f));
+        return std::fabs(p.x) <= c.radius + radius
+               && std::fabs(p.y) <= c.radius + radius
+               && -p.z <= 2.0f * c.radius + radius;
+    }
+
+    const glm::mat4& matrix(int cascade) const {
+        return m_Cascades[cascade].matrix;
+    }
+
+    // binds the depth array to unit and sets the lib/shadows.glsl uniforms
+    void bind(Shader& shader, unsigned int unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_Texture);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("shadowMap", unit);
+        shader.setInt("cascadeCount", m_CascadeCount);
+        shader.setMat4("shadowView", m_View);
+        glm::vec4 splits(0.0f), texelSizes(0.0f);
+        for (int i = 0; i < m_CascadeCount; ++i) {
+            shader.setMat4("cascadeMatrices[" + std::to_string(i) + "]", m_Cascades[i].matrix);
+            splits[i] = m_Splits[i];
+            texelSizes[i] = m_Cascades[i].texelSize;
+        }
+        shader.setVec4("cascadeSplits", splits);
+        shader.setVec4("cascadeTexelSizes", texelSizes);
+    }
+
+    int cascadeCount() const {
+        return m_CascadeCount;
+    }
+    int resolution() const {
+        return m_Resolution;
+    }
+    float split(int cascade) const {
+        return m_Splits[cascade];
+    }
+
+private:
+    struct Cascade {
+        glm::mat4 lightView = glm::mat4(1.0f);
+        glm::mat4 matrix = glm::mat4(1.0f);
+        float radius = 1.0f;
+        float texelSize = 1.0f;
+    };
+
+    GLuint m_Framebuffer = 0;
+    GLuint m_Texture = 0;
+    int m_CascadeCount = 0;
+    int m_Resolution = 0;
+    float m_ShadowDistance = 150.0f;
+    float m_SplitLambda = 0.8f;
+    glm::mat4 m_View = glm::mat4(1.0f);
+    Cascade m_Cascades[MAX_CASCADES];
+    float m_Splits[MAX_CASCADES] = {};
+    GLint m_SavedViewport[4] = {};
+};
+
+}
+
+#endif //PROJECT_BASE_CASCADEDSHADOWMAPS_H
@@ -0,0 +1,376 @@
+#ifndef PROJECT_BASE_CLUSTEREDLIGHTING_H
+#define PROJECT_BASE_CLUSTEREDLIGHTING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <rg/GpuMemory.h>
+#include <rg/JobSystem.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace rg {
+
+struct ClusterLight {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+};
+
+// Clustered forward lighting. The view frustum is cut into CLUSTERS_X * CLUSTERS_Y screen
+// tiles and CLUSTERS_Z exponential depth slices. Every frame the point lights are assigned
+// to the clusters they touch on the CPU and three texture buffers are uploaded:
+//   lights   RGBA32F, two texels per light: (position, radius), (color, 0)
+//   grid     RG32UI, per cluster: (first index, light count)
+//   indices  R32UI, the per-cluster light lists back to back
+// lib/clustered.glsl then only walks the lights of the fragment's own cluster.
+class ClusteredLighting {
+public:
+    static const int CLUSTERS_X = 16;
+    static const int CLUSTERS_Y = 9;
+    static const int CLUSTERS_Z = 24;
+    static const int CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+    // depth slices assigned per job
+    static const int SLICES_PER_JOB = 2;
+
+    ClusteredLighting() {
+        glGenBuffers(3, m_Buffers);
+        glGenTextures(3, m_Textures);
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        for (int i = 0; i < 3; ++i) {
+            glBindBuffer(GL_TEXTURE_BUFFER, m_Buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            GpuMemory::instance().track(GpuMemory::BUFFER, m_Buffers[i], 16, "clustered lighting");
+            glBindTexture(GL_TEXTURE_BUFFER, m_Textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], m_Buffers[i]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        GLint maxTexels = 65536;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        m_MaxIndices = (size_t) maxTexels;
+    }
+
+    ~ClusteredLighting() {
+        for (GLuint buffer : m_Buffers) {
+            GpuMemory::instance().forget(GpuMemory::BUFFER, buffer);
+        }
+        glDeleteTextures(3, m_Textures);
+        glDeleteBuffers(3, m_Buffers);
+    }
+
+    ClusteredLighting(const ClusteredLighting&) = delete;
+    ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+    // cluster bounds only depend on the projection, they are rebuilt when it changes
+    void setProjection(const glm::mat4& projection, float nearPlane, float farPlane) {
+        if (!m_ClusterMin.empty() && projection == m_Projection && nearPlane == m_Near && farPlane == m_Far) {
+            return;
+        }
+        m_Projection = projection;
+        m_InverseProjection = glm::inverse(projection);
+        m_Near = nearPlane;
+        m_Far = farPlane;
+        buildClusterBounds();
+    }
+
+    // assigns the lights to clusters and uploads the result
+    void update(const std::vector<ClusterLight>& lights, const glm::mat4& view) {
+        auto start = std::chrono::steady_clock::now();
+        m_LightCount = lights.size();
+        gatherViewSpaceLights(lights, view);
+        assign();
+        m_AssignMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        upload(lights);
+    }
+
+    // binds the three buffers to consecutive texture units starting at firstUnit
+    void bind(Shader& shader, const glm::mat4& view, unsigned int firstUnit) const {
+        const char* names[3] = { "clusterLights", "clusterGrid", "clusterIndices" };
+        for (int i = 0; i < 3; ++i) {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, m_Textures[i]);
+            shader.setInt(names[i], firstUnit + i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        float logRatio = std::log(m_Far / m_Near);
+        shader.setMat4("clusterView", view);
+        shader.setVec4("clusterParams", (float) m_ViewportWidth / CLUSTERS_X, (float) m_ViewportHeight / CLUSTERS_Y,
+                       CLUSTERS_Z / logRatio, -CLUSTERS_Z * std::log(m_Near) / logRatio);
+    }
+
+    void setViewport(int width, int height) {
+        m_ViewportWidth = width;
+        m_ViewportHeight = height;
+    }
+
+    double assignMilliseconds() const {
+        return m_AssignMilliseconds;
+    }
+    size_t lightCount() const {
+        return m_LightCount;
+    }
+    size_t indexCount() const {
+        return m_Indices.size();
+    }
+    // lights that did not fit once the index buffer reached GL_MAX_TEXTURE_BUFFER_SIZE
+    size_t droppedIndices() const {
+        return m_Dropped;
+    }
+
+private:
+    // view space depth (positive) of the near plane of a slice
+    float sliceDepth(int slice) const {
+        return m_Near * std::pow(m_Far / m_Near, (float) slice / CLUSTERS_Z);
+    }
+
+    int sliceOf(float depth) const {
+        int slice = (int) std::floor(std::log(depth / m_Near) / std::log(m_Far / m_Near) * CLUSTERS_Z);
+        return std::min(std::max(slice, 0), CLUSTERS_Z - 1);
+    }
+
+    void buildClusterBounds() {
+        m_ClusterMin.assign(CLUSTER_COUNT, glm::vec3(0.0f));
+        m_ClusterMax.assign(CLUSTER_COUNT, glm::vec3(0.0f));
+        for (int z = 0; z < CLUSTERS_Z; ++z) {
+            float depths[2] = { sliceDepth(z), sliceDepth(z + 1) };
+            for (int y = 0; y < CLUSTERS_Y; ++y) {
+                for (int x = 0; x < CLUSTERS_X; ++x) {
+                    glm::vec3 lo(1e30f), hi(-1e30f);
+                    for (int corner = 0; corner < 4; ++corner) {
+                        float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / CLUSTERS_X;
+                        float ndcY = -1.0f + 2.0f * (y + (corner >> 1)) / CLUSTERS_Y;
+                        // point on the near plane, then slide along its view ray
+                        glm::vec4 p = m_InverseProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+                        glm::vec3 ray = glm::vec3(p) / p.w;
+                        for (float depth : depths) {
+                            glm::vec3 point = ray * (depth / -ray.z);
+                            lo = glm::min(lo, point);
+                            hi = glm::max(hi, point);
+                        }
+                    }
+                    int index = clusterIndex(x, y, z);
+                    m_ClusterMin[index] = lo;
+                    m_ClusterMax[index] = hi;
+                }
+            }
+        }
+    }
+
+    static int clusterIndex(int x, int y, int z) {
+        return (z * CLUSTERS_Y + y) * CLUSTERS_X + x;
+    }
+
+    void gatherViewSpaceLights(const std::vector<ClusterLight>& lights, const glm::mat4& view) {
+        m_ViewLights.clear();
+        m_ViewLights.reserve(lights.size());
+        for (size_t i = 0; i < lights.size(); ++i) {
+            glm::vec3 p = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+            float r = lights[i].radius;
+            float closest = -p.z - r;
+            float farthest = -p.z + r;
+            if (farthest < m_Near || closest > m_Far) {
+                continue;
+            }
+            ViewLight light;
+            light.position = p;
+            light.radius = r;
+            light.index = (uint32_t) i;
+            light.firstSlice = sliceOf(std::max(closest, m_Near));
+            light.lastSlice = sliceOf(std::min(farthest, m_Far));
+            m_ViewLights.push_back(light);
+        }
+    }
+
+    // per depth slice: lights overlapping the slice, as SoA padded to a multiple of 4
+    struct SliceCandidates {
+        std::vector<float> x, y, z, radiusSquared;
+        std::vector<uint32_t> index;
+    };
+
+    void assign() {
+        m_Grid.assign(CLUSTER_COUNT * 2, 0);
+        m_SliceIndices.resize(CLUSTERS_Z);
+
+        auto work = [this](int firstSlice, int lastSlice) {
+            SliceCandidates candidates;
+            for (int z = firstSlice; z < lastSlice; ++z) {
+                collectCandidates(z, candidates);
+                assignSlice(z, candidates);
+            }
+        };
+
+        // a handful of lights is cheaper to assign than to hand out as jobs
+        if (m_ViewLights.size() < 64) {
+            work(0, CLUSTERS_Z);
+        } else {
+            JobSystem::instance().parallelFor(CLUSTERS_Z, SLICES_PER_JOB, [&work](size_t first, size_t last) {
+                work((int) first, (int) last);
+            });
+        }
+
+        // slices were filled independently, stitch them into one index list
+        m_Indices.clear();
+        m_Dropped = 0;
+        for (int z = 0; z < CLUSTERS_Z; ++z) {
+            uint32_t base = (uint32_t) m_Indices.size();
+            for (int cluster = clusterIndex(0, 0, z); cluster < clusterIndex(0, 0, z + 1); ++cluster) {
+                m_Grid[cluster * 2] += base;
+            }
+            const std::vector<uint32_t>& slice = m_SliceIndices[z];
+            size_t room = m_MaxIndices - std::min(m_MaxIndices, m_Indices.size());
+            if (slice.size() > room) {
+                m_Dropped += slice.size() - room;
+                for (int cluster = clusterIndex(0, 0, z); cluster < clusterIndex(0, 0, z + 1); ++cluster) {
+                    uint32_t first = m_Grid[cluster * 2];
+                    uint32_t available = first >= m_MaxIndices ? 0 : (uint32_t) (m_MaxIndices - first);
+                    m_Grid[cluster * 2 + 1] = std::min(m_Grid[cluster * 2 + 1], available);
+                }
+            }
+            m_Indices.insert(m_Indices.end(), slice.begin(), slice.begin() + std::min(slice.size(), room));
+        }
+    }
+
+    void collectCandidates(int z, SliceCandidates& candidates) const {
+        candidates.x.clear();
+        candidates.y.clear();
+        candidates.z.clear();
+        candidates.radiusSquared.clear();
+        candidates.index.clear();
+        for (const ViewLight& light : m_ViewLights) {
+            if (z < light.firstSlice || z > light.lastSlice) {
+                continue;
+            }
+            candidates.x.push_back(light.position.x);
+            candidates.y.push_back(light.position.y);
+            candidates.z.push_back(light.position.z);
+            candidates.radiusSquared.push_back(light.radius * light.radius);
+            candidates.index.push_back(light.index);
+        }
+        // padding lights can never pass the test
+        while (candidates.x.size() % 4) {
+            candidates.x.push_back(1e30f);
+            candidates.y.push_back(1e30f);
+            candidates.z.push_back(1e30f);
+            candidates.radiusSquared.push_back(-1.0f);
+            candidates.index.push_back(0);
+        }
+    }
+
+    void assignSlice(int z, const SliceCandidates& c) {
+        std::vector<uint32_t>& out = m_SliceIndices[z];
+        out.clear();
+        size_t count = c.x.size();
+        for (int y = 0; y < CLUSTERS_Y; ++y) {
+            for (int x = 0; x < CLUSTERS_X; ++x) {
+                int cluster = clusterIndex(x, y, z);
+                const glm::vec3& lo = m_ClusterMin[cluster];
+                const glm::vec3& hi = m_ClusterMax[cluster];
+                uint32_t first = (uint32_t) out.size();
+                // sphere vs box: squared distance from the light to the closest point of the box
+#if defined(__SSE2__)
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 loX = _mm_set1_ps(lo.x), loY = _mm_set1_ps(lo.y), loZ = _mm_set1_ps(lo.z);
+                const __m128 hiX = _mm_set1_ps(hi.x), hiY = _mm_set1_ps(hi.y), hiZ = _mm_set1_ps(hi.z);
+                for (size_t i = 0; i < count; i += 4) {
+                    __m128 px = _mm_loadu_ps(&c.x[i]);
+                    __m128 py = _mm_loadu_ps(&c.y[i]);
+                    __m128 pz = _mm_loadu_ps(&c.z[i]);
+                    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(loX, px), _mm_sub_ps(px, hiX)), zero);
+                    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(loY, py), _mm_sub_ps(py, hiY)), zero);
+                    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(loZ, pz), _mm_sub_ps(pz, hiZ)), zero);
+                    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_loadu_ps(&c.radiusSquared[i])));
+                    while (mask) {
+                        int lane = __builtin_ctz(mask);
+                        out.push_back(c.index[i + lane]);
+                        mask &= mask - 1;
+                    }
+                }
+#else
+                for (size_t i = 0; i < count; ++i) {
+                    float dx = std::max(std::max(lo.x - c.x[i], c.x[i] - hi.x), 0.0f);
+                    float dy = std::max(std::max(lo.y - c.y[i], c.y[i] - hi.y), 0.0f);
+                    float dz = std::max(std::max(lo.z - c.z[i], c.z[i] - hi.z), 0.0f);
+                    if (dx * dx + dy * dy + dz * dz <= c.radiusSquared[i]) {
+                        out.push_back(c.index[i]);
+                    }
+                }
+#endif
+                // offsets are relative to the slice until assign() stitches the slices together
+                m_Grid[cluster * 2] = first;
+                m_Grid[cluster * 2 + 1] = (uint32_t) out.size() - first;
+            }
+        }
+    }
+
+    void upload(const std::vector<ClusterLight>& lights) {
+        m_LightData.resize(std::max<size_t>(lights.size(), 1) * 8);
+        for (size_t i = 0; i < lights.size(); ++i) {
+            float* texel = &m_LightData[i * 8];
+            texel[0] = lights[i].position.x;
+            texel[1] = lights[i].position.y;
+            texel[2] = lights[i].position.z;
+            texel[3] = lights[i].radius;
+            texel[4] = lights[i].color.x;
+            texel[5] = lights[i].color.y;
+            texel[6] = lights[i].color.z;
+            texel[7] = 0.0f;
+        }
+        if (m_Indices.empty()) {
+            m_Indices.push_back(0);
+        }
+        // respecifying the storage orphans it, the previous frame may still be reading the old one
+        uploadBuffer(m_Buffers[0], m_LightData.data(), m_LightData.size() * sizeof(float));
+        uploadBuffer(m_Buffers[1], m_Grid.data(), m_Grid.size() * sizeof(uint32_t));
+        uploadBuffer(m_Buffers[2], m_Indices.data(), m_Indices.size() * sizeof(uint32_t));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    static void uploadBuffer(GLuint buffer, const void* data, size_t size) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+        GpuMemory::instance().track(GpuMemory::BUFFER, buffer, size, "clustered lighting");
+    }
+
+    struct ViewLight {
+        glm::vec3 position;
+        float radius;
+        uint32_t index;
+        int firstSlice;
+        int lastSlice;
+    };
+
+    GLuint m_Buffers[3] = {};
+    GLuint m_Textures[3] = {};
+    glm::mat4 m_Projection = glm::mat4(0.0f);
+    glm::mat4 m_InverseProjection = glm::mat4(1.0f);
+    float m_Near = 0.1f;
+    float m_Far = 100.0f;
+    int m_ViewportWidth = 1;
+    int m_ViewportHeight = 1;
+
+    std::vector<glm::vec3> m_ClusterMin;
+    std::vector<glm::vec3> m_ClusterMax;
+    std::vector<ViewLight> m_ViewLights;
+    std::vector<std::vector<uint32_t>> m_SliceIndices;
+    std::vector<uint32_t> m_Grid;
+    std::vector<uint32_t> m_Indices;
+    std::vector<float> m_LightData;
+    size_t m_MaxIndices = 65536;
+    size_t m_Dropped = 0;
+    size_t m_LightCount = 0;
+    double m_AssignMilliseconds = 0.0;
+};
+
+}
+
+#endif //PROJECT_BASE_CLUSTEREDLIGHTING_H
@@ -0,0 +1,532 @@
+#ifndef PROJECT_BASE_CUBEMAPIMPORTER_H
+#define PROJECT_BASE_CUBEMAPIMPORTER_H
+
+#include <glad/glad.h>
+#include <rg/GpuMemory.h>
+#include <rg/HalfFloat.h>
+#include <rg/JobSystem.h>
+#include <rg/MipStreaming.h>
+#include <rg/Hash.h>
+#include <stb_image.h>
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Where the six faces of a cubemap come from.
+//   FACES     six images in GL face order +X -X +Y -Y +Z -Z
+//   CROSS     one image, a horizontal (4x3) or vertical (3x4) cross, picked by its aspect
+//   EQUIRECT  one 2:1 latitude/longitude image
+// Radiance .hdr files (anything stb_image reports as HDR) become RGB16F cubemaps, everything
+// else stays RGB8.
+struct CubemapSource {
+    enum Layout { FACES, CROSS, EQUIRECT };
+
+    Layout layout = FACES;
+    std::vector<std::string> files;
+    // the images are stored bottom row first
+    bool flip = false;
+    // edge length of an equirect face; 0 takes a quarter of the image width
+    int faceSize = 0;
+};
+
+// Turns a CubemapSource into a mipmapped GL cubemap. Decoding, face extraction, mips and the
+// half float conversion run on the CPU as a job per file and per face. The result is
+// written to resources/cubemap_cache in the layout glTexImage2D takes, keyed by the source
+// files' names, sizes and modification times, so later runs only read and upload it.
+// stb_image's vertical flip is a global switch that is not safe to toggle while other
+// jobs decode, so import() turns it off and flips rows itself.
+class CubemapImporter {
+public:
+    struct Stats {
+        bool fromCache = false;
+        bool hdr = false;
+        int faceSize = 0;
+        int mips = 0;
+        int firstMip = 0;               // finest level uploaded, above 0 when streamed
+        size_t bytes = 0;
+        double decodeMilliseconds = 0.0;
+        double convertMilliseconds = 0.0;
+        double uploadMilliseconds = 0.0;
+        double totalMilliseconds = 0.0;
+    };
+
+    // a new cubemap texture, or 0 if the source could not be read. Streamed, only the tail
+    // rg::MipStreaming keeps resident is uploaded; bakedMips() is where the rest comes from.
+    GLuint import(const CubemapSource& source, bool streamed = false) {
+        auto start = std::chrono::steady_clock::now();
+        m_Stats = Stats();
+        std::string key = sourceKey(source);
+        Baked baked;
+        if (readCache(key, baked)) {
+            m_Stats.fromCache = true;
+        } else {
+            if (!bake(source, baked)) {
+                return 0;
+            }
+            writeCache(key, baked);
+        }
+        auto uploadStart = std::chrono::steady_clock::now();
+        m_Mips = BakedMips();
+        m_Mips.file = pathFor(key);
+        m_Mips.target = GL_TEXTURE_CUBE_MAP;
+        m_Mips.width = m_Mips.height = baked.size;
+        m_Mips.levels = baked.mips;
+        m_Mips.internalFormat = baked.hdr ? GL_RGB16F : GL_RGB8;
+        m_Mips.format = GL_RGB;
+        m_Mips.type = baked.hdr ? GL_HALF_FLOAT : GL_UNSIGNED_BYTE;
+        m_Mips.texelBytes = baked.hdr ? 3 * sizeof(uint16_t) : 3;
+        // RGB is padded to 4 components by most drivers
+        m_Mips.residentTexelBytes = baked.hdr ? 8 : 4;
+        m_Mips.wrap = GL_CLAMP_TO_EDGE;
+        m_Mips.offset = sizeof(Header);
+        m_Stats.firstMip = streamed ? MipStreaming::tailLevel(baked.size, baked.size) : 0;
+        GLuint texture = upload(baked, m_Stats.firstMip);
+        m_Stats.uploadMilliseconds = millisecondsSince(uploadStart);
+        m_Stats.hdr = baked.hdr;
+        m_Stats.faceSize = baked.size;
+        m_Stats.mips = baked.mips;
+        m_Stats.bytes = baked.data.size();
+        m_Stats.totalMilliseconds = millisecondsSince(start);
+        return texture;
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+    // the cache file of the last import
+    const BakedMips& bakedMips() const {
+        return m_Mips;
+    }
+
+    static std::string sourceKey(const CubemapSource& source) {
+        // a local copy, taking the address of the static constant would need a definition
+        uint32_t version = VERSION;
+        uint64_t hash = hashString("cubemap", hashBytes(&version, sizeof(version)));
+        int settings[3] = { (int) source.layout, source.flip ? 1 : 0, source.faceSize };
+        hash = hashBytes(settings, sizeof(settings), hash);
+        for (const std::string& file : source.files) {
+            hash = hashFileStamp(file, hash);
+        }
+        return hashToHex(hash);
+    }
+
+private:
+    static const uint32_t MAGIC = 0x42554352; // "RCUB"
+    static const uint32_t VERSION = 1;
+
+    struct Header {
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+        int32_t hdr = 0;
+        int32_t size = 0;
+        int32_t mips = 0;
+        uint64_t bytes = 0;
+    };
+
+    // RGB texels, unsigned char for LDR sources and float for HDR ones
+    template <typename T>
+    struct Image {
+        int width = 0;
+        int height = 0;
+        std::vector<T> pixels;
+    };
+
+    // face major: all mips of +X, then all mips of -X, ... as RGB8 or RGB16F texels
+    struct Baked {
+        bool hdr = false;
+        int size = 0;
+        int mips = 0;
+        std::vector<unsigned char> data;
+    };
+
+    static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static int mipCount(int size) {
+        int mips = 1;
+        while (size > 1) {
+            size /= 2;
+            ++mips;
+        }
+        return mips;
+    }
+
+    static size_t faceBytes(int size, int mips, size_t texelBytes) {
+        size_t bytes = 0;
+        for (int mip = 0; mip < mips; ++mip) {
+            size_t edge = std::max(size >> mip, 1);
+            bytes += edge * edge * texelBytes;
+        }
+        return bytes;
+    }
+
+    // one job per item, files and faces take long enough each
+    template <typename F>
+    static void parallelFor(int count, F work) {
+        JobSystem::instance().parallelFor(count, 1, [&work](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                work((int) i);
+            }
+        });
+    }
+
+    bool bake(const CubemapSource& source, Baked& baked) {
+        size_t expected = source.layout == CubemapSource::FACES ? 6 : 1;
+        if (source.files.size() != expected) {
+            std::cout << "ERROR::CUBEMAP_IMPORTER::WRONG_FILE_COUNT " << source.files.size() << std::endl;
+            return false;
+        }
+        stbi_set_flip_vertically_on_load(false);
+        baked.hdr = stbi_is_hdr(source.files[0].c_str()) != 0;
+        if (baked.hdr) {
+            return bakeAs<float>(source, baked);
+        }
+        return bakeAs<unsigned char>(source, baked);
+    }
+
+    template <typename T>
+    bool bakeAs(const CubemapSource& source, Baked& baked) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Image<T>> images(source.files.size());
+        std::vector<char> failed(images.size(), 0);
+        parallelFor((int) images.size(), [&](int i) {
+            failed[i] = !decode(source.files[i], source.flip, images[i]);
+        });
+        for (size_t i = 0; i < images.size(); ++i) {
+            if (failed[i]) {
+                std::cout << "ERROR::CUBEMAP_IMPORTER::CANNOT_LOAD " << source.files[i] << std::endl;
+                return false;
+            }
+        }
+        m_Stats.decodeMilliseconds = millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        int size = faceSizeOf(source, images[0]);
+        if (size <= 0) {
+            std::cout << "ERROR::CUBEMAP_IMPORTER::UNSUPPORTED_LAYOUT " << source.files[0] << std::endl;
+            return false;
+        }
+        baked.size = size;
+        baked.mips = mipCount(size);
+        size_t texelBytes = baked.hdr ? 3 * sizeof(uint16_t) : 3;
+        size_t perFace = faceBytes(size, baked.mips, texelBytes);
+        baked.data.resize(perFace * 6);
+        parallelFor(6, [&](int face) {
+            Image<T> level;
+            level.width = level.height = size;
+            level.pixels.resize((size_t) size * size * 3);
+            switch (source.layout) {
+                case CubemapSource::FACES:
+                    resample(images[face], level);
+                    break;
+                case CubemapSource::CROSS:
+                    extractCross(images[0], face, level);
+                    break;
+                case CubemapSource::EQUIRECT:
+                    sampleEquirect(images[0], face, level);
+                    break;
+            }
+            unsigned char* out = &baked.data[perFace * face];
+            for (int mip = 0; mip < baked.mips; ++mip) {
+                out += store(level, out);
+                if (mip + 1 < baked.mips) {
+                    level = downsample(level);
+                }
+            }
+        });
+        m_Stats.convertMilliseconds = millisecondsSince(start);
+        return true;
+    }
+
+    static bool decode(const std::string& path, bool flip, Image<unsigned char>& image) {
+        int channels = 0;
+        unsigned char* data = stbi_load(path.c_str(), &image.width, &image.height, &channels, 3);
+        if (!data) {
+            return false;
+        }
+        image.pixels.assign(data, data + (size_t) image.width * image.height * 3);
+        stbi_image_free(data);
+        if (flip) {
+            flipRows(image);
+        }
+        return true;
+    }
+
+    static bool decode(const std::string& path, bool flip, Image<float>& image) {
+        int channels = 0;
+        float* data = stbi_loadf(path.c_str(), &image.width, &image.height, &channels, 3);
+        if (!data) {
+            return false;
+        }
+        image.pixels.assign(data, data + (size_t) image.width * image.height * 3);
+        stbi_image_free(data);
+        if (flip) {
+            flipRows(image);
+        }
+        return true;
+    }
+
+    template <typename T>
+    static void flipRows(Image<T>& image) {
+        size_t row = (size_t) image.width * 3;
+        for (int y = 0; y < image.height / 2; ++y) {
+            std::swap_ranges(image.pixels.begin() + y * row, image.pixels.begin() + (y + 1) * row,
+                             image.pixels.begin() + (image.height - 1 - y) * row);
+        }
+    }
+
+    template <typename T>
+    static int faceSizeOf(const CubemapSource& source, const Image<T>& image) {
+        switch (source.layout) {
+            case CubemapSource::FACES:
+                return image.width;
+            case CubemapSource::CROSS:
+                if (image.width * 3 == image.height * 4)
+                    return image.width / 4;
+                if (image.width * 4 == image.height * 3)
+                    return image.width / 3;
+                return 0;
+            case CubemapSource::EQUIRECT:
+                return source.faceSize > 0 ? source.faceSize : image.width / 4;
+        }
+        return 0;
+    }
+
+    // direction of texel (u, v) in [-1, 1] of a GL cubemap face, row 0 at the top
+    static void faceDirection(int face, float u, float v, float* d) {
+        switch (face) {
+            case 0: d[0] = 1.0f;  d[1] = -v;    d[2] = -u;    break;
+            case 1: d[0] = -1.0f; d[1] = -v;    d[2] = u;     break;
+            case 2: d[0] = u;     d[1] = 1.0f;  d[2] = v;     break;
+            case 3: d[0] = u;     d[1] = -1.0f; d[2] = -v;    break;
+            case 4: d[0] = u;     d[1] = -v;    d[2] = 1.0f;  break;
+            default: d[0] = -u;   d[1] = -v;    d[2] = -1.0f; break;
+        }
+    }
+
+    // a face image of another size is scaled to the face size; same size is a copy
+    template <typename T>
+    static void resample(const Image<T>& image, Image<T>& face) {
+        if (image.width == face.width && image.height == face.height) {
+            face.pixels = image.pixels;
+            return;
+        }
+        for (int y = 0; y < face.height; ++y) {
+            for (int x = 0; x < face.width; ++x) {
+                float sx = (x + 0.5f) * image.width / face.width - 0.5f;
+                float sy = (y + 0.5f) * image.height / face.height - 0.5f;
+                bilinear(image, sx, sy, false, &face.pixels[((size_t) y * face.width + x) * 3]);
+            }
+        }
+    }
+
+    // the faces of a cross are laid out unfolded around +Z:
+    //        +Y                    +Y
+    //    -X  +Z  +X  -Z        -X  +Z  +X
+    //        -Y                    -Y
+    //                              -Z (upside down)
+    template <typename T>
+    static void extractCross(const Image<T>& image, int face, Image<T>& out) {
+        const int horizontal[6][2] = { {2, 1}, {0, 1}, {1, 0}, {1, 2}, {1, 1}, {3, 1} };
+        const int vertical[6][2] = { {2, 1}, {0, 1}, {1, 0}, {1, 2}, {1, 1}, {1, 3} };
+        bool isVertical = image.height > image.width;
+        const int* cell = isVertical ? vertical[face] : horizontal[face];
+        bool rotate = isVertical && face == 5;
+        int size = out.width;
+        for (int y = 0; y < size; ++y) {
+            int sy = rotate ? size - 1 - y : y;
+            for (int x = 0; x < size; ++x) {
+                int sx = rotate ? size - 1 - x : x;
+                const T* in = &image.pixels[(((size_t) cell[1] * size + sy) * image.width + cell[0] * size + sx) * 3];
+                std::copy(in, in + 3, &out.pixels[((size_t) y * size + x) * 3]);
+            }
+        }
+    }
+
+    // longitude along the width starting at -X, latitude along the height with +Y on top
+    template <typename T>
+    static void sampleEquirect(const Image<T>& image, int face, Image<T>& out) {
+        const float pi = 3.14159265358979f;
+        int size = out.width;
+        for (int y = 0; y < size; ++y) {
+            float v = (y + 0.5f) / size * 2.0f - 1.0f;
+            for (int x = 0; x < size; ++x) {
+                float u = (x + 0.5f) / size * 2.0f - 1.0f;
+                float d[3];
+                faceDirection(face, u, v, d);
+                float length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+                float longitude = std::atan2(d[2], d[0]);
+                float latitude = std::asin(d[1] / length);
+                float sx = (longitude / (2.0f * pi) + 0.5f) * image.width - 0.5f;
+                float sy = (0.5f - latitude / pi) * image.height - 0.5f;
+                bilinear(image, sx, sy, true, &out.pixels[((size_t) y * size + x) * 3]);
+            }
+        }
+    }
+
+    template <typename T>
+    static void bilinear(const Image<T>& image, float sx, float sy, bool wrapX, T* out) {
+        int x0 = (int) std::floor(sx);
+        int y0 = (int) std::floor(sy);
+        float fx = sx - x0;
+        float fy = sy - y0;
+        auto column = [&](int x) {
+            if (wrapX) {
+                return ((x % image.width) + image.width) % image.width;
+            }
+            return std::min(std::max(x, 0), image.width - 1);
+        };
+        auto row = [&](int y) {
+            return std::min(std::max(y, 0), image.height - 1);
+        };
+        const T* p00 = &image.pixels[((size_t) row(y0) * image.width + column(x0)) * 3];
+        const T* p10 = &image.pixels[((size_t) row(y0) * image.width + column(x0 + 1)) * 3];
+        const T* p01 = &image.pixels[((size_t) row(y0 + 1) * image.width + column(x0)) * 3];
+        const T* p11 = &image.pixels[((size_t) row(y0 + 1) * image.width + column(x0 + 1)) * 3];
+        for (int c = 0; c < 3; ++c) {
+            float top = p00[c] + (p10[c] - (float) p00[c]) * fx;
+            float bottom = p01[c] + (p11[c] - (float) p01[c]) * fx;
+            toTexel(top + (bottom - top) * fy, out[c]);
+        }
+    }
+
+    static void toTexel(float value, unsigned char& texel) {
+        texel = (unsigned char) std::min(std::max(value + 0.5f, 0.0f), 255.0f);
+    }
+
+    static void toTexel(float value, float& texel) {
+        texel = value;
+    }
+
+    // 2x2 box filter, the face size is a power of two or a face of odd size keeps its last row
+    template <typename T>
+    static Image<T> downsample(const Image<T>& image) {
+        Image<T> half;
+        half.width = std::max(image.width / 2, 1);
+        half.height = std::max(image.height / 2, 1);
+        half.pixels.resize((size_t) half.width * half.height * 3);
+        for (int y = 0; y < half.height; ++y) {
+            int y0 = std::min(y * 2, image.height - 1), y1 = std::min(y * 2 + 1, image.height - 1);
+            for (int x = 0; x < half.width; ++x) {
+                int x0 = std::min(x * 2, image.width - 1), x1 = std::min(x * 2 + 1, image.width - 1);
+                for (int c = 0; c < 3; ++c) {
+                    float sum = (float) image.pixels[((size_t) y0 * image.width + x0) * 3 + c]
+                                + image.pixels[((size_t) y0 * image.width + x1) * 3 + c]
+                                + image.pixels[((size_t) y1 * image.width + x0) * 3 + c]
+                                + image.pixels[((size_t) y1 * image.width + x1) * 3 + c];
+                    toTexel(sum * 0.25f, half.pixels[((size_t) y * half.width + x) * 3 + c]);
+                }
+            }
+        }
+        return half;
+    }
+
+    // writes one mip as upload texels, returns the bytes written
+    static size_t store(const Image<unsigned char>& image, unsigned char* out) {
+        std::memcpy(out, image.pixels.data(), image.pixels.size());
+        return image.pixels.size();
+    }
+
+    static size_t store(const Image<float>& image, unsigned char* out) {
+        uint16_t* halves = reinterpret_cast<uint16_t*>(out);
+        for (size_t i = 0; i < image.pixels.size(); ++i) {
+            halves[i] = floatToHalf(image.pixels[i]);
+        }
+        return image.pixels.size() * sizeof(uint16_t);
+    }
+
+    // levels above firstMip are skipped and left unspecified below the base level
+    GLuint upload(const Baked& baked, int firstMip) const {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        // RGB rows of the small mips are not 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        size_t texelBytes = baked.hdr ? 3 * sizeof(uint16_t) : 3;
+        const unsigned char* data = baked.data.data();
+        for (int face = 0; face < 6; ++face) {
+            for (int mip = 0; mip < baked.mips; ++mip) {
+                int size = std::max(baked.size >> mip, 1);
+                if (mip >= firstMip) {
+                    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, m_Mips.internalFormat, size, size, 0,
+                                 GL_RGB, m_Mips.type, data);
+                }
+                data += (size_t) size * size * texelBytes;
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, firstMip);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, baked.mips - 1);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        GpuMemory::instance().track(GpuMemory::TEXTURE, texture, m_Mips.residentBytes(firstMip), "skyboxes");
+        return texture;
+    }
+
+    std::string pathFor(const std::string& key) const {
+        return m_Directory + "/" + key + ".cube";
+    }
+
+    bool readCache(const std::string& key, Baked& baked) const {
+        std::ifstream in(pathFor(key), std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        Header header;
+        in.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!in || header.magic != MAGIC || header.version != VERSION || header.size <= 0
+            || header.mips != mipCount(header.size)) {
+            return false;
+        }
+        baked.hdr = header.hdr != 0;
+        baked.size = header.size;
+        baked.mips = header.mips;
+        size_t texelBytes = baked.hdr ? 3 * sizeof(uint16_t) : 3;
+        if (header.bytes != faceBytes(baked.size, baked.mips, texelBytes) * 6) {
+            return false;
+        }
+        baked.data.resize(header.bytes);
+        in.read(reinterpret_cast<char*>(baked.data.data()), baked.data.size());
+        return (bool) in;
+    }
+
+    void writeCache(const std::string& key, const Baked& baked) const {
+        mkdir(m_Directory.c_str(), 0755);
+        std::ofstream out(pathFor(key), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "ERROR::CUBEMAP_IMPORTER::CANNOT_WRITE " << pathFor(key) << std::endl;
+            return;
+        }
+        Header header;
+        header.hdr = baked.hdr ? 1 : 0;
+        header.size = baked.size;
+        header.mips = baked.mips;
+        header.bytes = baked.data.size();
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(baked.data.data()), baked.data.size());
+    }
+
+    std::string m_Directory = "resources/cubemap_cache";
+    Stats m_Stats;
+    BakedMips m_Mips;
+};
+
+}
+
+#endif //PROJECT_BASE_CUBEMAPIMPORTER_H
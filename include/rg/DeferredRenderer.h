@@ -0,0 +1,238 @@
+#ifndef PROJECT_BASE_DEFERREDRENDERER_H
+#define PROJECT_BASE_DEFERREDRENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <rg/ClusteredLighting.h>
+#include <rg/GpuMemory.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace rg {
+
+// Deferred shading path. The geometry pass writes a packed G-buffer of 12 bytes per pixel:
+//   0  SRGB8_ALPHA8  albedo, 7 bit specular intensity and a 1 bit lighting model (planet or ship)
+//   1  RG16F         octahedral world space normal
+//   depth DEPTH24    world position is reconstructed from depth, there is no position target
+// Lights are then shaded into the caller's HDR framebuffer: the directional and ship light
+// with one fullscreen triangle, every point light with one instanced screen space rectangle
+// around its bounding sphere, so a light only reads the G-buffer pixels it can reach.
+class DeferredRenderer {
+public:
+    // bytes per pixel written by the geometry pass and read back by every lighting pass
+    static const int GBUFFER_BYTES_PER_PIXEL = 4 + 4 + 4;
+    // read-modify-write of one RGBA16F target by an additively blended light
+    static const int BLEND_BYTES_PER_PIXEL = 8 + 8;
+
+    DeferredRenderer(int width, int height)
+        : m_Width(width)
+        , m_Height(height) {
+        glGenFramebuffers(1, &m_Framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+        glGenTextures(3, m_Textures);
+        // sRGB keeps the precision of the dark albedo values that 8 linear bits would band
+        const GLenum internalFormats[3] = { GL_SRGB8_ALPHA8, GL_RG16F, GL_DEPTH_COMPONENT24 };
+        const GLenum formats[3] = { GL_RGBA, GL_RG, GL_DEPTH_COMPONENT };
+        const GLenum types[3] = { GL_UNSIGNED_BYTE, GL_HALF_FLOAT, GL_UNSIGNED_INT };
+        const GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_DEPTH_ATTACHMENT };
+        for (int i = 0; i < 3; ++i) {
+            glBindTexture(GL_TEXTURE_2D, m_Textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], width, height, 0, formats[i], types[i], NULL);
+            // every target is 4 bytes a pixel, GBUFFER_BYTES_PER_PIXEL in total
+            GpuMemory::instance().track(GpuMemory::TEXTURE, m_Textures[i], textureBytes(width, height, 4), "g-buffer");
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], GL_TEXTURE_2D, m_Textures[i], 0);
+        }
+        glDrawBuffers(2, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEFERRED_RENDERER::GBUFFER_NOT_COMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // the fullscreen triangle is generated from gl_VertexID, core profile still wants a VAO
+        glGenVertexArrays(1, &m_FullscreenVAO);
+
+        const float corners[] = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+        glGenVertexArrays(1, &m_VolumeVAO);
+        glGenBuffers(1, &m_CornerVBO);
+        glGenBuffers(1, &m_InstanceVBO);
+        glBindVertexArray(m_VolumeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_CornerVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        GpuMemory::instance().track(GpuMemory::BUFFER, m_CornerVBO, sizeof(corners), "deferred lighting");
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, m_InstanceVBO);
+        for (int i = 0; i < 3; ++i) {
+            glEnableVertexAttribArray(1 + i);
+            glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(VolumeInstance),
+                                  (void*)(i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(1 + i, 1);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    ~DeferredRenderer() {
+        GpuMemory& memory = GpuMemory::instance();
+        memory.forget(GpuMemory::BUFFER, m_InstanceVBO);
+        memory.forget(GpuMemory::BUFFER, m_CornerVBO);
+        for (GLuint texture : m_Textures) {
+            memory.forget(GpuMemory::TEXTURE, texture);
+        }
+        glDeleteBuffers(1, &m_InstanceVBO);
+        glDeleteBuffers(1, &m_CornerVBO);
+        glDeleteVertexArrays(1, &m_VolumeVAO);
+        glDeleteVertexArrays(1, &m_FullscreenVAO);
+        glDeleteTextures(3, m_Textures);
+        glDeleteFramebuffers(1, &m_Framebuffer);
+    }
+
+    DeferredRenderer(const DeferredRenderer&) = delete;
+    DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+    void beginGeometryPass() {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_FRAMEBUFFER_SRGB);
+        // alpha carries the specular intensity and lighting model, it must not blend
+        glDisable(GL_BLEND);
+        m_Instances.clear();
+        m_LitPixels = 0.0;
+        m_VolumePixels = 0.0;
+    }
+
+    // copies the scene depth into target (it needs a DEPTH24 buffer of the same size) so
+    // forward passes that come after lighting still depth test, then binds target
+    void endGeometryPass(GLuint target) {
+        glDisable(GL_FRAMEBUFFER_SRGB);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_Framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+        glBlitFramebuffer(0, 0, m_Width, m_Height, 0, 0, m_Width, m_Height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+
+    // binds the G-buffer to three consecutive texture units starting at firstUnit
+    void bind(Shader& shader, const glm::mat4& projection, const glm::mat4& view, unsigned int firstUnit) const {
+        const char* names[3] = { "gAlbedoSpecular", "gNormal", "gDepth" };
+        for (int i = 0; i < 3; ++i) {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_2D, m_Textures[i]);
+            shader.setInt(names[i], firstUnit + i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        shader.setMat4("inverseViewProjection", glm::inverse(projection * view));
+    }
+
+    void drawFullscreen() {
+        glBindVertexArray(m_FullscreenVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        m_LitPixels = (double) m_Width * m_Height;
+    }
+
+    // one rectangle per light that is on screen; the shader has to be bound already
+    void drawLightVolumes(const std::vector<ClusterLight>& lights, const glm::mat4& projection,
+                          const glm::mat4& view, float nearPlane) {
+        m_Instances.clear();
+        m_VolumePixels = 0.0;
+        for (const ClusterLight& light : lights) {
+            VolumeInstance instance;
+            if (!screenRect(light, projection, view, nearPlane, instance.rect)) {
+                continue;
+            }
+            instance.positionRadius = glm::vec4(light.position, light.radius);
+            instance.color = glm::vec4(light.color, 0.0f);
+            m_Instances.push_back(instance);
+            m_VolumePixels += (instance.rect.z - instance.rect.x) * (instance.rect.w - instance.rect.y) * 0.25
+                              * m_Width * m_Height;
+        }
+        if (m_Instances.empty()) {
+            return;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, m_InstanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, m_Instances.size() * sizeof(VolumeInstance), m_Instances.data(), GL_STREAM_DRAW);
+        GpuMemory::instance().track(GpuMemory::BUFFER, m_InstanceVBO, m_Instances.size() * sizeof(VolumeInstance),
+                                    "deferred lighting");
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(m_VolumeVAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) m_Instances.size());
+        glBindVertexArray(0);
+    }
+
+    size_t gbufferBytes() const {
+        return (size_t) m_Width * m_Height * GBUFFER_BYTES_PER_PIXEL;
+    }
+    size_t visibleLights() const {
+        return m_Instances.size();
+    }
+    double volumePixels() const {
+        return m_VolumePixels;
+    }
+    // estimate of the framebuffer traffic of the last frame: G-buffer writes, the fullscreen
+    // pass and every light rectangle; overdraw in the geometry pass and caches are ignored
+    double estimatedBytes() const {
+        double pixels = (double) m_Width * m_Height;
+        return pixels * GBUFFER_BYTES_PER_PIXEL
+               + m_LitPixels * (GBUFFER_BYTES_PER_PIXEL + 8)
+               + m_VolumePixels * (GBUFFER_BYTES_PER_PIXEL + BLEND_BYTES_PER_PIXEL);
+    }
+
+private:
+    struct VolumeInstance {
+        glm::vec4 rect;
+        glm::vec4 positionRadius;
+        glm::vec4 color;
+    };
+
+    // NDC rectangle covering the light's bounding sphere, false if it is off screen
+    static bool screenRect(const ClusterLight& light, const glm::mat4& projection, const glm::mat4& view,
+                           float nearPlane, glm::vec4& rect) {
+        glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+        float r = light.radius;
+        if (-center.z + r < nearPlane) {
+            return false;
+        }
+        rect = glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f);
+        // a sphere crossing the near plane can cover any part of the screen
+        if (-center.z - r < nearPlane) {
+            return true;
+        }
+        glm::vec2 lo(1e30f), hi(-1e30f);
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 offset((corner & 1) ? r : -r, (corner & 2) ? r : -r, (corner & 4) ? r : -r);
+            glm::vec4 clip = projection * glm::vec4(center + offset, 1.0f);
+            glm::vec2 ndc = glm::vec2(clip) / clip.w;
+            lo = glm::min(lo, ndc);
+            hi = glm::max(hi, ndc);
+        }
+        if (lo.x >= 1.0f || lo.y >= 1.0f || hi.x <= -1.0f || hi.y <= -1.0f) {
+            return false;
+        }
+        rect = glm::vec4(glm::max(lo, glm::vec2(-1.0f)), glm::min(hi, glm::vec2(1.0f)));
+        return true;
+    }
+
+    int m_Width;
+    int m_Height;
+    GLuint m_Framebuffer = 0;
+    GLuint m_Textures[3] = {};
+    GLuint m_FullscreenVAO = 0;
+    GLuint m_VolumeVAO = 0;
+    GLuint m_CornerVBO = 0;
+    GLuint m_InstanceVBO = 0;
+    std::vector<VolumeInstance> m_Instances;
+    double m_LitPixels = 0.0;
+    double m_VolumePixels = 0.0;
+};
+
+}
+
+#endif //PROJECT_BASE_DEFERREDRENDERER_H
@@ -0,0 +1,96 @@
+#ifndef PROJECT_BASE_GLEXTENSIONS_H
+#define PROJECT_BASE_GLEXTENSIONS_H
+
+#include <glad/glad.h>
+#include <cstring>
+#include <string>
+
+// glad in libs/ is generated for the 3.3 core profile only. Entry points from newer
+// versions are loaded here by hand and must only be called after checking the flags
+// in rg::glext. If glad is ever regenerated for a newer version these are skipped.
+
+#ifndef GL_VERSION_4_1
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#define GL_PROGRAM_BINARY_FORMATS 0x87FF
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+PFNGLGETPROGRAMBINARYPROC rg_glGetProgramBinary = nullptr;
+PFNGLPROGRAMBINARYPROC rg_glProgramBinary = nullptr;
+PFNGLPROGRAMPARAMETERIPROC rg_glProgramParameteri = nullptr;
+#define glGetProgramBinary rg_glGetProgramBinary
+#define glProgramBinary rg_glProgramBinary
+#define glProgramParameteri rg_glProgramParameteri
+#endif
+
+#ifndef GL_VERSION_4_3
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC rg_glMultiDrawElementsIndirect = nullptr;
+#define glMultiDrawElementsIndirect rg_glMultiDrawElementsIndirect
+#endif
+
+namespace rg {
+namespace glext {
+
+int majorVersion = 3;
+int minorVersion = 3;
+// GL 4.1 or ARB_get_program_binary, and the driver reports at least one binary format
+bool programBinary = false;
+// GL 4.3 or ARB_multi_draw_indirect; base instance (4.2) comes with both
+bool multiDrawIndirect = false;
+
+bool hasExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char* extension = (const char*) glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(extension, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool versionAtLeast(int major, int minor) {
+    return majorVersion > major || (majorVersion == major && minorVersion >= minor);
+}
+
+// driver identity; anything compiled by the driver is only valid for the exact same string
+std::string driverString() {
+    std::string result;
+    const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (GLenum name : names) {
+        const char* value = (const char*) glGetString(name);
+        result += value ? value : "?";
+        result += '\n';
+    }
+    return result;
+}
+
+// call once after gladLoadGLLoader, with the same loader
+void load(GLADloadproc loader) {
+    glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+    glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+
+    if (versionAtLeast(4, 1) || hasExtension("GL_ARB_get_program_binary")) {
+        glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC) loader("glGetProgramBinary");
+        glProgramBinary = (PFNGLPROGRAMBINARYPROC) loader("glProgramBinary");
+        glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC) loader("glProgramParameteri");
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        programBinary = glGetProgramBinary && glProgramBinary && glProgramParameteri && formats > 0;
+    }
+
+    if (versionAtLeast(4, 3) || (hasExtension("GL_ARB_multi_draw_indirect") && hasExtension("GL_ARB_base_instance"))) {
+        glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC) loader("glMultiDrawElementsIndirect");
+        multiDrawIndirect = glMultiDrawElementsIndirect != nullptr;
+    }
+}
+
+}
+}
+
+#endif //PROJECT_BASE_GLEXTENSIONS_H
@@ -0,0 +1,338 @@
+#ifndef PROJECT_BASE_GEOMETRYARENA_H
+#define PROJECT_BASE_GEOMETRYARENA_H
+
+#include <glad/glad.h>
+#include <rg/GpuMemory.h>
+#include <rg/VertexPacking.h>
+
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <vector>
+
+namespace rg {
+
+// First-fit allocator over an abstract range [0, capacity). Free blocks are kept sorted by
+// offset and merged with their neighbours when released, so the arena doesn't fragment when
+// meshes are re-uploaded in another format and back.
+class FreeListAllocator {
+public:
+    static const size_t INVALID = ~(size_t) 0;
+
+    size_t allocate(size_t size, size_t alignment = 1) {
+        for (auto it = m_Free.begin(); it != m_Free.end(); ++it) {
+            size_t offset = (it->first + alignment - 1) / alignment * alignment;
+            size_t end = it->first + it->second;
+            if (offset + size > end) {
+                continue;
+            }
+            size_t blockOffset = it->first;
+            m_Free.erase(it);
+            // the alignment padding in front and the rest behind stay free
+            if (offset > blockOffset) {
+                m_Free[blockOffset] = offset - blockOffset;
+            }
+            if (offset + size < end) {
+                m_Free[offset + size] = end - offset - size;
+            }
+            m_Used += size;
+            return offset;
+        }
+        return INVALID;
+    }
+
+    void release(size_t offset, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        m_Used -= size;
+        auto next = m_Free.lower_bound(offset);
+        if (next != m_Free.end() && offset + size == next->first) {
+            size += next->second;
+            next = m_Free.erase(next);
+        }
+        if (next != m_Free.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += size;
+                return;
+            }
+        }
+        m_Free[offset] = size;
+    }
+
+    // the new space is free, joined with a free block at the old end
+    void grow(size_t capacity) {
+        size_t old = m_Capacity;
+        m_Capacity = capacity;
+        m_Used += capacity - old;
+        release(old, capacity - old);
+    }
+
+    size_t capacity() const {
+        return m_Capacity;
+    }
+    size_t used() const {
+        return m_Used;
+    }
+    size_t freeBlocks() const {
+        return m_Free.size();
+    }
+
+private:
+    std::map<size_t, size_t> m_Free;
+    size_t m_Capacity = 0;
+    size_t m_Used = 0;
+};
+
+// One vertex buffer per stream and one index buffer for every mesh of a vertex layout, with a
+// single VAO over them. Meshes get a vertex range and an index range; their indices stay
+// relative to their own first vertex and draws pass the range start as base vertex, so nothing
+// is rebound between meshes of the same layout. Indices of both widths share the index buffer,
+// ranges are aligned to 4 bytes. The buffers double when full and keep their contents.
+class GeometryArena {
+public:
+    struct Range {
+        size_t offset = FreeListAllocator::INVALID;
+        size_t size = 0;
+
+        bool valid() const {
+            return offset != FreeListAllocator::INVALID;
+        }
+    };
+
+    // the arena for a layout, created on first use
+    static GeometryArena& forLayout(const VertexLayout& layout) {
+        int key = layout.positions * 2 + (layout.tangents ? 1 : 0);
+        GeometryArena*& arena = arenas()[key];
+        if (!arena) {
+            arena = new GeometryArena(layout);
+        }
+        return *arena;
+    }
+
+    // deletes every arena's buffers; call before the context goes away
+    static void releaseAll() {
+        for (auto& entry : arenas()) {
+            delete entry.second;
+        }
+        arenas().clear();
+    }
+
+    template <typename F>
+    static void forEach(F visit) {
+        for (auto& entry : arenas()) {
+            visit(*entry.second);
+        }
+    }
+
+    ~GeometryArena() {
+        GpuMemory& memory = GpuMemory::instance();
+        for (int s = 0; s < m_Streams; ++s) {
+            memory.forget(GpuMemory::BUFFER, m_VBO[s]);
+        }
+        memory.forget(GpuMemory::BUFFER, m_EBO);
+        glDeleteVertexArrays(1, &m_VAO);
+        glDeleteBuffers(m_Streams, m_VBO);
+        glDeleteBuffers(1, &m_EBO);
+    }
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    // data holds one pointer per stream, see rg::VertexLayout for the streams of a layout
+    Range allocateVertices(size_t count, const void* const* data) {
+        Range range;
+        range.size = count;
+        range.offset = m_Vertices.allocate(count);
+        if (!range.valid()) {
+            growVertices(m_Vertices.capacity() + count);
+            range.offset = m_Vertices.allocate(count);
+        }
+        for (int s = 0; s < m_Streams; ++s) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_VBO[s]);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, range.offset * m_Strides[s], count * m_Strides[s], data[s]);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return range;
+    }
+
+    // size in bytes; the offset of the returned range is in bytes too
+    Range allocateIndices(size_t bytes, const void* data) {
+        Range range;
+        range.size = bytes;
+        range.offset = m_Indices.allocate(bytes, 4);
+        if (!range.valid()) {
+            growIndices(m_Indices.capacity() + bytes + 4);
+            range.offset = m_Indices.allocate(bytes, 4);
+        }
+        // not GL_ELEMENT_ARRAY_BUFFER, that binding belongs to whichever VAO is bound
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.offset, bytes, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return range;
+    }
+
+    void releaseVertices(Range& range) {
+        if (range.valid()) {
+            m_Vertices.release(range.offset, range.size);
+            range = Range();
+        }
+    }
+
+    void releaseIndices(Range& range) {
+        if (range.valid()) {
+            m_Indices.release(range.offset, range.size);
+            range = Range();
+        }
+    }
+
+    void bind() const {
+        glBindVertexArray(m_VAO);
+    }
+
+    GLuint vao() const {
+        return m_VAO;
+    }
+    const VertexLayout& layout() const {
+        return m_Layout;
+    }
+    size_t vertexBytes() const {
+        return m_Vertices.used() * m_VertexSize;
+    }
+    size_t indexBytes() const {
+        return m_Indices.used();
+    }
+    size_t capacityBytes() const {
+        return m_Vertices.capacity() * m_VertexSize + m_Indices.capacity();
+    }
+    size_t freeBlocks() const {
+        return m_Vertices.freeBlocks() + m_Indices.freeBlocks();
+    }
+
+private:
+    static const size_t INITIAL_VERTICES = 1 << 16;
+    static const size_t INITIAL_INDEX_BYTES = 1 << 18;
+
+    static std::map<int, GeometryArena*>& arenas() {
+        static std::map<int, GeometryArena*> instances;
+        return instances;
+    }
+
+    explicit GeometryArena(const VertexLayout& layout)
+        : m_Layout(layout) {
+        if (layout.packed()) {
+            m_Streams = layout.tangents ? 3 : 2;
+            m_Strides[0] = 4 * sizeof(uint16_t);
+            m_Strides[1] = 4 * sizeof(uint16_t);
+            m_Strides[2] = 2 * sizeof(int16_t);
+        } else {
+            m_Streams = 1;
+            m_Strides[0] = VERTEX_SIZE;
+        }
+        for (int s = 0; s < m_Streams; ++s) {
+            m_VertexSize += m_Strides[s];
+        }
+        glGenVertexArrays(1, &m_VAO);
+        growVertices(INITIAL_VERTICES);
+        growIndices(INITIAL_INDEX_BYTES);
+    }
+
+    // copies a buffer's contents into a new, larger one
+    static GLuint resize(GLuint buffer, size_t oldBytes, size_t newBytes) {
+        GLuint resized;
+        glGenBuffers(1, &resized);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, resized);
+        glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+        if (oldBytes > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        GpuMemory::instance().forget(GpuMemory::BUFFER, buffer);
+        GpuMemory::instance().track(GpuMemory::BUFFER, resized, newBytes, "geometry arenas");
+        glDeleteBuffers(1, &buffer);
+        return resized;
+    }
+
+    void growVertices(size_t needed) {
+        size_t capacity = m_Vertices.capacity() > 0 ? m_Vertices.capacity() * 2 : INITIAL_VERTICES;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        for (int s = 0; s < m_Streams; ++s) {
+            m_VBO[s] = resize(m_VBO[s], m_Vertices.capacity() * m_Strides[s], capacity * m_Strides[s]);
+        }
+        m_Vertices.grow(capacity);
+        setupAttributes();
+    }
+
+    void growIndices(size_t needed) {
+        size_t capacity = m_Indices.capacity() > 0 ? m_Indices.capacity() * 2 : INITIAL_INDEX_BYTES;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        m_EBO = resize(m_EBO, m_Indices.capacity(), capacity);
+        m_Indices.grow(capacity);
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        glBindVertexArray(0);
+    }
+
+    // the attribute formats Mesh used to set up per mesh, now once per layout
+    void setupAttributes() {
+        glBindVertexArray(m_VAO);
+        if (m_Layout.packed()) {
+            // positions, the bitangent sign rides along in w
+            glBindBuffer(GL_ARRAY_BUFFER, m_VBO[0]);
+            glEnableVertexAttribArray(0);
+            if (m_Layout.positions == VertexLayout::SNORM16)
+                glVertexAttribPointer(0, 4, GL_SHORT, GL_FALSE, m_Strides[0], (void*)0);
+            else
+                glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, m_Strides[0], (void*)0);
+            // octahedral normal and uv
+            glBindBuffer(GL_ARRAY_BUFFER, m_VBO[1]);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, m_Strides[1], (void*)0);
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, m_Strides[1], (void*)(2 * sizeof(uint16_t)));
+            // octahedral tangent
+            if (m_Layout.tangents) {
+                glBindBuffer(GL_ARRAY_BUFFER, m_VBO[2]);
+                glEnableVertexAttribArray(3);
+                glVertexAttribPointer(3, 2, GL_SHORT, GL_FALSE, m_Strides[2], (void*)0);
+            }
+        } else {
+            // learnopengl's Vertex: position, normal, uv, tangent, bitangent
+            glBindBuffer(GL_ARRAY_BUFFER, m_VBO[0]);
+            const GLint sizes[5] = { 3, 3, 2, 3, 3 };
+            size_t offset = 0;
+            for (GLuint a = 0; a < 5; ++a) {
+                glEnableVertexAttribArray(a);
+                glVertexAttribPointer(a, sizes[a], GL_FLOAT, GL_FALSE, VERTEX_SIZE, (void*)offset);
+                offset += sizes[a] * sizeof(float);
+            }
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // sizeof(Vertex) in learnopengl/mesh.h, which includes this file
+    static const GLsizei VERTEX_SIZE = 14 * sizeof(float);
+
+    VertexLayout m_Layout;
+    int m_Streams = 1;
+    GLsizei m_Strides[3] = {};
+    size_t m_VertexSize = 0;
+    GLuint m_VAO = 0;
+    GLuint m_VBO[3] = {};
+    GLuint m_EBO = 0;
+    FreeListAllocator m_Vertices;
+    FreeListAllocator m_Indices;
+};
+
+}
+
+#endif //PROJECT_BASE_GEOMETRYARENA_H
@@ -0,0 +1,262 @@
+#ifndef PROJECT_BASE_GPUMEMORY_H
+#define PROJECT_BASE_GPUMEMORY_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rg {
+
+// Every texture, buffer and renderbuffer the renderer allocates, with its size and owner. The
+// owners call track() when they (re)specify storage and forget() before deleting it; sizes are
+// what the storage needs at its internal format, drivers add their own padding on top.
+//
+// On top of that a residency budget for the textures that can shrink: an evictable texture
+// gives a callback that drops its largest mip level and one that restores it. update(), once
+// per frame, drops top mips of the least recently bound textures while the total is over the
+// budget, and restores textures that were bound while degraded once they fit under it again.
+// Both are limited per frame so a budget change never stalls a single frame for long.
+class GpuMemory {
+public:
+    enum Kind { TEXTURE, BUFFER, RENDERBUFFER, KIND_COUNT };
+
+    // returns the new size in bytes; dropTopMip returns the old one when nothing can be dropped
+    struct Residency {
+        std::function<size_t()> dropTopMip;
+        std::function<size_t()> restore;
+    };
+
+    struct Stats {
+        size_t evictions = 0;
+        size_t restorations = 0;
+        size_t evictedBytes = 0;        // freed by the evictions so far
+    };
+
+    static const int EVICTIONS_PER_FRAME = 4;
+    static const int RESTORATIONS_PER_FRAME = 2;
+    // levels dropped at most; the smallest textures are not worth a readback
+    static const int MAX_DROPPED_LEVELS = 4;
+
+    static GpuMemory& instance() {
+        static GpuMemory memory;
+        return memory;
+    }
+
+    GpuMemory(const GpuMemory&) = delete;
+    GpuMemory& operator=(const GpuMemory&) = delete;
+
+    // bytes replace whatever was recorded for the object before
+    void track(Kind kind, GLuint id, size_t bytes, const std::string& owner) {
+        Allocation& allocation = m_Allocations[keyOf(kind, id)];
+        m_Totals[kind] -= allocation.bytes;
+        allocation.kind = kind;
+        allocation.bytes = bytes;
+        allocation.owner = owner;
+        m_Totals[kind] += bytes;
+    }
+
+    void forget(Kind kind, GLuint id) {
+        auto found = m_Allocations.find(keyOf(kind, id));
+        if (found == m_Allocations.end()) {
+            return;
+        }
+        m_Totals[kind] -= found->second.bytes;
+        m_Allocations.erase(found);
+        if (kind == TEXTURE) {
+            m_Residents.erase(id);
+        }
+    }
+
+    size_t total() const {
+        return m_Totals[TEXTURE] + m_Totals[BUFFER] + m_Totals[RENDERBUFFER];
+    }
+    size_t total(Kind kind) const {
+        return m_Totals[kind];
+    }
+    size_t allocationCount() const {
+        return m_Allocations.size();
+    }
+
+    // owner -> bytes per kind, sorted by owner
+    std::map<std::string, std::vector<size_t>> byOwner() const {
+        std::map<std::string, std::vector<size_t>> owners;
+        for (const auto& entry : m_Allocations) {
+            std::vector<size_t>& bytes = owners[entry.second.owner];
+            bytes.resize(KIND_COUNT);
+            bytes[entry.second.kind] += entry.second.bytes;
+        }
+        return owners;
+    }
+
+    // a tracked texture that may lose its top mips under the budget
+    void makeEvictable(GLuint texture, const Residency& residency) {
+        Resident& resident = m_Residents[texture];
+        resident.residency = residency;
+        resident.lastUsed = m_Frame;
+        resident.dropped = 0;
+        resident.exhausted = false;
+    }
+
+    // the texture is bound this frame
+    void touch(GLuint texture) {
+        auto found = m_Residents.find(texture);
+        if (found != m_Residents.end()) {
+            found->second.lastUsed = m_Frame;
+        }
+    }
+
+    // 0 turns the budget off; dropped mips come back as their textures are used again
+    void setBudget(size_t bytes) {
+        m_Budget = bytes;
+    }
+    size_t budget() const {
+        return m_Budget;
+    }
+
+    size_t degradedCount() const {
+        size_t count = 0;
+        for (const auto& entry : m_Residents) {
+            count += entry.second.dropped > 0;
+        }
+        return count;
+    }
+
+    void update() {
+        if (m_Budget > 0 && total() > m_Budget) {
+            evict();
+        } else {
+            restore();
+        }
+        ++m_Frame;
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+    size_t evictableCount() const {
+        return m_Residents.size();
+    }
+
+private:
+    struct Allocation {
+        Kind kind = TEXTURE;
+        size_t bytes = 0;
+        std::string owner;
+    };
+
+    struct Resident {
+        Residency residency;
+        uint64_t lastUsed = 0;
+        int dropped = 0;
+        bool exhausted = false;         // down to 1x1, nothing left to drop
+    };
+
+    GpuMemory() = default;
+
+    static uint64_t keyOf(Kind kind, GLuint id) {
+        return (uint64_t) kind << 32 | id;
+    }
+
+    // oldest first; among equally old ones the largest, it frees the most
+    std::vector<GLuint> byAge(bool degradedOnly) const {
+        std::vector<GLuint> textures;
+        for (const auto& entry : m_Residents) {
+            const Resident& resident = entry.second;
+            if (degradedOnly ? resident.dropped > 0 : !resident.exhausted && resident.dropped < MAX_DROPPED_LEVELS) {
+                textures.push_back(entry.first);
+            }
+        }
+        std::sort(textures.begin(), textures.end(), [this](GLuint a, GLuint b) {
+            const Resident& x = m_Residents.at(a);
+            const Resident& y = m_Residents.at(b);
+            if (x.lastUsed != y.lastUsed) {
+                return x.lastUsed < y.lastUsed;
+            }
+            return bytesOf(a) > bytesOf(b);
+        });
+        return textures;
+    }
+
+    size_t bytesOf(GLuint texture) const {
+        auto found = m_Allocations.find(keyOf(TEXTURE, texture));
+        return found == m_Allocations.end() ? 0 : found->second.bytes;
+    }
+
+    void evict() {
+        int evicted = 0;
+        for (GLuint texture : byAge(false)) {
+            if (evicted == EVICTIONS_PER_FRAME || total() <= m_Budget) {
+                break;
+            }
+            Resident& resident = m_Residents[texture];
+            size_t before = bytesOf(texture);
+            size_t after = resident.residency.dropTopMip();
+            if (after >= before) {
+                resident.exhausted = true;
+                continue;
+            }
+            track(TEXTURE, texture, after, m_Allocations[keyOf(TEXTURE, texture)].owner);
+            ++resident.dropped;
+            ++evicted;
+            ++m_Stats.evictions;
+            m_Stats.evictedBytes += before - after;
+        }
+    }
+
+    // the most recently used degraded textures first, while the full size fits the budget
+    void restore() {
+        std::vector<GLuint> degraded = byAge(true);
+        int restored = 0;
+        for (auto it = degraded.rbegin(); it != degraded.rend() && restored < RESTORATIONS_PER_FRAME; ++it) {
+            Resident& resident = m_Residents[*it];
+            // levels double each way: every dropped level was a quarter of the next size
+            size_t full = bytesOf(*it) << (2 * resident.dropped);
+            bool used = resident.lastUsed + 1 >= m_Frame;
+            if (!used || (m_Budget > 0 && total() - bytesOf(*it) + full > m_Budget)) {
+                continue;
+            }
+            size_t bytes = resident.residency.restore();
+            track(TEXTURE, *it, bytes, m_Allocations[keyOf(TEXTURE, *it)].owner);
+            resident.dropped = 0;
+            resident.exhausted = false;
+            ++restored;
+            ++m_Stats.restorations;
+        }
+    }
+
+    std::unordered_map<uint64_t, Allocation> m_Allocations;
+    std::unordered_map<GLuint, Resident> m_Residents;
+    size_t m_Totals[KIND_COUNT] = {};
+    size_t m_Budget = 0;
+    uint64_t m_Frame = 0;
+    Stats m_Stats;
+};
+
+// bytes of the first levels of a texture's mip chain, for every layer
+size_t textureBytes(int width, int height, size_t texelBytes, int levels = 1, int layers = 1) {
+    size_t bytes = 0;
+    for (int level = 0; level < levels; ++level) {
+        bytes += (size_t) std::max(width >> level, 1) * std::max(height >> level, 1) * texelBytes;
+    }
+    return bytes * layers;
+}
+
+// the number of levels glGenerateMipmap creates
+int mipLevels(int width, int height) {
+    int levels = 1;
+    while ((width | height) >> levels) {
+        ++levels;
+    }
+    return levels;
+}
+
+}
+
+#endif //PROJECT_BASE_GPUMEMORY_H
@@ -0,0 +1,74 @@
+#ifndef PROJECT_BASE_GPUTIMER_H
+#define PROJECT_BASE_GPUTIMER_H
+
+#include <glad/glad.h>
+
+namespace rg {
+
+// Measures GPU time of a block of commands with GL_TIME_ELAPSED queries (core since 3.3).
+// Results are read a few frames late from a small ring of queries so that reading them
+// never stalls the pipeline. Only one GL_TIME_ELAPSED query can be active at a time,
+// so timed blocks must not be nested.
+class GpuTimer {
+public:
+    GpuTimer() = default;
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    ~GpuTimer() {
+        if (m_Queries[0]) {
+            glDeleteQueries(LATENCY, m_Queries);
+        }
+    }
+
+    void begin() {
+        if (!m_Queries[0]) {
+            glGenQueries(LATENCY, m_Queries);
+        }
+        collect();
+        glBeginQuery(GL_TIME_ELAPSED, m_Queries[m_Current]);
+    }
+
+    void end() {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_Pending[m_Current] = true;
+        m_Current = (m_Current + 1) % LATENCY;
+    }
+
+    // exponentially smoothed, so the number is readable in ImGui
+    double milliseconds() const {
+        return m_Milliseconds;
+    }
+
+private:
+    static const int LATENCY = 4;
+
+    void collect() {
+        for (int i = 0; i < LATENCY; ++i) {
+            if (!m_Pending[i]) {
+                continue;
+            }
+            GLint available = 0;
+            glGetQueryObjectiv(m_Queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                continue;
+            }
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(m_Queries[i], GL_QUERY_RESULT, &nanoseconds);
+            m_Pending[i] = false;
+            double sample = nanoseconds / 1.0e6;
+            m_Milliseconds = m_HasSample ? m_Milliseconds * 0.9 + sample * 0.1 : sample;
+            m_HasSample = true;
+        }
+    }
+
+    GLuint m_Queries[LATENCY] = {};
+    bool m_Pending[LATENCY] = {};
+    int m_Current = 0;
+    double m_Milliseconds = 0.0;
+    bool m_HasSample = false;
+};
+
+}
+
+#endif //PROJECT_BASE_GPUTIMER_H
@@ -0,0 +1,44 @@
+#ifndef PROJECT_BASE_HALFFLOAT_H
+#define PROJECT_BASE_HALFFLOAT_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace rg {
+
+// IEEE half float bits for GL_HALF_FLOAT uploads. Rounds to nearest; values past the half
+// range become infinity, values below the smallest denormal zero.
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (uint16_t) ((bits >> 16) & 0x8000u);
+    int exponent = (int) ((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+    if (((bits >> 23) & 0xffu) == 0xffu) {
+        return (uint16_t) (sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+    }
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000u;
+        uint32_t shift = (uint32_t) (14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1u) {
+            ++half;
+        }
+        return (uint16_t) (sign | half);
+    }
+    uint32_t half = ((uint32_t) exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u) {
+        ++half;
+    }
+    if (half >= 0x7c00u) {
+        return (uint16_t) (sign | 0x7c00u);
+    }
+    return (uint16_t) (sign | half);
+}
+
+}
+
+#endif //PROJECT_BASE_HALFFLOAT_H
@@ -0,0 +1,52 @@
+#ifndef PROJECT_BASE_HASH_H
+#define PROJECT_BASE_HASH_H
+
+#include <sys/stat.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace rg {
+
+// 64-bit FNV-1a. Used for cache keys on disk, so it has to stay stable between runs
+// (std::hash gives no such guarantee).
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = FNV_OFFSET_BASIS) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t hashString(const std::string& s, uint64_t seed = FNV_OFFSET_BASIS) {
+    // mix in the length so that ("ab", "c") and ("a", "bc") hash differently when chained
+    uint64_t size = s.size();
+    return hashBytes(s.data(), s.size(), hashBytes(&size, sizeof(size), seed));
+}
+
+// a file's name, size and modification time, so baked data keyed by it is rebuilt when the
+// file is edited without reading the file itself
+uint64_t hashFileStamp(const std::string& path, uint64_t seed = FNV_OFFSET_BASIS) {
+    uint64_t hash = hashString(path, seed);
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0) {
+        int64_t stamp[2] = { (int64_t) info.st_size, (int64_t) info.st_mtime };
+        hash = hashBytes(stamp, sizeof(stamp), hash);
+    }
+    return hash;
+}
+
+std::string hashToHex(uint64_t hash) {
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) hash);
+    return std::string(buffer);
+}
+
+}
+
+#endif //PROJECT_BASE_HASH_H
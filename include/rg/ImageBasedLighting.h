@@ -0,0 +1,489 @@
+#ifndef PROJECT_BASE_IMAGEBASEDLIGHTING_H
+#define PROJECT_BASE_IMAGEBASEDLIGHTING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <rg/GpuMemory.h>
+#include <rg/Hash.h>
+#include <rg/JobSystem.h>
+#include <rg/MipStreaming.h>
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace rg {
+
+// Image based lighting baked from a skybox cubemap:
+//   diffuse   9 spherical harmonics coefficients per channel, projected on the CPU from the
+//             top mip of the sky (SSE over four texels at a time, rows split into rg::JobSystem jobs)
+//             and already convolved with the cosine lobe
+//   specular  a cubemap whose mips are the sky prefiltered with a GGX lobe of increasing
+//             roughness, rendered by ibl_prefilter.fs
+// Both go to resources/ibl_cache, keyed by the sky's source files, so the next start only
+// uploads them. lib/ibl.glsl samples the result.
+class ImageBasedLighting {
+public:
+    static const int PREFILTER_SIZE = 128;
+    static const int PREFILTER_MIPS = 5;
+    // jobs the SH projection's rows are split into
+    static const int SH_CHUNKS = 64;
+
+    struct Timings {
+        bool fromCache = false;
+        double readbackMilliseconds = 0.0;
+        double shMilliseconds = 0.0;
+        double prefilterMilliseconds = 0.0;
+        double bakeMilliseconds = 0.0;
+        double loadMilliseconds = 0.0;
+        unsigned int threads = 1;
+    };
+
+    ImageBasedLighting() {
+        // filtering across face edges, the blurry mips would show the seams otherwise
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        glGenTextures(1, &m_Prefiltered);
+        glGenVertexArrays(1, &m_FullscreenVAO);
+        glGenFramebuffers(1, &m_Framebuffer);
+    }
+
+    ~ImageBasedLighting() {
+        GpuMemory::instance().forget(GpuMemory::TEXTURE, m_Prefiltered);
+        glDeleteFramebuffers(1, &m_Framebuffer);
+        glDeleteVertexArrays(1, &m_FullscreenVAO);
+        glDeleteTextures(1, &m_Prefiltered);
+    }
+
+    ImageBasedLighting(const ImageBasedLighting&) = delete;
+    ImageBasedLighting& operator=(const ImageBasedLighting&) = delete;
+
+    // cache key of a sky loaded from files: their names, sizes and modification times, and
+    // the bake settings, so editing an image or the bake itself misses the cache
+    static std::string sourceKey(const std::vector<std::string>& files) {
+        // a local copy, taking the address of the static constant would need a definition
+        uint32_t version = VERSION;
+        uint64_t hash = hashString("ibl", hashBytes(&version, sizeof(version)));
+        int settings[3] = { PREFILTER_SIZE, PREFILTER_MIPS, PREFILTER_SAMPLES };
+        hash = hashBytes(settings, sizeof(settings), hash);
+        for (const std::string& file : files) {
+            hash = hashFileStamp(file, hash);
+        }
+        return hashToHex(hash);
+    }
+
+    // loads the bake for key from the cache, or bakes it from sky and stores it. A streamed sky
+    // (rg::MipStreaming) passes its baked file as source, the bake then reads level 0 from there
+    // instead of the coarse levels the sky has resident.
+    void load(GLuint sky, const std::string& key, Shader& prefilterShader, bool forceBake = false,
+              const BakedMips* source = nullptr) {
+        auto start = std::chrono::steady_clock::now();
+        if (!forceBake && loadCache(key)) {
+            m_Timings.fromCache = true;
+            m_Timings.loadMilliseconds = millisecondsSince(start);
+            std::cout << "IBL: loaded from cache in " << m_Timings.loadMilliseconds << " ms" << std::endl;
+            return;
+        }
+        bool full = bake(sky, prefilterShader, source);
+        m_Timings.fromCache = false;
+        m_Timings.bakeMilliseconds = millisecondsSince(start);
+        // the key only covers the source files, a bake from a lower level must not outlive the run
+        if (full) {
+            storeCache(key);
+        } else {
+            std::cout << "IBL: the sky's level 0 was not resident, the bake is not cached" << std::endl;
+        }
+        std::cout << "IBL: baked in " << m_Timings.bakeMilliseconds << " ms (readback "
+                  << m_Timings.readbackMilliseconds << " ms, SH " << m_Timings.shMilliseconds << " ms on "
+                  << m_Timings.threads << " threads, prefilter " << m_Timings.prefilterMilliseconds << " ms)"
+                  << std::endl;
+    }
+
+    // binds the prefiltered sky to unit and sets the lib/ibl.glsl uniforms
+    void bind(Shader& shader, unsigned int unit, float intensity) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, m_Prefiltered);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("prefilteredSky", unit);
+        shader.setFloat("prefilteredMaxLod", (float) (PREFILTER_MIPS - 1));
+        shader.setFloat("iblIntensity", intensity);
+        for (int i = 0; i < 9; ++i) {
+            shader.setVec3("shIrradiance[" + std::to_string(i) + "]",
+                           glm::vec3(m_SH[i * 3], m_SH[i * 3 + 1], m_SH[i * 3 + 2]));
+        }
+    }
+
+    const Timings& timings() const {
+        return m_Timings;
+    }
+
+    // Projects a cubemap given as six RGB float faces (GL face order, rows bottom up as
+    // glGetTexImage returns them) onto 9 SH coefficients per channel, pre-multiplied with
+    // the cosine lobe convolution and 1/pi, so albedo * sum(c_i * Y_i(n)) is the diffuse light.
+    // coefficients is 9 RGB triples.
+    static unsigned int projectSH(const std::vector<float>* faces, int size, float* coefficients) {
+        int rows = 6 * size;
+        int maxChunks = SH_CHUNKS;
+        int chunks = std::min(rows, maxChunks);
+        // a sum per chunk instead of per thread, whichever thread runs it
+        std::vector<std::vector<double>> partial(chunks, std::vector<double>(27, 0.0));
+        JobSystem::instance().parallelFor(chunks, 1, [&](size_t firstChunk, size_t lastChunk) {
+            for (size_t chunk = firstChunk; chunk < lastChunk; ++chunk) {
+                int first = rows * (int) chunk / chunks;
+                int last = rows * ((int) chunk + 1) / chunks;
+                for (int row = first; row < last; ++row) {
+                    projectRow(faces[row / size], row / size, row % size, size, partial[chunk].data());
+                }
+            }
+        });
+
+        // texel area on the unit cube face, the per texel part of the solid angle is in the sum
+        double texelArea = 4.0 / ((double) size * size);
+        const double bands[9] = { 1.0, 2.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0, 0.25, 0.25, 0.25, 0.25, 0.25 };
+        for (int i = 0; i < 27; ++i) {
+            double sum = 0.0;
+            for (int chunk = 0; chunk < chunks; ++chunk) {
+                sum += partial[chunk][i];
+            }
+            coefficients[i] = (float) (sum * texelArea * bands[i / 3]);
+        }
+        return std::min<unsigned int>(JobSystem::instance().threadCount(), (unsigned int) chunks);
+    }
+
+private:
+    static const uint32_t MAGIC = 0x42494752; // "RGIB"
+    // 2: bakes of streamed skies read level 0 from the baked file, drop those made from the tail
+    static const uint32_t VERSION = 2;
+    static const int PREFILTER_SAMPLES = 64;
+
+    struct Header {
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+        int32_t size = PREFILTER_SIZE;
+        int32_t mips = PREFILTER_MIPS;
+        float sh[27] = {};
+    };
+
+    static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // the unit cube point of texel (u, v) in [-1, 1] on a face is major + u * s + v * t
+    static void faceBasis(int face, float* major, float* s, float* t) {
+        static const float bases[6][9] = {
+            {  1, 0, 0,   0, 0, -1,   0, -1, 0 },
+            { -1, 0, 0,   0, 0,  1,   0, -1, 0 },
+            {  0, 1, 0,   1, 0,  0,   0, 0,  1 },
+            {  0, -1, 0,  1, 0,  0,   0, 0, -1 },
+            {  0, 0, 1,   1, 0,  0,   0, -1, 0 },
+            {  0, 0, -1, -1, 0,  0,   0, -1, 0 },
+        };
+        for (int i = 0; i < 3; ++i) {
+            major[i] = bases[face][i];
+            s[i] = bases[face][3 + i];
+            t[i] = bases[face][6 + i];
+        }
+    }
+
+    // adds one row of a face, weighted by the texel's solid angle, to the 27 sums
+    static void projectRow(const std::vector<float>& face, int faceIndex, int y, int size, double* sums) {
+        float major[3], s[3], t[3];
+        faceBasis(faceIndex, major, s, t);
+        float v = (y + 0.5f) / size * 2.0f - 1.0f;
+        const float* pixels = &face[(size_t) y * size * 3];
+        int x = 0;
+#if defined(__SSE2__)
+        __m128 acc[27];
+        for (int i = 0; i < 27; ++i) {
+            acc[i] = _mm_setzero_ps();
+        }
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 vv = _mm_set1_ps(v);
+        const __m128 step = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        const __m128 scale = _mm_set1_ps(2.0f / size);
+        const __m128 offset = _mm_set1_ps(1.0f / size - 1.0f);
+        for (; x + 4 <= size; x += 4) {
+            __m128 u = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps((float) x), step), scale), offset);
+            // 1 / |(u, v, 1)| and the solid angle weight 1 / |(u, v, 1)|^3
+            __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(vv, vv)), one);
+            __m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+            __m128 weight = _mm_mul_ps(_mm_mul_ps(inverseLength, inverseLength), inverseLength);
+            __m128 d[3];
+            for (int i = 0; i < 3; ++i) {
+                d[i] = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_set1_ps(major[i]), _mm_mul_ps(u, _mm_set1_ps(s[i]))),
+                                             _mm_set1_ps(v * t[i])), inverseLength);
+            }
+            __m128 basis[9];
+            shBasis(d[0], d[1], d[2], basis);
+            const float* p = pixels + x * 3;
+            __m128 color[3] = {
+                _mm_mul_ps(_mm_set_ps(p[9], p[6], p[3], p[0]), weight),
+                _mm_mul_ps(_mm_set_ps(p[10], p[7], p[4], p[1]), weight),
+                _mm_mul_ps(_mm_set_ps(p[11], p[8], p[5], p[2]), weight),
+            };
+            for (int i = 0; i < 9; ++i) {
+                for (int c = 0; c < 3; ++c) {
+                    acc[i * 3 + c] = _mm_add_ps(acc[i * 3 + c], _mm_mul_ps(basis[i], color[c]));
+                }
+            }
+        }
+        for (int i = 0; i < 27; ++i) {
+            float lanes[4];
+            _mm_storeu_ps(lanes, acc[i]);
+            sums[i] += (double) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        }
+#endif
+        for (; x < size; ++x) {
+            float u = (x + 0.5f) / size * 2.0f - 1.0f;
+            float inverseLength = 1.0f / std::sqrt(u * u + v * v + 1.0f);
+            float weight = inverseLength * inverseLength * inverseLength;
+            float d[3];
+            for (int i = 0; i < 3; ++i) {
+                d[i] = (major[i] + u * s[i] + v * t[i]) * inverseLength;
+            }
+            float basis[9];
+            shBasis(d[0], d[1], d[2], basis);
+            for (int i = 0; i < 9; ++i) {
+                for (int c = 0; c < 3; ++c) {
+                    sums[i * 3 + c] += basis[i] * pixels[x * 3 + c] * weight;
+                }
+            }
+        }
+    }
+
+    // real SH basis up to band 2, the same constants as IrradianceSH in lib/ibl.glsl
+    static void shBasis(float x, float y, float z, float* out) {
+        out[0] = 0.282095f;
+        out[1] = 0.488603f * y;
+        out[2] = 0.488603f * z;
+        out[3] = 0.488603f * x;
+        out[4] = 1.092548f * x * y;
+        out[5] = 1.092548f * y * z;
+        out[6] = 0.315392f * (3.0f * z * z - 1.0f);
+        out[7] = 1.092548f * x * z;
+        out[8] = 0.546274f * (x * x - y * y);
+    }
+
+#if defined(__SSE2__)
+    static void shBasis(__m128 x, __m128 y, __m128 z, __m128* out) {
+        const __m128 c0 = _mm_set1_ps(0.282095f), c1 = _mm_set1_ps(0.488603f);
+        const __m128 c2 = _mm_set1_ps(1.092548f), c3 = _mm_set1_ps(0.315392f), c4 = _mm_set1_ps(0.546274f);
+        out[0] = c0;
+        out[1] = _mm_mul_ps(c1, y);
+        out[2] = _mm_mul_ps(c1, z);
+        out[3] = _mm_mul_ps(c1, x);
+        out[4] = _mm_mul_ps(c2, _mm_mul_ps(x, y));
+        out[5] = _mm_mul_ps(c2, _mm_mul_ps(y, z));
+        out[6] = _mm_mul_ps(c3, _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(z, z)), _mm_set1_ps(1.0f)));
+        out[7] = _mm_mul_ps(c2, _mm_mul_ps(x, z));
+        out[8] = _mm_mul_ps(c4, _mm_sub_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+    }
+#endif
+
+    // false if it could only read a level below 0 of the sky
+    bool bake(GLuint sky, Shader& prefilterShader, const BakedMips* source) {
+        // top mip of the sky back from the GPU, whatever format it was uploaded in; the base
+        // level, a streamed sky (rg::MipStreaming) may not have the finer ones yet. Its level 0
+        // is then uploaded from the baked file into a texture of its own for the bake.
+        auto start = std::chrono::steady_clock::now();
+        glBindTexture(GL_TEXTURE_CUBE_MAP, sky);
+        GLint base = 0, size = 0;
+        glGetTexParameteriv(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, &base);
+        GLuint levelZero = 0;
+        if (base > 0 && source && source->target == GL_TEXTURE_CUBE_MAP) {
+            levelZero = uploadLevelZero(*source);
+            if (levelZero) {
+                sky = levelZero;
+                base = 0;
+                glBindTexture(GL_TEXTURE_CUBE_MAP, sky);
+            }
+        }
+        glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, base, GL_TEXTURE_WIDTH, &size);
+        std::vector<float> faces[6];
+        for (int face = 0; face < 6; ++face) {
+            faces[face].resize((size_t) size * size * 3);
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, base, GL_RGB, GL_FLOAT, faces[face].data());
+        }
+        // the prefilter reads blurrier mips of the sky for wide lobes
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        m_Timings.readbackMilliseconds = millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        m_Timings.threads = projectSH(faces, size, m_SH);
+        m_Timings.shMilliseconds = millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        prefilter(sky, size, prefilterShader);
+        glFinish();
+        m_Timings.prefilterMilliseconds = millisecondsSince(start);
+        if (levelZero) {
+            glDeleteTextures(1, &levelZero);
+        }
+        return base == 0;
+    }
+
+    // a cube with level 0 of every face read from the baked file, 0 if the file can't be read
+    static GLuint uploadLevelZero(const BakedMips& mips) {
+        std::ifstream in(mips.file, std::ios::binary);
+        std::vector<unsigned char> data(mips.levelBytes(0));
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int face = 0; face < 6; ++face) {
+            in.seekg((std::streamoff) mips.offsetOf(face, 0));
+            in.read(reinterpret_cast<char*>(data.data()), data.size());
+            if (!in) {
+                std::cout << "ERROR::IBL::CANNOT_READ " << mips.file << std::endl;
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+                glDeleteTextures(1, &texture);
+                return 0;
+            }
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, mips.internalFormat, mips.levelWidth(0),
+                         mips.levelHeight(0), 0, mips.format, mips.type, data.data());
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    void allocatePrefiltered() {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, m_Prefiltered);
+        for (int mip = 0; mip < PREFILTER_MIPS; ++mip) {
+            int size = PREFILTER_SIZE >> mip;
+            for (int face = 0; face < 6; ++face) {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGBA16F, size, size, 0, GL_RGBA,
+                             GL_HALF_FLOAT, NULL);
+            }
+        }
+        GpuMemory::instance().track(GpuMemory::TEXTURE, m_Prefiltered,
+                                    textureBytes(PREFILTER_SIZE, PREFILTER_SIZE, 8, PREFILTER_MIPS, 6), "image based lighting");
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, PREFILTER_MIPS - 1);
+    }
+
+    void prefilter(GLuint sky, int skySize, Shader& shader) {
+        allocatePrefiltered();
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+        shader.use();
+        shader.setInt("sky", 0);
+        shader.setFloat("sourceSize", (float) skySize);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, sky);
+        glBindVertexArray(m_FullscreenVAO);
+        for (int mip = 0; mip < PREFILTER_MIPS; ++mip) {
+            int size = PREFILTER_SIZE >> mip;
+            glViewport(0, 0, size, size);
+            shader.setFloat("roughness", (float) mip / (PREFILTER_MIPS - 1));
+            for (int face = 0; face < 6; ++face) {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                                       m_Prefiltered, mip);
+                shader.setInt("face", face);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+        }
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+        if (blend)
+            glEnable(GL_BLEND);
+    }
+
+    std::string pathFor(const std::string& key) const {
+        return m_Directory + "/" + key + ".ibl";
+    }
+
+    bool loadCache(const std::string& key) {
+        std::ifstream in(pathFor(key), std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        Header header;
+        in.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!in || header.magic != MAGIC || header.version != VERSION || header.size != PREFILTER_SIZE
+            || header.mips != PREFILTER_MIPS) {
+            return false;
+        }
+        std::vector<uint16_t> data;
+        allocatePrefiltered();
+        for (int mip = 0; mip < PREFILTER_MIPS; ++mip) {
+            int size = PREFILTER_SIZE >> mip;
+            data.resize((size_t) size * size * 4);
+            for (int face = 0; face < 6; ++face) {
+                in.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(uint16_t));
+                if (!in) {
+                    return false;
+                }
+                glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, 0, 0, size, size, GL_RGBA, GL_HALF_FLOAT,
+                                data.data());
+            }
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        std::copy(header.sh, header.sh + 27, m_SH);
+        return true;
+    }
+
+    void storeCache(const std::string& key) {
+        mkdir(m_Directory.c_str(), 0755);
+        std::ofstream out(pathFor(key), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "ERROR::IBL::CANNOT_WRITE " << pathFor(key) << std::endl;
+            return;
+        }
+        Header header;
+        std::copy(m_SH, m_SH + 27, header.sh);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        std::vector<uint16_t> data;
+        glBindTexture(GL_TEXTURE_CUBE_MAP, m_Prefiltered);
+        for (int mip = 0; mip < PREFILTER_MIPS; ++mip) {
+            int size = PREFILTER_SIZE >> mip;
+            data.resize((size_t) size * size * 4);
+            for (int face = 0; face < 6; ++face) {
+                glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGBA, GL_HALF_FLOAT, data.data());
+                out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(uint16_t));
+            }
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    }
+
+    std::string m_Directory = "resources/ibl_cache";
+    GLuint m_Prefiltered = 0;
+    GLuint m_FullscreenVAO = 0;
+    GLuint m_Framebuffer = 0;
+    float m_SH[27] = {};
+    Timings m_Timings;
+};
+
+}
+
+#endif //PROJECT_BASE_IMAGEBASEDLIGHTING_H
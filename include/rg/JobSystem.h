@@ -0,0 +1,381 @@
+#ifndef PROJECT_BASE_JOBSYSTEM_H
+#define PROJECT_BASE_JOBSYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace rg {
+
+class JobSystem;
+
+// Counts the jobs started with it that haven't finished. Jobs can be made to wait for a
+// counter instead of blocking a thread: JobSystem::run(work, counter, after) keeps the job
+// aside until after reaches zero. A counter must outlive its jobs, JobSystem::wait() on it
+// before it goes out of scope.
+class JobCounter {
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool done() const {
+        // finishing covers the moment between the last decrement and the release of the
+        // continuations, the counter can't be destroyed before that is over either
+        return m_Pending.load() == 0 && m_Finishing.load() == 0;
+    }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<int> m_Pending{0};
+    std::atomic<int> m_Finishing{0};
+    std::mutex m_Mutex;
+    std::vector<void*> m_Continuations;     // jobs waiting for the counter, as JobSystem::Job*
+};
+
+// Work stealing job scheduler. Every thread has a Chase-Lev deque: the owner pushes and pops
+// jobs at the bottom, idle threads steal the oldest ones from the top of a random other deque,
+// so a parallel loop spreads out without a shared queue everyone contends on. The thread that
+// creates the system (the main thread for instance()) is thread 0 and runs jobs while it
+// waits on a counter, the workers sleep on a condition variable when there is nothing to steal.
+//
+// A job is any callable up to JOB_STORAGE bytes, stored inline in a slot of the submitting
+// thread's pool; capture larger state by reference. Threads the system doesn't know, like a
+// std::thread of its own, run their jobs inline. A full deque or pool runs the job inline too.
+class JobSystem {
+public:
+    static const size_t JOB_STORAGE = 64;
+    static const int DEQUE_CAPACITY = 4096;     // a power of two
+    static const int POOL_SIZE = 4096;      // a power of two
+    static const int POOL_PROBES = 8;
+    // yields before a worker with nothing to steal goes to sleep
+    static const int SPINS = 64;
+
+    // one worker per hardware thread besides the main thread
+    static JobSystem& instance() {
+        static JobSystem jobs(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return jobs;
+    }
+
+    explicit JobSystem(unsigned int workers)
+        : m_MainThread(std::this_thread::get_id()) {
+        for (unsigned int i = 0; i <= workers; ++i) {
+            m_Threads.emplace_back(new ThreadState);
+        }
+        for (unsigned int i = 1; i <= workers; ++i) {
+            m_Workers.emplace_back(&JobSystem::workerLoop, this, (int) i);
+        }
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(m_SleepMutex);
+            m_Stop = true;
+        }
+        m_Wake.notify_all();
+        for (std::thread& worker : m_Workers) {
+            worker.join();
+        }
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // the workers and the main thread
+    unsigned int threadCount() const {
+        return (unsigned int) m_Threads.size();
+    }
+
+    template <typename F>
+    void run(F&& work, JobCounter& counter) {
+        run(std::forward<F>(work), counter, nullptr);
+    }
+
+    // work starts once after has reached zero; after may be null
+    template <typename F>
+    void run(F&& work, JobCounter& counter, JobCounter* after) {
+        typedef typename std::decay<F>::type Work;
+        static_assert(sizeof(Work) <= JOB_STORAGE, "capture the job's state by reference");
+        int thread = threadIndex();
+        Job* job = thread >= 0 ? allocate(thread) : nullptr;
+        if (!job) {
+            if (after) {
+                wait(*after);
+            }
+            work();
+            return;
+        }
+        new (&job->storage) Work(std::forward<F>(work));
+        job->invoke = [](void* storage) {
+            Work& w = *static_cast<Work*>(storage);
+            w();
+            w.~Work();
+        };
+        job->counter = &counter;
+        counter.m_Pending.fetch_add(1);
+        if (after) {
+            std::unique_lock<std::mutex> lock(after->m_Mutex);
+            if (after->m_Pending.load() > 0) {
+                after->m_Continuations.push_back(job);
+                return;
+            }
+        }
+        submit(thread, job);
+    }
+
+    // runs jobs, this thread's own first, until the counter is done
+    void wait(const JobCounter& counter) {
+        int thread = threadIndex();
+        while (!counter.done()) {
+            Job* job = thread >= 0 ? find(thread) : nullptr;
+            if (job) {
+                execute(job);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // body(first, last) over [0, count) in chunks of grain; the calling thread takes the first
+    // chunk and then helps with the rest
+    template <typename F>
+    void parallelFor(size_t count, size_t grain, const F& body) {
+        grain = std::max<size_t>(grain, 1);
+        if (count <= grain || threadIndex() < 0 || m_Workers.empty()) {
+            if (count > 0) {
+                body((size_t) 0, count);
+            }
+            return;
+        }
+        JobCounter counter;
+        for (size_t first = grain; first < count; first += grain) {
+            size_t last = std::min(first + grain, count);
+            run([&body, first, last]() { body(first, last); }, counter);
+        }
+        body((size_t) 0, grain);
+        wait(counter);
+    }
+
+    // jobs executed by every thread since the last call, thread 0 first; for the benchmarks
+    std::vector<size_t> takeExecutedCounts() {
+        std::vector<size_t> counts;
+        for (auto& state : m_Threads) {
+            counts.push_back(state->executed.exchange(0));
+        }
+        return counts;
+    }
+
+private:
+    class Job {
+    public:
+        std::aligned_storage<JOB_STORAGE, alignof(std::max_align_t)>::type storage;
+        void (*invoke)(void*) = nullptr;
+        JobCounter* counter = nullptr;
+        std::atomic<bool> busy{false};
+    };
+
+    // Chase-Lev deque with a fixed capacity, after Lê, Pop, Cohen, Zappa Nardelli: "Correct
+    // and Efficient Work-Stealing for Weak Memory Models". push and pop only from the owner.
+    class Deque {
+    public:
+        bool push(Job* job) {
+            int64_t bottom = m_Bottom.load(std::memory_order_relaxed);
+            int64_t top = m_Top.load(std::memory_order_acquire);
+            if (bottom - top >= DEQUE_CAPACITY) {
+                return false;
+            }
+            m_Jobs[bottom & (DEQUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        Job* pop() {
+            int64_t bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+            m_Bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t top = m_Top.load(std::memory_order_relaxed);
+            if (top > bottom) {
+                m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            Job* job = m_Jobs[bottom & (DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+            if (top == bottom) {
+                // the last job, a thief may be taking it at the same time
+                if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                   std::memory_order_relaxed)) {
+                    job = nullptr;
+                }
+                m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+
+        Job* steal() {
+            int64_t top = m_Top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t bottom = m_Bottom.load(std::memory_order_acquire);
+            if (top >= bottom) {
+                return nullptr;
+            }
+            Job* job = m_Jobs[top & (DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+            if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return job;
+        }
+
+    private:
+        // top and bottom on their own cache lines, thieves only write top
+        std::atomic<int64_t> m_Top{0};
+        char m_TopPadding[64 - sizeof(std::atomic<int64_t>)];
+        std::atomic<int64_t> m_Bottom{0};
+        char m_BottomPadding[64 - sizeof(std::atomic<int64_t>)];
+        std::atomic<Job*> m_Jobs[DEQUE_CAPACITY] = {};
+    };
+
+    struct ThreadState {
+        Deque deque;
+        Job pool[POOL_SIZE];
+        int next = 0;                       // where allocate() looks first
+        uint32_t random = 0x9e3779b9u;      // xorshift state for picking a victim
+        std::atomic<size_t> executed{0};
+    };
+
+    struct ThreadSlot {
+        const JobSystem* system = nullptr;
+        int index = -1;
+    };
+
+    static ThreadSlot& threadSlot() {
+        thread_local ThreadSlot slot;
+        return slot;
+    }
+
+    // 0 for the main thread, 1.. for the workers, -1 for threads the system doesn't know
+    int threadIndex() const {
+        const ThreadSlot& slot = threadSlot();
+        if (slot.system == this) {
+            return slot.index;
+        }
+        return std::this_thread::get_id() == m_MainThread ? 0 : -1;
+    }
+
+    // a free slot of the thread's pool; slots are freed by whoever executes the job, mostly in
+    // the order they were taken, so a few busy ones in a row mean the pool is full
+    Job* allocate(int thread) {
+        ThreadState& state = *m_Threads[thread];
+        for (int i = 0; i < POOL_PROBES; ++i) {
+            Job& job = state.pool[state.next];
+            state.next = (state.next + 1) & (POOL_SIZE - 1);
+            if (!job.busy.load(std::memory_order_acquire)) {
+                job.busy.store(true, std::memory_order_relaxed);
+                return &job;
+            }
+        }
+        return nullptr;
+    }
+
+    void submit(int thread, Job* job) {
+        if (!m_Threads[thread]->deque.push(job)) {
+            execute(job);
+            return;
+        }
+        m_Queued.fetch_add(1);
+        if (m_Sleeping.load() > 0) {
+            std::lock_guard<std::mutex> lock(m_SleepMutex);
+            m_Wake.notify_one();
+        }
+    }
+
+    Job* find(int thread) {
+        Job* job = m_Threads[thread]->deque.pop();
+        if (!job && m_Threads.size() > 1) {
+            ThreadState& state = *m_Threads[thread];
+            uint32_t& x = state.random;
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            size_t first = x % m_Threads.size();
+            for (size_t i = 0; i < m_Threads.size() && !job; ++i) {
+                size_t victim = (first + i) % m_Threads.size();
+                if ((int) victim != thread) {
+                    job = m_Threads[victim]->deque.steal();
+                }
+            }
+        }
+        if (job) {
+            m_Queued.fetch_sub(1);
+        }
+        return job;
+    }
+
+    void execute(Job* job) {
+        job->invoke(&job->storage);
+        JobCounter* counter = job->counter;
+        job->busy.store(false, std::memory_order_release);
+        int thread = threadIndex();
+        if (thread >= 0) {
+            m_Threads[thread]->executed.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::vector<void*> released;
+        counter->m_Finishing.fetch_add(1);
+        if (counter->m_Pending.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(counter->m_Mutex);
+            released.swap(counter->m_Continuations);
+        }
+        counter->m_Finishing.fetch_sub(1);
+        // only now, a continuation may be what lets its owner destroy the counter
+        for (void* continuation : released) {
+            submit(thread, static_cast<Job*>(continuation));
+        }
+    }
+
+    void workerLoop(int index) {
+        ThreadSlot& slot = threadSlot();
+        slot.system = this;
+        slot.index = index;
+        m_Threads[index]->random ^= (uint32_t) index * 0x85ebca6bu;
+        while (!m_Stop.load()) {
+            Job* job = nullptr;
+            for (int spin = 0; spin < SPINS && !job; ++spin) {
+                job = find(index);
+                if (!job) {
+                    std::this_thread::yield();
+                }
+            }
+            if (job) {
+                execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_SleepMutex);
+            m_Sleeping.fetch_add(1);
+            m_Wake.wait(lock, [this]() { return m_Queued.load() > 0 || m_Stop.load(); });
+            m_Sleeping.fetch_sub(1);
+        }
+    }
+
+    std::thread::id m_MainThread;
+    std::vector<std::unique_ptr<ThreadState>> m_Threads;
+    std::vector<std::thread> m_Workers;
+    std::atomic<int> m_Queued{0};
+    std::atomic<int> m_Sleeping{0};
+    std::atomic<bool> m_Stop{false};
+    std::mutex m_SleepMutex;
+    std::condition_variable m_Wake;
+};
+
+}
+
+#endif //PROJECT_BASE_JOBSYSTEM_H
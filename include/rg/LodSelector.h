@@ -0,0 +1,41 @@
+#ifndef PROJECT_BASE_LODSELECTOR_H
+#define PROJECT_BASE_LODSELECTOR_H
+
+#include <learnopengl/model.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace rg {
+
+// Picks a model's LOD from how large it is on screen. A LOD is good enough while its error,
+// projected like the model itself, stays under pixelError pixels. Moving to a coarser LOD needs
+// the error to be hysteresis below that and going back needs it to be hysteresis above, so a
+// model sitting at a boundary doesn't switch every frame.
+struct LodSelector {
+    float pixelError = 1.0f;
+    float hysteresis = 0.25f;
+
+    // pixels per model unit at the near side of a bounding sphere; scale is the model matrix scale
+    static float pixelsPerUnit(float distance, float radius, float scale, float fovY, float screenHeight) {
+        float nearest = std::max(distance - radius, 0.1f);
+        return scale * screenHeight / (2.0f * nearest * std::tan(fovY * 0.5f));
+    }
+
+    int select(const Model& model, float pixelsPerUnit, int current) const {
+        int lod = 0;
+        for (int level = 1; level < model.LodCount(); ++level) {
+            float pixels = model.LodError(level) * pixelsPerUnit;
+            float limit = pixelError * (level > current ? 1.0f - hysteresis : 1.0f + hysteresis);
+            if (pixels > limit) {
+                break;
+            }
+            lod = level;
+        }
+        return lod;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_LODSELECTOR_H
@@ -0,0 +1,201 @@
+#ifndef PROJECT_BASE_MESHCACHE_H
+#define PROJECT_BASE_MESHCACHE_H
+
+#include <learnopengl/mesh.h>
+#include <rg/Hash.h>
+
+#include <sys/stat.h>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Everything Model needs to rebuild a mesh without Assimp: the optimized vertices and
+// indices, the simplified index lists of LOD 1 and up with their errors in model units, and
+// the material textures as (type, path relative to the model) pairs.
+struct CachedMesh {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<std::vector<unsigned int>> lods;
+    std::vector<float> lodErrors;
+    std::vector<std::pair<std::string, std::string>> textures;
+};
+
+// On-disk cache of imported models, so the import and the index optimization in
+// rg/MeshOptimizer.h are paid once. The key is the model file's and its material
+// library's name, size and modification time plus the cache version, which goes up
+// whenever the import or the optimization changes what ends up in the buffers.
+class MeshCache {
+public:
+    struct Stats {
+        unsigned int hits = 0;
+        unsigned int imported = 0;
+    };
+
+    static MeshCache& instance() {
+        static MeshCache cache;
+        return cache;
+    }
+
+    void setDirectory(const std::string& path) {
+        m_Directory = path;
+    }
+
+    std::string key(const std::string& modelPath) const {
+        // a local copy, taking the address of the static constant would need a definition
+        uint32_t version = VERSION;
+        uint64_t hash = hashBytes(&version, sizeof(version));
+        hash = hashFileStamp(modelPath, hash);
+        // obj materials live next to the model in a file of the same name
+        std::string::size_type dot = modelPath.find_last_of('.');
+        if (dot != std::string::npos) {
+            hash = hashFileStamp(modelPath.substr(0, dot) + ".mtl", hash);
+        }
+        return hashToHex(hash);
+    }
+
+    bool load(const std::string& key, std::vector<CachedMesh>& meshes) {
+        std::ifstream in(pathFor(key), std::ios::binary | std::ios::ate);
+        if (!in) {
+            return false;
+        }
+        // every count is checked against the bytes left in the file before anything is sized
+        // by it, so a truncated or corrupted file fails instead of allocating
+        uint64_t fileSize = (uint64_t) in.tellg();
+        in.seekg(0);
+        Header header;
+        in.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!in || header.magic != MAGIC || header.version != VERSION
+            || !fits(in, fileSize, (uint64_t) header.meshCount * (sizeof(uint32_t) * 4))) {
+            return false;
+        }
+        meshes.resize(header.meshCount);
+        for (CachedMesh& mesh : meshes) {
+            uint32_t counts[3] = {};
+            in.read(reinterpret_cast<char*>(counts), sizeof(counts));
+            // each texture has at least its two string lengths
+            uint64_t bytes = (uint64_t) counts[0] * sizeof(Vertex) + (uint64_t) counts[1] * sizeof(unsigned int)
+                             + (uint64_t) counts[2] * sizeof(uint32_t) * 2;
+            if (!in || !fits(in, fileSize, bytes)) {
+                return false;
+            }
+            mesh.vertices.resize(counts[0]);
+            mesh.indices.resize(counts[1]);
+            mesh.textures.resize(counts[2]);
+            in.read(reinterpret_cast<char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+            in.read(reinterpret_cast<char*>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+            for (auto& texture : mesh.textures) {
+                if (!readString(in, texture.first) || !readString(in, texture.second)) {
+                    return false;
+                }
+            }
+            uint32_t lodCount = 0;
+            in.read(reinterpret_cast<char*>(&lodCount), sizeof(lodCount));
+            if (!in || lodCount > MAX_LODS) {
+                return false;
+            }
+            mesh.lods.resize(lodCount);
+            mesh.lodErrors.resize(lodCount);
+            for (uint32_t i = 0; i < lodCount; ++i) {
+                uint32_t count = 0;
+                in.read(reinterpret_cast<char*>(&mesh.lodErrors[i]), sizeof(float));
+                in.read(reinterpret_cast<char*>(&count), sizeof(count));
+                if (!in || count > mesh.indices.size() || !fits(in, fileSize, (uint64_t) count * sizeof(unsigned int))) {
+                    return false;
+                }
+                mesh.lods[i].resize(count);
+                in.read(reinterpret_cast<char*>(mesh.lods[i].data()), count * sizeof(unsigned int));
+            }
+            if (!in) {
+                return false;
+            }
+        }
+        ++m_Stats.hits;
+        return true;
+    }
+
+    void store(const std::string& key, const std::vector<CachedMesh>& meshes) {
+        ++m_Stats.imported;
+        mkdir(m_Directory.c_str(), 0755);
+        std::ofstream out(pathFor(key), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "ERROR::MESH_CACHE::CANNOT_WRITE " << pathFor(key) << std::endl;
+            return;
+        }
+        Header header;
+        header.meshCount = (uint32_t) meshes.size();
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const CachedMesh& mesh : meshes) {
+            uint32_t counts[3] = { (uint32_t) mesh.vertices.size(), (uint32_t) mesh.indices.size(),
+                                   (uint32_t) mesh.textures.size() };
+            out.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+            out.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+            out.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+            for (const auto& texture : mesh.textures) {
+                writeString(out, texture.first);
+                writeString(out, texture.second);
+            }
+            uint32_t lodCount = (uint32_t) mesh.lods.size();
+            out.write(reinterpret_cast<const char*>(&lodCount), sizeof(lodCount));
+            for (uint32_t i = 0; i < lodCount; ++i) {
+                uint32_t count = (uint32_t) mesh.lods[i].size();
+                out.write(reinterpret_cast<const char*>(&mesh.lodErrors[i]), sizeof(float));
+                out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+                out.write(reinterpret_cast<const char*>(mesh.lods[i].data()), count * sizeof(unsigned int));
+            }
+        }
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x48534d52; // "RMSH"
+    static const uint32_t VERSION = 2;
+    static const uint32_t MAX_LODS = 8;
+
+    struct Header {
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+        uint32_t meshCount = 0;
+    };
+
+    MeshCache() = default;
+
+    // whether bytes more can still be read from a file of fileSize bytes
+    static bool fits(std::ifstream& in, uint64_t fileSize, uint64_t bytes) {
+        return bytes <= fileSize - (uint64_t) in.tellg();
+    }
+
+    static bool readString(std::ifstream& in, std::string& s) {
+        uint32_t length = 0;
+        in.read(reinterpret_cast<char*>(&length), sizeof(length));
+        if (!in || length > 4096) {
+            return false;
+        }
+        s.resize(length);
+        in.read(&s[0], length);
+        return (bool) in;
+    }
+
+    static void writeString(std::ofstream& out, const std::string& s) {
+        uint32_t length = (uint32_t) s.size();
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(s.data(), length);
+    }
+
+    std::string pathFor(const std::string& key) const {
+        return m_Directory + "/" + key + ".mesh";
+    }
+
+    std::string m_Directory = "resources/mesh_cache";
+    Stats m_Stats;
+};
+
+}
+
+#endif //PROJECT_BASE_MESHCACHE_H
@@ -0,0 +1,314 @@
+#ifndef PROJECT_BASE_MESHOPTIMIZER_H
+#define PROJECT_BASE_MESHOPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace rg {
+
+// Import-time index and vertex reordering for the GPU caches, run once per mesh before it
+// goes to the mesh cache:
+//   optimizeVertexCache   Forsyth's greedy triangle order for an LRU post-transform cache
+//   optimizeOverdraw      cuts that order into clusters where the cache restarts anyway and
+//                         draws outward facing clusters first, so they occlude the rest
+//   optimizeVertexFetch   renumbers vertices in first-use order, the vertex buffer is then
+//                         read front to back
+// The passes only reorder, the triangles and their winding stay the same.
+
+struct VertexCacheStats {
+    // transformed vertices per triangle, 0.5 is ideal on a regular grid and 3 the worst
+    double acmr = 0.0;
+    // transformed vertices per vertex, 1 is ideal
+    double atvr = 0.0;
+};
+
+// simulates a FIFO cache of cacheSize entries, about what current GPUs behave like
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount,
+                                    unsigned int cacheSize = 16) {
+    VertexCacheStats stats;
+    if (indices.empty() || vertexCount == 0) {
+        return stats;
+    }
+    std::vector<unsigned int> timestamps(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    size_t misses = 0;
+    for (unsigned int index : indices) {
+        if (time - timestamps[index] > cacheSize) {
+            timestamps[index] = time++;
+            ++misses;
+        }
+    }
+    stats.acmr = (double) misses / (indices.size() / 3);
+    stats.atvr = (double) misses / vertexCount;
+    return stats;
+}
+
+namespace detail {
+
+const int FORSYTH_CACHE_SIZE = 32;
+
+// cache position score: the last triangle's vertices are held back a little so strips
+// don't turn back on themselves, then falling off towards the end of the cache
+float forsythCacheScore(int position) {
+    if (position < 0) {
+        return 0.0f;
+    }
+    if (position < 3) {
+        return 0.75f;
+    }
+    float scaled = 1.0f - (float) (position - 3) / (FORSYTH_CACHE_SIZE - 3);
+    return std::pow(scaled, 1.5f);
+}
+
+// vertices with few triangles left get a boost so they are finished and leave the cache
+float forsythValenceScore(unsigned int remaining) {
+    return remaining == 0 ? 0.0f : 2.0f / std::sqrt((float) remaining);
+}
+
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // triangles of every vertex
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (unsigned int index : indices) {
+        ++offsets[index + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        adjacency[fill[indices[i]]++] = (unsigned int) (i / 3);
+    }
+
+    std::vector<unsigned int> remaining(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        remaining[v] = offsets[v + 1] - offsets[v];
+    }
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        vertexScore[v] = detail::forsythValenceScore(remaining[v]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]]
+                           + vertexScore[indices[t * 3 + 2]];
+    }
+    std::vector<char> emitted(triangleCount, 0);
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(detail::FORSYTH_CACHE_SIZE + 3);
+    nextCache.reserve(detail::FORSYTH_CACHE_SIZE + 3);
+    size_t scanFrom = 0;
+
+    long best = -1;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (best < 0 || triangleScore[t] > triangleScore[best]) {
+            best = (long) t;
+        }
+    }
+
+    while (best >= 0) {
+        emitted[best] = 1;
+        const unsigned int* triangle = &indices[best * 3];
+        result.insert(result.end(), triangle, triangle + 3);
+
+        // the triangle's vertices move to the front of the cache
+        nextCache.assign(triangle, triangle + 3);
+        for (unsigned int v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                nextCache.push_back(v);
+            }
+        }
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = triangle[k];
+            // drop the triangle from its vertices' lists of remaining triangles
+            unsigned int* begin = &adjacency[offsets[v]];
+            unsigned int* end = begin + remaining[v];
+            unsigned int* it = std::find(begin, end, (unsigned int) best);
+            if (it != end) {
+                std::swap(*it, *(end - 1));
+                --remaining[v];
+            }
+        }
+        if (nextCache.size() > (size_t) detail::FORSYTH_CACHE_SIZE) {
+            // evicted vertices lose their cache score, and so do their triangles
+            for (size_t i = detail::FORSYTH_CACHE_SIZE; i < nextCache.size(); ++i) {
+                unsigned int v = nextCache[i];
+                vertexScore[v] = detail::forsythValenceScore(remaining[v]);
+                for (unsigned int a = offsets[v]; a < offsets[v] + remaining[v]; ++a) {
+                    unsigned int t = adjacency[a];
+                    triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]]
+                                       + vertexScore[indices[t * 3 + 2]];
+                }
+            }
+            nextCache.resize(detail::FORSYTH_CACHE_SIZE);
+        }
+        cache.swap(nextCache);
+
+        // rescore the cached vertices and their triangles, the best of those goes next
+        for (size_t i = 0; i < cache.size(); ++i) {
+            unsigned int v = cache[i];
+            vertexScore[v] = detail::forsythCacheScore((int) i) + detail::forsythValenceScore(remaining[v]);
+        }
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache) {
+            for (unsigned int a = offsets[v]; a < offsets[v] + remaining[v]; ++a) {
+                unsigned int t = adjacency[a];
+                float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]]
+                              + vertexScore[indices[t * 3 + 2]];
+                triangleScore[t] = score;
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = (long) t;
+                }
+            }
+        }
+        // nothing left around the cache: continue with the next unused triangle
+        if (best < 0) {
+            while (scanFrom < triangleCount && emitted[scanFrom]) {
+                ++scanFrom;
+            }
+            if (scanFrom < triangleCount) {
+                best = (long) scanFrom;
+            }
+        }
+    }
+    indices.swap(result);
+}
+
+// threshold is how much worse than the vertex cache order the result may get, 1.05 allows 5%
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+                      float threshold = 1.05f, unsigned int cacheSize = 16) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // hard boundaries: triangles where all three vertices miss, the cache starts over there
+    std::vector<size_t> clusters;
+    {
+        std::vector<unsigned int> timestamps(positions.size(), 0);
+        unsigned int time = cacheSize + 1;
+        for (size_t t = 0; t < triangleCount; ++t) {
+            int misses = 0;
+            for (int k = 0; k < 3; ++k) {
+                unsigned int v = indices[t * 3 + k];
+                if (time - timestamps[v] > cacheSize) {
+                    timestamps[v] = time++;
+                    ++misses;
+                }
+            }
+            if (t == 0 || misses == 3) {
+                clusters.push_back(t);
+            }
+        }
+    }
+
+    // soft boundaries: split a cluster further where its ACMR so far stays under the limit
+    double limit = analyzeVertexCache(indices, positions.size(), cacheSize).acmr * threshold;
+    std::vector<size_t> split;
+    {
+        std::vector<unsigned int> timestamps(positions.size(), 0);
+        unsigned int time = cacheSize + 1;
+        for (size_t c = 0; c < clusters.size(); ++c) {
+            size_t begin = clusters[c];
+            size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+            size_t start = begin;
+            size_t misses = 0;
+            split.push_back(begin);
+            time += cacheSize + 1;
+            for (size_t t = begin; t < end; ++t) {
+                for (int k = 0; k < 3; ++k) {
+                    unsigned int v = indices[t * 3 + k];
+                    if (time - timestamps[v] > cacheSize) {
+                        timestamps[v] = time++;
+                        ++misses;
+                    }
+                }
+                size_t triangles = t + 1 - start;
+                // a new cluster needs a few triangles to make up for its cold start
+                if (t + 1 < end && triangles >= 16 && (double) misses / triangles <= limit) {
+                    split.push_back(t + 1);
+                    start = t + 1;
+                    misses = 0;
+                    time += cacheSize + 1;
+                }
+            }
+        }
+    }
+
+    // sort clusters by how far out they face from the mesh center
+    glm::vec3 meshCenter(0.0f);
+    for (const glm::vec3& p : positions) {
+        meshCenter += p;
+    }
+    meshCenter /= (float) std::max<size_t>(positions.size(), 1);
+    std::vector<float> sortKeys(split.size());
+    for (size_t c = 0; c < split.size(); ++c) {
+        size_t begin = split[c];
+        size_t end = c + 1 < split.size() ? split[c + 1] : triangleCount;
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = begin; t < end; ++t) {
+            const glm::vec3& a = positions[indices[t * 3]];
+            const glm::vec3& b = positions[indices[t * 3 + 1]];
+            const glm::vec3& c2 = positions[indices[t * 3 + 2]];
+            glm::vec3 n = glm::cross(b - a, c2 - a);
+            float triangleArea = glm::length(n);
+            center += (a + b + c2) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        center = area > 0.0f ? center / area : positions[indices[begin * 3]];
+        float normalLength = glm::length(normal);
+        sortKeys[c] = normalLength > 0.0f ? glm::dot(center - meshCenter, normal / normalLength) : 0.0f;
+    }
+    std::vector<size_t> order(split.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return sortKeys[a] > sortKeys[b];
+    });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c : order) {
+        size_t begin = split[c];
+        size_t end = c + 1 < split.size() ? split[c + 1] : triangleCount;
+        result.insert(result.end(), indices.begin() + begin * 3, indices.begin() + end * 3);
+    }
+    indices.swap(result);
+}
+
+// V is any vertex type; vertices nothing refers to are dropped
+template <typename V>
+void optimizeVertexFetch(std::vector<V>& vertices, std::vector<unsigned int>& indices) {
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<V> reordered;
+    reordered.reserve(vertices.size());
+    for (unsigned int& index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = (unsigned int) reordered.size();
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+}
+
+#endif //PROJECT_BASE_MESHOPTIMIZER_H
@@ -0,0 +1,234 @@
+#ifndef PROJECT_BASE_MESHSIMPLIFIER_H
+#define PROJECT_BASE_MESHSIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <unordered_set>
+#include <vector>
+
+namespace rg {
+
+// Quadric error edge collapse (Garland-Heckbert) for the LOD chains built at import. Collapses
+// are half-edge collapses: a vertex moves onto a neighbour and is dropped, so the simplified
+// mesh only indexes the original vertex buffer and every LOD shares it. Vertices on an edge
+// used by a single triangle are never moved. After aiProcess_JoinIdenticalVertices those are
+// the mesh borders and every UV or normal seam, where the vertex exists once per side, so the
+// seams survive unchanged. Collapses that flip a triangle or join vertices whose normals differ
+// a lot are rejected.
+
+namespace detail {
+
+// symmetric 4x4 matrix of the summed squared plane distances, plus the summed weight
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double weight = 0;
+
+    void addPlane(const glm::vec3& n, double d, double w) {
+        a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+        a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+        a22 += w * n.z * n.z; a23 += w * n.z * d;
+        a33 += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+        weight += q.weight;
+    }
+
+    // mean squared distance of p to the planes
+    double error(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                 + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                 + a22 * z * z + 2 * a23 * z
+                 + a33;
+        return weight > 0 ? std::fabs(e) / weight : 0.0;
+    }
+};
+
+}
+
+// Collapses edges in order of quadric error until the index count is down to targetIndexCount
+// or the next collapse would move the surface further than maxError. error receives the largest
+// distance error accepted, in the units of the positions.
+std::vector<unsigned int> simplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+                                       const std::vector<unsigned int>& indices, size_t targetIndexCount,
+                                       float maxError, float* error = nullptr) {
+    const size_t vertexCount = positions.size();
+    std::vector<unsigned int> result(indices);
+    double worst = 0.0;
+
+    // vertices on open edges stay where they are
+    std::vector<char> locked(vertexCount, 0);
+    {
+        std::unordered_set<uint64_t> edges;
+        edges.reserve(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            for (int k = 0; k < 3; ++k) {
+                edges.insert((uint64_t) indices[i + k] << 32 | indices[i + (k + 1) % 3]);
+            }
+        }
+        for (uint64_t edge : edges) {
+            unsigned int a = (unsigned int) (edge >> 32), b = (unsigned int) edge;
+            if (!edges.count((uint64_t) b << 32 | a)) {
+                locked[a] = locked[b] = 1;
+            }
+        }
+    }
+
+    // area weighted plane quadrics of the triangles around each vertex
+    std::vector<detail::Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const glm::vec3& p0 = positions[indices[i]];
+        glm::vec3 n = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+        float area = glm::length(n);
+        if (area == 0.0f) {
+            continue;
+        }
+        n /= area;
+        double d = -glm::dot(n, p0);
+        for (int k = 0; k < 3; ++k) {
+            quadrics[indices[i + k]].addPlane(n, d, area);
+        }
+    }
+
+    struct Collapse {
+        unsigned int from, to;
+        double error;
+    };
+    std::vector<Collapse> candidates;
+    std::vector<unsigned int> offsets, adjacency, fill, remap(vertexCount);
+    std::vector<char> touched(vertexCount);
+    const double limit = (double) maxError * maxError;
+    // how far the normals of two vertices may differ before they count as a crease
+    const float normalLimit = 0.5f;
+
+    while (result.size() > targetIndexCount) {
+        size_t triangleCount = result.size() / 3;
+
+        candidates.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (int k = 0; k < 3; ++k) {
+                unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+                if (glm::dot(normals[a], normals[b]) < normalLimit) {
+                    continue;
+                }
+                if (!locked[a])
+                    candidates.push_back(Collapse{a, b, quadrics[a].error(positions[b])});
+                if (!locked[b])
+                    candidates.push_back(Collapse{b, a, quadrics[b].error(positions[a])});
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y) {
+            return x.error < y.error;
+        });
+
+        // triangles around every vertex
+        offsets.assign(vertexCount + 1, 0);
+        for (unsigned int index : result) {
+            ++offsets[index + 1];
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        adjacency.resize(result.size());
+        fill.assign(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < result.size(); ++i) {
+            adjacency[fill[result[i]]++] = (unsigned int) (i / 3);
+        }
+
+        // independent collapses only: a vertex whose triangles changed waits for the next pass
+        std::iota(remap.begin(), remap.end(), 0);
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t removed = 0, needed = (result.size() - targetIndexCount + 2) / 3;
+        size_t collapses = 0;
+        for (const Collapse& c : candidates) {
+            if (c.error > limit || removed >= needed) {
+                break;
+            }
+            if (touched[c.from] || touched[c.to]) {
+                continue;
+            }
+            bool flips = false;
+            size_t shared = 0;
+            for (unsigned int a = offsets[c.from]; a < offsets[c.from + 1] && !flips; ++a) {
+                const unsigned int* triangle = &result[adjacency[a] * 3];
+                if (triangle[0] == c.to || triangle[1] == c.to || triangle[2] == c.to) {
+                    ++shared;
+                    continue;
+                }
+                glm::vec3 before[3], after[3];
+                for (int k = 0; k < 3; ++k) {
+                    before[k] = positions[triangle[k]];
+                    after[k] = triangle[k] == c.from ? positions[c.to] : before[k];
+                }
+                glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+                flips = glm::dot(n0, n1) <= 0.0f;
+            }
+            if (flips) {
+                continue;
+            }
+            remap[c.from] = c.to;
+            quadrics[c.to].add(quadrics[c.from]);
+            for (unsigned int a = offsets[c.from]; a < offsets[c.from + 1]; ++a) {
+                const unsigned int* triangle = &result[adjacency[a] * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+            }
+            worst = std::max(worst, c.error);
+            removed += shared;
+            ++collapses;
+        }
+        if (collapses == 0) {
+            break;
+        }
+
+        // move the collapsed vertices and drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t t = 0; t < triangleCount; ++t) {
+            unsigned int a = remap[result[t * 3]], b = remap[result[t * 3 + 1]], c = remap[result[t * 3 + 2]];
+            if (a == b || b == c || a == c) {
+                continue;
+            }
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (error) {
+        *error = (float) std::sqrt(worst);
+    }
+    return result;
+}
+
+// The error of drawing LOD level of a mesh whose LOD i + 1 has the accumulated error
+// lodErrors[i]. LOD 0 and meshes without LODs have none, levels past the last LOD draw the last.
+float lodError(const std::vector<float>& lodErrors, int level) {
+    return level <= 0 || lodErrors.empty() ? 0.0f : lodErrors[std::min<size_t>(level, lodErrors.size()) - 1];
+}
+
+// The error of a model at LOD level, the largest of its meshes'. Meshes is any range of objects
+// with a LodError(int) like Mesh, meshes with fewer LODs count with their last one.
+template <typename Meshes>
+float largestLodError(const Meshes& meshes, int level) {
+    float error = 0.0f;
+    for (const auto& mesh : meshes) {
+        error = std::max(error, mesh.LodError(level));
+    }
+    return error;
+}
+
+}
+
+#endif //PROJECT_BASE_MESHSIMPLIFIER_H
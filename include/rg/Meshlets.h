@@ -0,0 +1,303 @@
+#ifndef PROJECT_BASE_MESHLETS_H
+#define PROJECT_BASE_MESHLETS_H
+
+#include <glm/glm.hpp>
+#include <rg/VertexPacking.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace rg {
+
+// Meshlets: runs of at most MAX_VERTICES distinct vertices and MAX_TRIANGLES triangles, each with
+// a bounding sphere and a cone around its triangle normals. They are cut from the index buffer in
+// its existing order, after optimizeVertexCache that keeps neighbouring triangles together, so a
+// meshlet is a contiguous index range and visible neighbours merge into one draw range again.
+// Culling runs on the CPU over four meshlets at a time:
+//   frustum  the sphere is outside one of the six planes
+//   cone     every triangle faces away from the camera (Shirman, Tarini: the cone's half angle
+//            alpha and the sphere give dot(center - camera, axis) >= sin(alpha) |center - camera| + radius)
+// Everything is in model space; MeshletCuller takes the planes and the camera from the caller.
+
+struct MeshletStats {
+    size_t meshlets = 0;
+    size_t frustumCulled = 0;
+    size_t coneCulled = 0;
+    size_t triangles = 0;
+    size_t trianglesDrawn = 0;
+    size_t ranges = 0;
+
+    void add(const MeshletStats& other) {
+        meshlets += other.meshlets;
+        frustumCulled += other.frustumCulled;
+        coneCulled += other.coneCulled;
+        triangles += other.triangles;
+        trianglesDrawn += other.trianglesDrawn;
+        ranges += other.ranges;
+    }
+};
+
+// the view in model space: normalized frustum planes pointing inwards and the camera position
+struct MeshletView {
+    glm::vec4 planes[6];
+    glm::vec3 camera;
+
+    // planes of a combined projection * view * model matrix (Gribb, Hartmann)
+    static MeshletView fromMatrix(const glm::mat4& m, const glm::vec3& modelSpaceCamera) {
+        MeshletView view;
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; ++i) {
+            row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+        }
+        view.planes[0] = row[3] + row[0];
+        view.planes[1] = row[3] - row[0];
+        view.planes[2] = row[3] + row[1];
+        view.planes[3] = row[3] - row[1];
+        view.planes[4] = row[3] + row[2];
+        view.planes[5] = row[3] - row[2];
+        for (glm::vec4& plane : view.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        view.camera = modelSpaceCamera;
+        return view;
+    }
+};
+
+class MeshletSet {
+public:
+    static const unsigned int MAX_VERTICES = 64;
+    static const unsigned int MAX_TRIANGLES = 124;
+
+    // ranges are the mesh's 16-bit index ranges; a meshlet never crosses one, so it keeps its
+    // range's base vertex
+    void build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+               const std::vector<IndexRange>& ranges) {
+        clear();
+        std::vector<unsigned int> seen(positions.size(), ~0u);
+        for (const IndexRange& range : ranges) {
+            unsigned int first = range.first;
+            unsigned int end = range.first + range.count;
+            while (first < end) {
+                unsigned int meshlet = (unsigned int) m_First.size();
+                unsigned int vertices = 0;
+                unsigned int last = first;
+                while (last < end && (last - first) / 3 < MAX_TRIANGLES) {
+                    unsigned int added = 0;
+                    for (int k = 0; k < 3; ++k) {
+                        if (seen[indices[last + k]] != meshlet) {
+                            ++added;
+                        }
+                    }
+                    if (vertices + added > MAX_VERTICES) {
+                        break;
+                    }
+                    for (int k = 0; k < 3; ++k) {
+                        if (seen[indices[last + k]] != meshlet) {
+                            seen[indices[last + k]] = meshlet;
+                        }
+                    }
+                    vertices += added;
+                    last += 3;
+                }
+                addMeshlet(positions, indices, first, last, range.baseVertex);
+                first = last;
+            }
+        }
+        // pad to a multiple of four with meshlets that are always culled
+        while (m_CenterX.size() % 4 != 0) {
+            m_CenterX.push_back(0.0f);
+            m_CenterY.push_back(0.0f);
+            m_CenterZ.push_back(0.0f);
+            m_Radius.push_back(-1e30f);
+            m_AxisX.push_back(0.0f);
+            m_AxisY.push_back(0.0f);
+            m_AxisZ.push_back(0.0f);
+            m_ConeSin.push_back(1.0f);
+        }
+    }
+
+    void clear() {
+        m_CenterX.clear(); m_CenterY.clear(); m_CenterZ.clear(); m_Radius.clear();
+        m_AxisX.clear(); m_AxisY.clear(); m_AxisZ.clear(); m_ConeSin.clear();
+        m_First.clear(); m_Count.clear(); m_BaseVertex.clear();
+    }
+
+    size_t count() const {
+        return m_First.size();
+    }
+
+    bool empty() const {
+        return m_First.empty();
+    }
+
+    // visible index ranges, neighbouring meshlets joined; simd false runs the scalar reference
+    void cull(const MeshletView& view, std::vector<IndexRange>& visible, MeshletStats& stats, bool simd = true) const {
+        m_Visible.assign(m_CenterX.size(), 0);
+        size_t frustumCulled = 0;
+#if defined(__SSE2__)
+        if (simd) {
+            frustumCulled = cullSimd(view);
+        } else {
+            frustumCulled = cullScalar(view);
+        }
+#else
+        (void) simd;
+        frustumCulled = cullScalar(view);
+#endif
+        visible.clear();
+        size_t drawn = 0, triangles = 0, coneCulled = 0;
+        for (size_t i = 0; i < m_First.size(); ++i) {
+            triangles += m_Count[i] / 3;
+            if (m_Visible[i] != 1) {
+                coneCulled += m_Visible[i] == 2;
+                continue;
+            }
+            drawn += m_Count[i] / 3;
+            if (!visible.empty() && visible.back().first + visible.back().count == m_First[i]
+                && visible.back().baseVertex == m_BaseVertex[i]) {
+                visible.back().count += m_Count[i];
+            } else {
+                visible.push_back(IndexRange{m_First[i], m_Count[i], m_BaseVertex[i]});
+            }
+        }
+        stats.meshlets += m_First.size();
+        stats.frustumCulled += frustumCulled;
+        stats.coneCulled += coneCulled;
+        stats.triangles += triangles;
+        stats.trianglesDrawn += drawn;
+        stats.ranges += visible.size();
+    }
+
+private:
+    void addMeshlet(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                    unsigned int first, unsigned int last, unsigned int baseVertex) {
+        glm::vec3 lo(1e30f), hi(-1e30f), normalSum(0.0f);
+        std::vector<glm::vec3> normals;
+        normals.reserve((last - first) / 3);
+        for (unsigned int i = first; i < last; i += 3) {
+            const glm::vec3& a = positions[indices[i]];
+            const glm::vec3& b = positions[indices[i + 1]];
+            const glm::vec3& c = positions[indices[i + 2]];
+            lo = glm::min(lo, glm::min(a, glm::min(b, c)));
+            hi = glm::max(hi, glm::max(a, glm::max(b, c)));
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float length = glm::length(n);
+            if (length > 0.0f) {
+                normals.push_back(n / length);
+                normalSum += n / length;
+            }
+        }
+        glm::vec3 center = (lo + hi) * 0.5f;
+        float radius = 0.0f;
+        for (unsigned int i = first; i < last; ++i) {
+            radius = std::max(radius, glm::length(positions[indices[i]] - center));
+        }
+
+        // half angle of the cone; past 90 degrees nothing can be back-facing as a whole
+        glm::vec3 axis(0.0f);
+        float sinAlpha = 1.0f;
+        float axisLength = glm::length(normalSum);
+        if (axisLength > 0.0f) {
+            axis = normalSum / axisLength;
+            float minCos = 1.0f;
+            for (const glm::vec3& n : normals) {
+                minCos = std::min(minCos, glm::dot(n, axis));
+            }
+            if (minCos > 0.0f) {
+                sinAlpha = std::sqrt(1.0f - minCos * minCos);
+            }
+        }
+
+        m_CenterX.push_back(center.x);
+        m_CenterY.push_back(center.y);
+        m_CenterZ.push_back(center.z);
+        m_Radius.push_back(radius);
+        m_AxisX.push_back(axis.x);
+        m_AxisY.push_back(axis.y);
+        m_AxisZ.push_back(axis.z);
+        m_ConeSin.push_back(sinAlpha);
+        m_First.push_back(first);
+        m_Count.push_back(last - first);
+        m_BaseVertex.push_back(baseVertex);
+    }
+
+    // m_Visible: 1 drawn, 0 outside the frustum, 2 facing away; returns the frustum count
+    size_t cullScalar(const MeshletView& view) const {
+        size_t frustumCulled = 0;
+        for (size_t i = 0; i < m_First.size(); ++i) {
+            glm::vec3 center(m_CenterX[i], m_CenterY[i], m_CenterZ[i]);
+            bool inside = true;
+            for (const glm::vec4& plane : view.planes) {
+                inside = inside && glm::dot(glm::vec3(plane), center) + plane.w >= -m_Radius[i];
+            }
+            if (!inside) {
+                ++frustumCulled;
+                continue;
+            }
+            glm::vec3 toCenter = center - view.camera;
+            glm::vec3 axis(m_AxisX[i], m_AxisY[i], m_AxisZ[i]);
+            bool away = glm::dot(toCenter, axis) >= m_ConeSin[i] * glm::length(toCenter) + m_Radius[i];
+            m_Visible[i] = away ? 2 : 1;
+        }
+        return frustumCulled;
+    }
+
+#if defined(__SSE2__)
+    size_t cullSimd(const MeshletView& view) const {
+        size_t frustumCulled = 0;
+        const __m128 cameraX = _mm_set1_ps(view.camera.x);
+        const __m128 cameraY = _mm_set1_ps(view.camera.y);
+        const __m128 cameraZ = _mm_set1_ps(view.camera.z);
+        for (size_t i = 0; i < m_CenterX.size(); i += 4) {
+            __m128 x = _mm_loadu_ps(&m_CenterX[i]);
+            __m128 y = _mm_loadu_ps(&m_CenterY[i]);
+            __m128 z = _mm_loadu_ps(&m_CenterZ[i]);
+            __m128 radius = _mm_loadu_ps(&m_Radius[i]);
+            __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (const glm::vec4& plane : view.planes) {
+                __m128 distance = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+                        _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+            }
+
+            __m128 dx = _mm_sub_ps(x, cameraX);
+            __m128 dy = _mm_sub_ps(y, cameraY);
+            __m128 dz = _mm_sub_ps(z, cameraZ);
+            __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+            __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&m_AxisX[i])), _mm_mul_ps(dy, _mm_loadu_ps(&m_AxisY[i]))),
+                                      _mm_mul_ps(dz, _mm_loadu_ps(&m_AxisZ[i])));
+            __m128 away = _mm_cmpge_ps(along, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&m_ConeSin[i]), distance), radius));
+
+            int insideMask = _mm_movemask_ps(inside);
+            int awayMask = _mm_movemask_ps(away);
+            for (int k = 0; k < 4 && i + k < m_First.size(); ++k) {
+                if (!(insideMask & (1 << k))) {
+                    ++frustumCulled;
+                } else {
+                    m_Visible[i + k] = (awayMask & (1 << k)) ? 2 : 1;
+                }
+            }
+        }
+        return frustumCulled;
+    }
+#endif
+
+    // structure of arrays for the SIMD loop, padded to a multiple of four
+    std::vector<float> m_CenterX, m_CenterY, m_CenterZ, m_Radius;
+    std::vector<float> m_AxisX, m_AxisY, m_AxisZ, m_ConeSin;
+    std::vector<unsigned int> m_First, m_Count, m_BaseVertex;
+    mutable std::vector<char> m_Visible;
+};
+
+}
+
+#endif //PROJECT_BASE_MESHLETS_H
@@ -0,0 +1,542 @@
+#ifndef PROJECT_BASE_MIPSTREAMING_H
+#define PROJECT_BASE_MIPSTREAMING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <rg/GpuMemory.h>
+#include <rg/Hash.h>
+#include <stb_image.h>
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// A mip chain baked to a file in the layout glTexImage2D takes: for every face all levels from
+// the largest down, then the next face. rg::CubemapImporter's cache files are one, the 2D
+// textures rg::MipStreaming loads are baked to resources/mip_cache as another.
+struct BakedMips {
+    std::string file;
+    GLenum target = GL_TEXTURE_2D;          // or GL_TEXTURE_CUBE_MAP, six faces
+    int width = 0;
+    int height = 0;
+    int levels = 0;
+    GLenum internalFormat = GL_RGBA8;
+    GLenum format = GL_RGBA;
+    GLenum type = GL_UNSIGNED_BYTE;
+    size_t texelBytes = 4;                  // in the file
+    size_t residentTexelBytes = 4;          // in GPU memory, RGB is padded to 4 components
+    GLint wrap = GL_REPEAT;
+    size_t offset = 0;                      // of the first level of the first face, past the header
+
+    int faces() const {
+        return target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+    }
+
+    int levelWidth(int level) const {
+        return std::max(width >> level, 1);
+    }
+    int levelHeight(int level) const {
+        return std::max(height >> level, 1);
+    }
+
+    size_t levelBytes(int level) const {
+        return (size_t) levelWidth(level) * levelHeight(level) * texelBytes;
+    }
+
+    size_t offsetOf(int face, int level) const {
+        size_t faceBytes = 0, before = 0;
+        for (int l = 0; l < levels; ++l) {
+            if (l == level) {
+                before = faceBytes;
+            }
+            faceBytes += levelBytes(l);
+        }
+        return offset + faceBytes * face + before;
+    }
+
+    // GPU bytes with every level from first down resident
+    size_t residentBytes(int first) const {
+        return textureBytes(levelWidth(first), levelHeight(first), residentTexelBytes, levels - first, faces());
+    }
+};
+
+// Mip streaming for large textures. A streamed texture starts with only its small levels, the
+// tail up to TAIL_SIZE texels, and GL_TEXTURE_BASE_LEVEL on the finest of them; the levels above
+// are left unspecified, which GL allows below the base level, so they take no memory.
+//
+// What the view needs comes from a feedback pass: every FEEDBACK_INTERVAL frames the scene is
+// drawn at 1/FEEDBACK_DIVISOR of the screen size with mip_feedback.fs, which writes the
+// stream's id and the level the pixel would sample at full resolution into an RG8 target. The
+// target is read into one of READBACK_LATENCY pixel pack buffers behind a fence and mapped a
+// few frames later, when the fence has passed, so the CPU never waits for the GPU.
+//
+// update() then loads one level finer per frame for every texture that was asked for a finer
+// level than it has, reading it from the baked file, up to UPLOAD_BYTES_PER_FRAME; a level that
+// no feedback asked for in KEEP_FRAMES frames is respecified empty and the base level moves
+// back up. Streamed textures are tracked in rg::GpuMemory at their resident size and are not
+// evictable there, the streaming already keeps them at what the view needs.
+class MipStreaming {
+public:
+    static const int FEEDBACK_DIVISOR = 8;
+    static const int FEEDBACK_INTERVAL = 4;
+    static const int READBACK_LATENCY = 3;
+    static const int TAIL_SIZE = 64;
+    static const int KEEP_FRAMES = 240;
+    static const size_t UPLOAD_BYTES_PER_FRAME = 8 << 20;
+
+    struct Stats {
+        size_t readbacks = 0;
+        size_t levelsLoaded = 0;
+        size_t levelsDropped = 0;
+        size_t bytesRead = 0;
+    };
+
+    MipStreaming(int width, int height)
+        : m_Width(std::max(width / FEEDBACK_DIVISOR, 1))
+        , m_Height(std::max(height / FEEDBACK_DIVISOR, 1)) {
+        glGenFramebuffers(1, &m_Framebuffer);
+        glGenTextures(1, &m_Target);
+        glGenRenderbuffers(1, &m_Depth);
+        glBindTexture(GL_TEXTURE_2D, m_Target);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, m_Width, m_Height, 0, GL_RG, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_Depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_Width, m_Height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_Target, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_Depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::MIP_STREAMING::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        size_t readbackBytes = (size_t) m_Width * m_Height * 2;
+        glGenBuffers(READBACK_LATENCY, m_Readbacks);
+        for (GLuint buffer : m_Readbacks) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, readbackBytes, nullptr, GL_STREAM_READ);
+            GpuMemory::instance().track(GpuMemory::BUFFER, buffer, readbackBytes, "mip feedback");
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        GpuMemory::instance().track(GpuMemory::TEXTURE, m_Target, textureBytes(m_Width, m_Height, 2), "mip feedback");
+        GpuMemory::instance().track(GpuMemory::RENDERBUFFER, m_Depth, textureBytes(m_Width, m_Height, 4), "mip feedback");
+    }
+
+    ~MipStreaming() {
+        GpuMemory& memory = GpuMemory::instance();
+        for (int i = 0; i < READBACK_LATENCY; ++i) {
+            if (m_Fences[i]) {
+                glDeleteSync(m_Fences[i]);
+            }
+            memory.forget(GpuMemory::BUFFER, m_Readbacks[i]);
+        }
+        glDeleteBuffers(READBACK_LATENCY, m_Readbacks);
+        memory.forget(GpuMemory::TEXTURE, m_Target);
+        memory.forget(GpuMemory::RENDERBUFFER, m_Depth);
+        glDeleteRenderbuffers(1, &m_Depth);
+        glDeleteTextures(1, &m_Target);
+        glDeleteFramebuffers(1, &m_Framebuffer);
+        for (const Stream& stream : m_Streams) {
+            if (stream.owned) {
+                memory.forget(GpuMemory::TEXTURE, stream.texture);
+                glDeleteTextures(1, &stream.texture);
+            }
+        }
+    }
+
+    MipStreaming(const MipStreaming&) = delete;
+    MipStreaming& operator=(const MipStreaming&) = delete;
+
+    // the first level of the tail that is always resident
+    static int tailLevel(int width, int height) {
+        int level = 0;
+        while (std::max(width >> level, height >> level) > TAIL_SIZE) {
+            ++level;
+        }
+        return level;
+    }
+
+    // An image file as a streamed 2D texture, baked to resources/mip_cache on first use; 0 if
+    // it can't be read. The texture belongs to the streaming and lives as long as it does.
+    GLuint load(const std::string& path, bool srgb, bool flip) {
+        BakedMips mips;
+        if (!bake(path, flip, mips)) {
+            return 0;
+        }
+        if (srgb && mips.format == GL_RGB)
+            mips.internalFormat = GL_SRGB8;
+        else if (srgb && mips.format == GL_RGBA)
+            mips.internalFormat = GL_SRGB8_ALPHA8;
+        int tail = tailLevel(mips.width, mips.height);
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, mips.wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, mips.wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mips.levels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        Stream& stream = addStream(texture, mips, mips.levels, "streamed textures");
+        stream.owned = true;
+        for (int level = mips.levels - 1; level >= tail; --level) {
+            loadLevel(stream, level);
+        }
+        return texture;
+    }
+
+    // A texture that already has the levels from first down, the rest come from mips.file. It
+    // stays the caller's, who deletes it after the streaming is gone.
+    void add(GLuint texture, const BakedMips& mips, int first, const std::string& owner) {
+        addStream(texture, mips, first, owner);
+    }
+
+    bool streamed(GLuint texture) const {
+        return find(texture) >= 0;
+    }
+
+    // Binds the feedback target when a feedback pass is due this frame and a readback buffer is
+    // free; draw the scene with mip_feedback.fs and streamTo() per draw, then endFeedback().
+    bool beginFeedback() {
+        if (m_Frame % FEEDBACK_INTERVAL != 0 || m_Fences[m_Next]) {
+            return false;
+        }
+        glGetIntegerv(GL_VIEWPORT, m_SavedViewport);
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, m_SavedClearColor);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+        glViewport(0, 0, m_Width, m_Height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        return true;
+    }
+
+    // what the next feedback draws request; a texture that isn't streamed, or 0, only occludes
+    void streamTo(Shader& shader, GLuint texture) const {
+        int index = find(texture);
+        shader.setFloat("streamId", index >= 0 ? (float) (index + 1) : 0.0f);
+        if (index >= 0) {
+            const BakedMips& mips = m_Streams[index].mips;
+            shader.setVec2("textureSize0", glm::vec2(mips.width, mips.height));
+        }
+        // derivatives in the feedback target span FEEDBACK_DIVISOR screen pixels
+        shader.setFloat("lodBias", std::log2((float) FEEDBACK_DIVISOR));
+    }
+
+    void endFeedback(GLuint target) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_Readbacks[m_Next]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, m_Width, m_Height, GL_RG, GL_UNSIGNED_BYTE, nullptr);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        m_Fences[m_Next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_Next = (m_Next + 1) % READBACK_LATENCY;
+        glViewport(m_SavedViewport[0], m_SavedViewport[1], m_SavedViewport[2], m_SavedViewport[3]);
+        glClearColor(m_SavedClearColor[0], m_SavedClearColor[1], m_SavedClearColor[2], m_SavedClearColor[3]);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+
+    // once per frame: takes in finished readbacks, then loads and drops levels
+    void update() {
+        collect();
+        size_t uploaded = 0;
+        for (Stream& stream : m_Streams) {
+            if (stream.resident > 0 && wanted(stream, stream.resident - 1) && uploaded < UPLOAD_BYTES_PER_FRAME) {
+                uploaded += loadLevel(stream, stream.resident - 1);
+            } else if (stream.resident < stream.tail && !wanted(stream, stream.resident)) {
+                dropLevel(stream);
+            }
+        }
+        ++m_Frame;
+    }
+
+    size_t residentBytes() const {
+        size_t bytes = 0;
+        for (const Stream& stream : m_Streams) {
+            bytes += stream.mips.residentBytes(stream.resident);
+        }
+        return bytes;
+    }
+
+    // what the streamed textures would take with every level resident
+    size_t fullBytes() const {
+        size_t bytes = 0;
+        for (const Stream& stream : m_Streams) {
+            bytes += stream.mips.residentBytes(0);
+        }
+        return bytes;
+    }
+
+    size_t streamCount() const {
+        return m_Streams.size();
+    }
+    // finest level resident of the texture, -1 if it isn't streamed
+    int residentLevel(GLuint texture) const {
+        int index = find(texture);
+        return index >= 0 ? m_Streams[index].resident : -1;
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x50494d52; // "RMIP"
+    static const uint32_t VERSION = 1;
+
+    struct Header {
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+        int32_t width = 0;
+        int32_t height = 0;
+        int32_t channels = 0;
+        int32_t levels = 0;
+        uint64_t bytes = 0;
+    };
+
+    struct Stream {
+        GLuint texture = 0;
+        BakedMips mips;
+        int resident = 0;                   // finest level uploaded, the base level
+        int tail = 0;                       // this level and the smaller ones are never dropped
+        bool owned = false;
+        std::string owner;
+        std::vector<uint64_t> lastWanted;   // per level, frame of the last feedback that asked for it
+    };
+
+    Stream& addStream(GLuint texture, const BakedMips& mips, int first, const std::string& owner) {
+        Stream stream;
+        stream.texture = texture;
+        stream.mips = mips;
+        stream.resident = first;
+        stream.tail = tailLevel(mips.width, mips.height);
+        stream.owner = owner;
+        // nothing asked for the finer levels yet
+        stream.lastWanted.assign(mips.levels, 0);
+        m_Streams.push_back(stream);
+        GpuMemory::instance().track(GpuMemory::TEXTURE, texture, mips.residentBytes(first), owner);
+        return m_Streams.back();
+    }
+
+    int find(GLuint texture) const {
+        for (size_t i = 0; i < m_Streams.size(); ++i) {
+            if (m_Streams[i].texture == texture) {
+                return (int) i;
+            }
+        }
+        return -1;
+    }
+
+    bool wanted(const Stream& stream, int level) const {
+        return stream.lastWanted[level] > 0 && stream.lastWanted[level] + KEEP_FRAMES >= m_Frame;
+    }
+
+    // the oldest readback whose fence has passed; the finest level every stream was asked for
+    void collect() {
+        int oldest = (m_Next + READBACK_LATENCY - pendingReadbacks()) % READBACK_LATENCY;
+        if (!m_Fences[oldest]) {
+            return;
+        }
+        GLenum status = glClientWaitSync(m_Fences[oldest], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            return;
+        }
+        glDeleteSync(m_Fences[oldest]);
+        m_Fences[oldest] = 0;
+        ++m_Stats.readbacks;
+
+        std::vector<int> finest(m_Streams.size(), INT32_MAX);
+        size_t bytes = (size_t) m_Width * m_Height * 2;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_Readbacks[oldest]);
+        const unsigned char* pixels = (const unsigned char*) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes,
+                                                                              GL_MAP_READ_BIT);
+        if (pixels) {
+            for (size_t i = 0; i < bytes; i += 2) {
+                size_t stream = pixels[i];
+                if (stream > 0 && stream <= finest.size()) {
+                    finest[stream - 1] = std::min(finest[stream - 1], (int) pixels[i + 1]);
+                }
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        for (size_t i = 0; i < m_Streams.size(); ++i) {
+            Stream& stream = m_Streams[i];
+            for (int level = std::max(finest[i], 0); level < stream.tail; ++level) {
+                stream.lastWanted[level] = m_Frame;
+            }
+        }
+    }
+
+    // readbacks in flight; they are issued and collected in order, so they end at m_Next
+    int pendingReadbacks() const {
+        int pending = 0;
+        for (GLsync fence : m_Fences) {
+            pending += fence != 0;
+        }
+        return pending;
+    }
+
+    // reads one level of every face from the baked file; returns the bytes uploaded
+    size_t loadLevel(Stream& stream, int level) {
+        const BakedMips& mips = stream.mips;
+        std::ifstream in(mips.file, std::ios::binary);
+        std::vector<unsigned char> data(mips.levelBytes(level));
+        glBindTexture(mips.target, stream.texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int face = 0; face < mips.faces(); ++face) {
+            in.seekg((std::streamoff) mips.offsetOf(face, level));
+            in.read(reinterpret_cast<char*>(data.data()), data.size());
+            if (!in) {
+                std::cout << "ERROR::MIP_STREAMING::CANNOT_READ " << mips.file << " level " << level << std::endl;
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                glBindTexture(mips.target, 0);
+                // the texture keeps what it has, the level isn't tried again
+                stream.lastWanted.assign(mips.levels, 0);
+                stream.tail = stream.resident;
+                return 0;
+            }
+            GLenum target = mips.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : mips.target;
+            glTexImage2D(target, level, mips.internalFormat, mips.levelWidth(level), mips.levelHeight(level), 0,
+                         mips.format, mips.type, data.data());
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(mips.target, GL_TEXTURE_BASE_LEVEL, level);
+        glBindTexture(mips.target, 0);
+        stream.resident = std::min(stream.resident, level);
+        GpuMemory::instance().track(GpuMemory::TEXTURE, stream.texture, mips.residentBytes(stream.resident), stream.owner);
+        ++m_Stats.levelsLoaded;
+        m_Stats.bytesRead += data.size() * mips.faces();
+        return data.size() * mips.faces();
+    }
+
+    // a zero sized image gives the finest level's memory back; it is below the base level, so
+    // the texture stays complete
+    void dropLevel(Stream& stream) {
+        const BakedMips& mips = stream.mips;
+        int level = stream.resident;
+        glBindTexture(mips.target, stream.texture);
+        glTexParameteri(mips.target, GL_TEXTURE_BASE_LEVEL, level + 1);
+        for (int face = 0; face < mips.faces(); ++face) {
+            GLenum target = mips.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : mips.target;
+            glTexImage2D(target, level, mips.internalFormat, 0, 0, 0, mips.format, mips.type, nullptr);
+        }
+        glBindTexture(mips.target, 0);
+        stream.resident = level + 1;
+        GpuMemory::instance().track(GpuMemory::TEXTURE, stream.texture, mips.residentBytes(stream.resident), stream.owner);
+        ++m_Stats.levelsDropped;
+    }
+
+    // the file's mip chain, 2x2 box filtered like rg::CubemapImporter's, written once per file
+    bool bake(const std::string& path, bool flip, BakedMips& mips) {
+        // a local copy, taking the address of the static constant would need a definition
+        uint32_t version = VERSION;
+        uint64_t hash = hashFileStamp(path, hashString("mips", hashBytes(&version, sizeof(version))));
+        hash = hashBytes(&flip, sizeof(flip), hash);
+        mips.file = m_Directory + "/" + hashToHex(hash) + ".mips";
+        mips.offset = sizeof(Header);
+
+        Header header;
+        std::ifstream in(mips.file, std::ios::binary);
+        if (in) {
+            in.read(reinterpret_cast<char*>(&header), sizeof(header));
+        }
+        if (!in || header.magic != MAGIC || header.version != VERSION || header.width <= 0 || header.height <= 0
+            || header.channels < 1 || header.channels > 4 || header.levels != mipLevels(header.width, header.height)) {
+            if (!write(path, flip, mips.file, header)) {
+                return false;
+            }
+        }
+        mips.width = header.width;
+        mips.height = header.height;
+        mips.levels = header.levels;
+        const GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+        const GLenum internalFormats[4] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+        mips.format = formats[header.channels - 1];
+        mips.internalFormat = internalFormats[header.channels - 1];
+        mips.texelBytes = (size_t) header.channels;
+        mips.residentTexelBytes = header.channels == 3 ? 4 : (size_t) header.channels;
+        return true;
+    }
+
+    bool write(const std::string& path, bool flip, const std::string& file, Header& header) const {
+        int width, height, channels;
+        stbi_set_flip_vertically_on_load(flip);
+        unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 0);
+        if (!data) {
+            std::cout << "ERROR::MIP_STREAMING::LOAD_FAILED " << path << std::endl;
+            return false;
+        }
+        std::vector<unsigned char> level(data, data + (size_t) width * height * channels);
+        stbi_image_free(data);
+        header.width = width;
+        header.height = height;
+        header.channels = channels;
+        header.levels = mipLevels(width, height);
+
+        std::vector<unsigned char> chain;
+        for (int l = 0; l < header.levels; ++l) {
+            chain.insert(chain.end(), level.begin(), level.end());
+            if (l + 1 < header.levels) {
+                level = downsample(level, std::max(width >> l, 1), std::max(height >> l, 1), channels);
+            }
+        }
+        header.bytes = chain.size();
+        mkdir(m_Directory.c_str(), 0755);
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "ERROR::MIP_STREAMING::CANNOT_WRITE " << file << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(chain.data()), chain.size());
+        return true;
+    }
+
+    static std::vector<unsigned char> downsample(const std::vector<unsigned char>& image, int width, int height,
+                                                 int channels) {
+        int halfWidth = std::max(width / 2, 1), halfHeight = std::max(height / 2, 1);
+        std::vector<unsigned char> half((size_t) halfWidth * halfHeight * channels);
+        for (int y = 0; y < halfHeight; ++y) {
+            int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            for (int x = 0; x < halfWidth; ++x) {
+                int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                const unsigned char* p00 = &image[((size_t) y0 * width + x0) * channels];
+                const unsigned char* p10 = &image[((size_t) y0 * width + x1) * channels];
+                const unsigned char* p01 = &image[((size_t) y1 * width + x0) * channels];
+                const unsigned char* p11 = &image[((size_t) y1 * width + x1) * channels];
+                for (int c = 0; c < channels; ++c) {
+                    half[((size_t) y * halfWidth + x) * channels + c] = (unsigned char) ((p00[c] + p10[c] + p01[c] + p11[c] + 2) / 4);
+                }
+            }
+        }
+        return half;
+    }
+
+    std::vector<Stream> m_Streams;
+    int m_Width, m_Height;
+    GLuint m_Framebuffer = 0;
+    GLuint m_Target = 0;
+    GLuint m_Depth = 0;
+    GLuint m_Readbacks[READBACK_LATENCY] = {};
+    GLsync m_Fences[READBACK_LATENCY] = {};
+    int m_Next = 0;
+    GLint m_SavedViewport[4] = {};
+    GLfloat m_SavedClearColor[4] = {};
+    uint64_t m_Frame = 1;
+    std::string m_Directory = "resources/mip_cache";
+    Stats m_Stats;
+};
+
+}
+
+#endif //PROJECT_BASE_MIPSTREAMING_H
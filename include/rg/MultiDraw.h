@@ -0,0 +1,249 @@
+#ifndef PROJECT_BASE_MULTIDRAW_H
+#define PROJECT_BASE_MULTIDRAW_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+#include <rg/GLExtensions.h>
+#include <rg/GpuMemory.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace rg {
+
+// Every mesh of every added model as one command in an indirect buffer, drawn with a single
+// glMultiDrawElementsIndirect per arena VAO, index type and (for colour passes) texture set.
+// Shaders are compiled with MULTI_DRAW and read their model matrix and packed-position
+// transform from the drawData buffer texture, see lib/vertex.glsl. gl_DrawID needs GL 4.6
+// or ARB_shader_draw_parameters, so the draw's slot comes from an instanced attribute
+// instead: every command's baseInstance is its slot and attribute 5 reads 0, 1, 2, ...
+// with divisor 1, which the base instance offsets. Meshes drawing from texture arrays share a
+// group when they share the arrays and read their layers from drawData. Only available where
+// glext::multiDrawIndirect is set; callers keep Model::Draw as the fallback.
+class MultiDrawBatch {
+public:
+    static const GLuint DRAW_ID_ATTRIBUTE = 5;
+    // texels of RGBA32F per draw: the model matrix columns, position offset, position scale;
+    // the w of the last two holds the diffuse and specular layer of texture array materials
+    static const int TEXELS_PER_DRAW = 6;
+
+    // with materials false the textures are left alone and draws are only split by geometry
+    explicit MultiDrawBatch(bool materials)
+        : m_Materials(materials) {
+        glGenBuffers(1, &m_IndirectBuffer);
+        glGenBuffers(1, &m_DrawIdBuffer);
+        glGenBuffers(1, &m_DrawDataBuffer);
+        glGenTextures(1, &m_DrawDataTexture);
+    }
+
+    ~MultiDrawBatch() {
+        GpuMemory& memory = GpuMemory::instance();
+        memory.forget(GpuMemory::BUFFER, m_IndirectBuffer);
+        memory.forget(GpuMemory::BUFFER, m_DrawIdBuffer);
+        memory.forget(GpuMemory::BUFFER, m_DrawDataBuffer);
+        glDeleteBuffers(1, &m_IndirectBuffer);
+        glDeleteBuffers(1, &m_DrawIdBuffer);
+        glDeleteBuffers(1, &m_DrawDataBuffer);
+        glDeleteTextures(1, &m_DrawDataTexture);
+    }
+
+    MultiDrawBatch(const MultiDrawBatch&) = delete;
+    MultiDrawBatch& operator=(const MultiDrawBatch&) = delete;
+
+    void clear() {
+        for (auto& group : m_Groups) {
+            group.second.draws.clear();
+        }
+        m_Transforms.clear();
+        m_DrawCount = 0;
+    }
+
+    void add(Model& model, const glm::mat4& transform) {
+        uint32_t transformIndex = (uint32_t) m_Transforms.size();
+        m_Transforms.push_back(transform);
+        for (Mesh& mesh : model.meshes) {
+            std::vector<GLuint> material;
+            if (m_Materials) {
+                for (const Texture& texture : mesh.MaterialTextures()) {
+                    material.push_back(texture.id);
+                }
+            }
+            Group& group = m_Groups[GroupKey(mesh.VAO, mesh.IndexType(), material)];
+            group.mesh = &mesh;
+            size_t indexSize = mesh.IndexType() == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+            for (const IndexRange& range : mesh.IndexRanges()) {
+                Draw draw;
+                draw.command.count = range.count;
+                draw.command.instanceCount = 1;
+                draw.command.firstIndex = (GLuint) (mesh.IndexOffset() / indexSize + range.first);
+                draw.command.baseVertex = (GLint) (mesh.BaseVertex() + range.baseVertex);
+                draw.transform = transformIndex;
+                draw.mesh = &mesh;
+                group.draws.push_back(draw);
+                ++m_DrawCount;
+            }
+        }
+    }
+
+    // drawDataUnit is the texture unit for the per-draw buffer texture
+    void submit(Shader& shader, int drawDataUnit) {
+        if (m_DrawCount == 0) {
+            return;
+        }
+        // lay the groups out back to back; a command's slot is its position in the buffer
+        m_Commands.clear();
+        m_DrawData.clear();
+        m_Commands.reserve(m_DrawCount);
+        m_DrawData.reserve(m_DrawCount * TEXELS_PER_DRAW);
+        for (auto& entry : m_Groups) {
+            Group& group = entry.second;
+            group.firstCommand = m_Commands.size();
+            for (Draw& draw : group.draws) {
+                draw.command.baseInstance = (GLuint) m_Commands.size();
+                m_Commands.push_back(draw.command);
+                const glm::mat4& transform = m_Transforms[draw.transform];
+                for (int c = 0; c < 4; ++c) {
+                    m_DrawData.push_back(transform[c]);
+                }
+                glm::vec2 layers = draw.mesh->MaterialLayers();
+                m_DrawData.push_back(glm::vec4(draw.mesh->PositionOffset(), layers.x));
+                m_DrawData.push_back(glm::vec4(draw.mesh->PositionScale(), layers.y));
+            }
+        }
+        upload();
+
+        shader.setInt("drawData", drawDataUnit);
+        glActiveTexture(GL_TEXTURE0 + drawDataUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, m_DrawDataTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer);
+        TextureBindings::instance().invalidate();
+        GLuint bound = 0;
+        for (auto& entry : m_Groups) {
+            Group& group = entry.second;
+            if (group.draws.empty()) {
+                continue;
+            }
+            GLuint vao = std::get<0>(entry.first);
+            if (vao != bound) {
+                if (bound) {
+                    glDisableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+                }
+                bindDrawIds(vao);
+                bound = vao;
+            }
+            if (m_Materials) {
+                group.mesh->BindTextures(shader);
+            }
+            glMultiDrawElementsIndirect(GL_TRIANGLES, std::get<1>(entry.first),
+                                        (void*) (group.firstCommand * sizeof(Command)),
+                                        (GLsizei) group.draws.size(), 0);
+            ++m_MultiDrawCalls;
+        }
+        if (bound) {
+            glDisableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // commands recorded since clear()
+    size_t drawCount() const {
+        return m_DrawCount;
+    }
+
+    // glMultiDrawElementsIndirect calls since the last resetCallCount()
+    size_t multiDrawCalls() const {
+        return m_MultiDrawCalls;
+    }
+    void resetCallCount() {
+        m_MultiDrawCalls = 0;
+    }
+
+private:
+    // the layout glMultiDrawElementsIndirect reads
+    struct Command {
+        GLuint count = 0;
+        GLuint instanceCount = 0;
+        GLuint firstIndex = 0;
+        GLint baseVertex = 0;
+        GLuint baseInstance = 0;
+    };
+
+    struct Draw {
+        Command command;
+        uint32_t transform = 0;
+        const Mesh* mesh = nullptr;
+    };
+
+    // VAO, index type, the mesh's textures in binding order
+    typedef std::tuple<GLuint, GLenum, std::vector<GLuint>> GroupKey;
+
+    struct Group {
+        Mesh* mesh = nullptr;           // any mesh of the group, for its textures
+        std::vector<Draw> draws;
+        size_t firstCommand = 0;
+    };
+
+    void upload() {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, m_Commands.size() * sizeof(Command), m_Commands.data(), GL_STREAM_DRAW);
+        GpuMemory::instance().track(GpuMemory::BUFFER, m_IndirectBuffer, m_Commands.size() * sizeof(Command), "multi-draw");
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        glBindBuffer(GL_TEXTURE_BUFFER, m_DrawDataBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, m_DrawData.size() * sizeof(glm::vec4), m_DrawData.data(), GL_STREAM_DRAW);
+        GpuMemory::instance().track(GpuMemory::BUFFER, m_DrawDataBuffer, m_DrawData.size() * sizeof(glm::vec4),
+                                    "multi-draw");
+        glBindTexture(GL_TEXTURE_BUFFER, m_DrawDataTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_DrawDataBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        // the slot numbers only change when the batch outgrows them
+        if (m_Commands.size() > m_DrawIdCapacity) {
+            m_DrawIdCapacity = std::max(m_Commands.size(), m_DrawIdCapacity * 2);
+            std::vector<GLuint> ids(m_DrawIdCapacity);
+            for (size_t i = 0; i < ids.size(); ++i) {
+                ids[i] = (GLuint) i;
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, m_DrawIdBuffer);
+            glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+            GpuMemory::instance().track(GpuMemory::BUFFER, m_DrawIdBuffer, ids.size() * sizeof(GLuint), "multi-draw");
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+
+    // attaches the slot attribute to an arena VAO for the duration of submit()
+    void bindDrawIds(GLuint vao) {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_DrawIdBuffer);
+        glEnableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+        glVertexAttribIPointer(DRAW_ID_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*) 0);
+        glVertexAttribDivisor(DRAW_ID_ATTRIBUTE, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    bool m_Materials;
+    std::map<GroupKey, Group> m_Groups;
+    std::vector<glm::mat4> m_Transforms;
+    std::vector<Command> m_Commands;
+    std::vector<glm::vec4> m_DrawData;
+    size_t m_DrawCount = 0;
+    size_t m_MultiDrawCalls = 0;
+    size_t m_DrawIdCapacity = 0;
+    GLuint m_IndirectBuffer = 0;
+    GLuint m_DrawIdBuffer = 0;
+    GLuint m_DrawDataBuffer = 0;
+    GLuint m_DrawDataTexture = 0;
+};
+
+}
+
+#endif //PROJECT_BASE_MULTIDRAW_H
@@ -0,0 +1,314 @@
+#ifndef PROJECT_BASE_POINTSHADOWMAP_H
+#define PROJECT_BASE_POINTSHADOWMAP_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <learnopengl/shader.h>
+#include <rg/GpuMemory.h>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+struct ShadowCaster {
+    glm::vec3 center;   // world space bounding sphere
+    float radius;
+    glm::mat4 model;
+    // static casters are rendered into the cached cube and only redrawn when the light
+    // moved or a static caster's model matrix changed; a caster that moves every frame is
+    // not static, it would rebuild the cache every frame
+    bool isStatic;
+    std::function<void(Shader&)> draw;
+};
+
+// Omnidirectional shadows for one point light. The cube map stores the distance to the
+// light divided by the far plane, lib/shadows.glsl compares against it with a cube shadow
+// sampler. The six faces are drawn in one pass with a layered geometry shader, or face by
+// face for comparison.
+//
+// Static casters go into a second cube that is kept between frames. A frame then copies
+// that cube and draws only the moving casters on top, instead of drawing the whole scene
+// six times. The cached distances are measured from the light position the cube was built
+// at, so it is only reused while the light stays closer to that than the smallest depth
+// bias of lib/shadows.glsl, and while the static casters keep their model matrices. A light
+// that moved further than that since the previous frame would miss the cache on the next one
+// as well, so while it moves that fast the cube is drawn directly, without building a cache.
+class PointShadowMap {
+public:
+    PointShadowMap(int resolution, float farPlane)
+        : m_Resolution(resolution)
+        , m_Far(farPlane) {
+        glGenTextures(2, m_Cubes);
+        for (int cube = 0; cube < 2; ++cube) {
+            glBindTexture(GL_TEXTURE_CUBE_MAP, m_Cubes[cube]);
+            for (int face = 0; face < 6; ++face) {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, resolution, resolution, 0,
+                             GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+            }
+            GpuMemory::instance().track(GpuMemory::TEXTURE, m_Cubes[cube], textureBytes(resolution, resolution, 4, 1, 6),
+                                        "point shadows");
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        glGenFramebuffers(1, &m_Framebuffer);
+        glGenFramebuffers(1, &m_CopyFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_Cubes[FRAME], 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::POINT_SHADOW_MAP::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, m_CopyFramebuffer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    ~PointShadowMap() {
+        for (GLuint cube : m_Cubes) {
+            GpuMemory::instance().forget(GpuMemory::TEXTURE, cube);
+        }
+        glDeleteFramebuffers(1, &m_CopyFramebuffer);
+        glDeleteFramebuffers(1, &m_Framebuffer);
+        glDeleteTextures(2, m_Cubes);
+    }
+
+    PointShadowMap(const PointShadowMap&) = delete;
+    PointShadowMap& operator=(const PointShadowMap&) = delete;
+
+    void setCaching(bool caching) {
+        m_Caching = caching;
+        m_CacheValid = false;
+    }
+    bool caching() const {
+        return m_Caching;
+    }
+    // further than MIN_DEPTH_BIAS would shift cached shadows by more than the bias
+    void setTolerance(float distance) {
+        float limit = MIN_DEPTH_BIAS;
+        m_Tolerance = std::min(distance, limit);
+    }
+    // layered needs a shader built with shadow_point.gs and LAYERED, the other one draws
+    // the faces one by one with faceMatrix
+    void setLayered(bool layered) {
+        m_Layered = layered;
+    }
+    bool layered() const {
+        return m_Layered;
+    }
+
+    // draws the casters into the cube for lightPosition, then binds target
+    void render(const glm::vec3& lightPosition, const std::vector<ShadowCaster>& casters,
+                Shader& layeredShader, Shader& faceShader, GLuint target) {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glViewport(0, 0, m_Resolution, m_Resolution);
+        m_LightMoving = glm::length(lightPosition - m_Position) > m_Tolerance;
+        m_Position = lightPosition;
+        m_DrawnCasters = 0;
+
+        // without static casters there is nothing to keep
+        bool caching = m_Caching && std::any_of(casters.begin(), casters.end(),
+                                                [](const ShadowCaster& caster) { return caster.isStatic; });
+        bool useCache = caching && cacheMatches(lightPosition, casters);
+        m_CacheHit = useCache;
+        m_CacheRebuilt = caching && !useCache && !m_LightMoving;
+        if (m_CacheRebuilt) {
+            // the cache is built from the static casters only, the light position is stored
+            // with it so that frames close enough can reuse it
+            drawCasters(STATIC, lightPosition, casters, layeredShader, faceShader, true, false);
+            storeCacheKey(lightPosition, casters);
+            useCache = true;
+            ++m_CacheRebuilds;
+        }
+        if (useCache) {
+            copyStaticToFrame();
+            drawCasters(FRAME, lightPosition, casters, layeredShader, faceShader, false, true);
+        } else {
+            drawCasters(FRAME, lightPosition, casters, layeredShader, faceShader, true, true, true);
+        }
+
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+
+    // binds the cube to unit and sets the lib/shadows.glsl uniforms
+    void bind(Shader& shader, unsigned int unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, m_Cubes[FRAME]);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("pointShadowMap", unit);
+        shader.setVec3("pointShadowPosition", m_Position);
+        shader.setFloat("pointShadowFar", m_Far);
+    }
+
+    bool cacheHit() const {
+        return m_CacheHit;
+    }
+    bool cacheRebuilt() const {
+        return m_CacheRebuilt;
+    }
+    unsigned int cacheRebuilds() const {
+        return m_CacheRebuilds;
+    }
+    // the light moved further than the tolerance since the previous frame, so the cache is
+    // neither used nor rebuilt
+    bool lightMoving() const {
+        return m_LightMoving;
+    }
+    // casters drawn into the cube this frame, counted once per pass over the faces
+    unsigned int drawnCasters() const {
+        return m_DrawnCasters;
+    }
+
+private:
+    enum { STATIC = 0, FRAME = 1 };
+
+    struct CacheEntry {
+        glm::mat4 model;
+        float radius;
+    };
+
+    bool cacheMatches(const glm::vec3& lightPosition, const std::vector<ShadowCaster>& casters) const {
+        if (!m_CacheValid || glm::length(lightPosition - m_CachedLight) > m_Tolerance) {
+            return false;
+        }
+        size_t i = 0;
+        for (const ShadowCaster& caster : casters) {
+            if (!caster.isStatic) {
+                continue;
+            }
+            if (i == m_CachedCasters.size() || m_CachedCasters[i].model != caster.model
+                || m_CachedCasters[i].radius != caster.radius) {
+                return false;
+            }
+            ++i;
+        }
+        return i == m_CachedCasters.size();
+    }
+
+    void storeCacheKey(const glm::vec3& lightPosition, const std::vector<ShadowCaster>& casters) {
+        m_CachedLight = lightPosition;
+        m_CachedCasters.clear();
+        for (const ShadowCaster& caster : casters) {
+            if (caster.isStatic) {
+                m_CachedCasters.push_back(CacheEntry{caster.model, caster.radius});
+            }
+        }
+        m_CacheValid = true;
+    }
+
+    void copyStaticToFrame() {
+        for (int face = 0; face < 6; ++face) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, m_CopyFramebuffer);
+            glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                                   m_Cubes[STATIC], 0);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_Framebuffer);
+            attachFace(FRAME, face, GL_DRAW_FRAMEBUFFER);
+            glBlitFramebuffer(0, 0, m_Resolution, m_Resolution, 0, 0, m_Resolution, m_Resolution,
+                              GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        }
+    }
+
+    void attachFace(int cube, int face, GLenum target) {
+        if (face < 0) {
+            glFramebufferTexture(target, GL_DEPTH_ATTACHMENT, m_Cubes[cube], 0);
+        } else {
+            glFramebufferTexture2D(target, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_Cubes[cube], 0);
+        }
+    }
+
+    void faceMatrices(const glm::vec3& p, glm::mat4* matrices) const {
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, NEAR_PLANE, m_Far);
+        matrices[0] = projection * glm::lookAt(p, p + glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f));
+        matrices[1] = projection * glm::lookAt(p, p + glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f));
+        matrices[2] = projection * glm::lookAt(p, p + glm::vec3( 0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f));
+        matrices[3] = projection * glm::lookAt(p, p + glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f));
+        matrices[4] = projection * glm::lookAt(p, p + glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f));
+        matrices[5] = projection * glm::lookAt(p, p + glm::vec3( 0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f));
+    }
+
+    void drawCasters(int cube, const glm::vec3& lightPosition, const std::vector<ShadowCaster>& casters,
+                     Shader& layeredShader, Shader& faceShader, bool drawStatic, bool drawDynamic,
+                     bool clear = false) {
+        glm::mat4 matrices[6];
+        faceMatrices(lightPosition, matrices);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+        // the static cube is always drawn from scratch, the frame cube only without the cache
+        clear = clear || cube == STATIC;
+
+        Shader& shader = m_Layered ? layeredShader : faceShader;
+        shader.use();
+        shader.setVec3("lightPosition", lightPosition);
+        shader.setFloat("farPlane", m_Far);
+        if (m_Layered) {
+            for (int face = 0; face < 6; ++face) {
+                shader.setMat4("faceMatrices[" + std::to_string(face) + "]", matrices[face]);
+            }
+        }
+        int passes = m_Layered ? 1 : 6;
+        for (int pass = 0; pass < passes; ++pass) {
+            attachFace(cube, m_Layered ? -1 : pass, GL_FRAMEBUFFER);
+            if (clear) {
+                glClear(GL_DEPTH_BUFFER_BIT);
+            }
+            if (!m_Layered) {
+                shader.setMat4("faceMatrix", matrices[pass]);
+            }
+            for (const ShadowCaster& caster : casters) {
+                if ((caster.isStatic && !drawStatic) || (!caster.isStatic && !drawDynamic)) {
+                    continue;
+                }
+                // out of the light's range entirely
+                if (glm::length(caster.center - lightPosition) - caster.radius > m_Far) {
+                    continue;
+                }
+                shader.setMat4("model", caster.model);
+                caster.draw(shader);
+                if (pass == 0) {
+                    ++m_DrawnCasters;
+                }
+            }
+        }
+        // leave the frame cube attached as a whole for the next frame's blit target
+        attachFace(FRAME, -1, GL_FRAMEBUFFER);
+    }
+
+    static constexpr float NEAR_PLANE = 0.1f;
+    // the constant part of the bias PointShadow() in lib/shadows.glsl subtracts, in world units
+    static constexpr float MIN_DEPTH_BIAS = 0.05f;
+
+    int m_Resolution;
+    float m_Far;
+    GLuint m_Cubes[2] = {};
+    GLuint m_Framebuffer = 0;
+    GLuint m_CopyFramebuffer = 0;
+    glm::vec3 m_Position = glm::vec3(0.0f);
+    bool m_Layered = true;
+    bool m_Caching = true;
+    float m_Tolerance = MIN_DEPTH_BIAS;
+    bool m_CacheValid = false;
+    bool m_CacheHit = false;
+    bool m_CacheRebuilt = false;
+    bool m_LightMoving = false;
+    glm::vec3 m_CachedLight = glm::vec3(0.0f);
+    std::vector<CacheEntry> m_CachedCasters;
+    unsigned int m_CacheRebuilds = 0;
+    unsigned int m_DrawnCasters = 0;
+};
+
+}
+
+#endif //PROJECT_BASE_POINTSHADOWMAP_H
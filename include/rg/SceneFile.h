@@ -0,0 +1,682 @@
+#ifndef PROJECT_BASE_SCENEFILE_H
+#define PROJECT_BASE_SCENEFILE_H
+
+#include <glm/glm.hpp>
+#include <rg/Hash.h>
+#include <rg/SceneTransforms.h>
+
+#include <sys/stat.h>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+struct SceneModel {
+    std::string name;
+    std::string path;
+};
+
+// A node of the scene. Objects without a model only carry their children, like the pivot an
+// orbiting ship hangs from. The rotation is angle + spin * time radians around axis.
+struct SceneObject {
+    // how the renderer draws the object: the ship and the planet have passes of their own,
+    // props are drawn with the model's materials and the ship's lighting
+    enum Role { PROP, SHIP, PLANET };
+
+    std::string name;
+    std::string model;
+    std::string parent;
+    Role role = PROP;
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::vec3 axis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float angle = 0.0f;
+    float spin = 0.0f;
+    // the planet's surface texture, the model's own materials are not used for it
+    std::string texture;
+};
+
+// The renderer has one directional and one point light:
+//   directional  its direction is the anchor's position + (cos, 0, sin) of speed * time, as
+//                the planet's light has always been set
+//   point        above the anchor at a fixed world height
+// The ship's shader has always been lit with colors of its own, those are the ship* values.
+struct SceneLight {
+    enum Type { DIRECTIONAL, POINT };
+
+    std::string name;
+    Type type = POINT;
+    std::string anchor;
+    float speed = 1.0f;
+    float height = 0.0f;
+    glm::vec3 ambient = glm::vec3(0.0f);
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    glm::vec3 specular = glm::vec3(0.0f);
+    glm::vec3 attenuation = glm::vec3(1.0f, 0.0f, 0.0f);        // constant, linear, quadratic
+    glm::vec3 shipAmbient = glm::vec3(0.0f);
+    glm::vec3 shipDiffuse = glm::vec3(0.0f);
+    glm::vec3 shipSpecular = glm::vec3(0.0f);
+    glm::vec3 shipAttenuation = glm::vec3(1.0f, 0.0f, 0.0f);
+};
+
+struct ScenePost {
+    bool hdr = true;
+    bool bloom = false;
+    float exposure = 1.2f;
+    float iblIntensity = 0.6f;
+    // a sky by its name in rg::Skybox, empty keeps the current one
+    std::string sky;
+    int escortLights = 0;
+};
+
+// Everything a scene file describes. Objects become the nodes of rg::SceneTransforms in file
+// order, object i is node i, so parents always come before their children.
+struct SceneDescription {
+    std::vector<SceneModel> models;
+    std::vector<SceneObject> objects;
+    std::vector<SceneLight> lights;
+    ScenePost post;
+
+    // -1 if there is none
+    int object(const std::string& name) const {
+        for (size_t i = 0; i < objects.size(); ++i) {
+            if (objects[i].name == name) {
+                return (int) i;
+            }
+        }
+        return -1;
+    }
+
+    // the first object with the role, or -1
+    int objectWithRole(SceneObject::Role role) const {
+        for (size_t i = 0; i < objects.size(); ++i) {
+            if (objects[i].role == role) {
+                return (int) i;
+            }
+        }
+        return -1;
+    }
+
+    const SceneModel* model(const std::string& name) const {
+        for (const SceneModel& model : models) {
+            if (model.name == name) {
+                return &model;
+            }
+        }
+        return nullptr;
+    }
+
+    const SceneLight* light(SceneLight::Type type) const {
+        for (const SceneLight& light : lights) {
+            if (light.type == type) {
+                return &light;
+            }
+        }
+        return nullptr;
+    }
+
+    // the model file of an object, empty for pivots
+    std::string modelPath(size_t object) const {
+        const SceneModel* found = model(objects[object].model);
+        return found ? found->path : std::string();
+    }
+
+    // replaces the nodes of transforms with the objects at time 0
+    void build(SceneTransforms& transforms) const {
+        transforms.clear();
+        for (const SceneObject& object : objects) {
+            int parent = this->object(object.parent);
+            SceneTransforms::Node node = transforms.create(parent < 0 ? SceneTransforms::NO_PARENT
+                                                                      : (SceneTransforms::Node) parent);
+            transforms.setPosition(node, object.position);
+            transforms.setScale(node, object.scale);
+            transforms.setRotation(node, object.angle, object.axis);
+        }
+    }
+
+    // whether animate() moves the object: it or one of its parents spins
+    bool animated(size_t object) const {
+        for (int i = (int) object; i >= 0; i = this->object(objects[i].parent)) {
+            if (objects[i].spin != 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // turns the spinning objects, only those become dirty
+    void animate(SceneTransforms& transforms, float time) const {
+        for (size_t i = 0; i < objects.size(); ++i) {
+            if (objects[i].spin != 0.0f) {
+                transforms.setRotation((SceneTransforms::Node) i, objects[i].angle + objects[i].spin * time,
+                                       objects[i].axis);
+            }
+        }
+    }
+};
+
+// Scene files are text, one record per line, # starts a comment, values with spaces go in
+// double quotes, vectors are comma separated and a single number fills all three components:
+//   model  <name> <path>
+//   object <name> [model=] [parent=] [role=prop|ship|planet] [position=] [scale=] [axis=]
+//                 [angle=] [spin=] [texture=]
+//   grid   <name> model= count=x,y,z spacing=x,y,z [parent=] [position=] [scale=] [axis=]
+//                 [angle=] [spin=]       props <name>0, <name>1... on a grid from position
+//   light  <name> directional|point anchor= [speed=] [height=] [ambient=] [diffuse=] [specular=]
+//                 [attenuation=] [shipAmbient=] [shipDiffuse=] [shipSpecular=] [shipAttenuation=]
+//   post   [hdr=] [bloom=] [exposure=] [ibl=] [sky=] [escorts=]
+// A scene needs a ship and a planet with models, a texture for the planet and one light of each
+// type. load() compiles the text into a binary in resources/scene_cache, keyed by the file's
+// name, size and modification time, which later loads read instead of parsing.
+class SceneFile {
+public:
+    struct Stats {
+        bool fromCache = false;
+        double milliseconds = 0.0;
+    };
+
+    // scene is only replaced when the file is valid
+    bool load(const std::string& path, SceneDescription& scene) {
+        auto start = std::chrono::steady_clock::now();
+        m_Path = path;
+        m_Stamp = hashFileStamp(path);
+        SceneDescription loaded;
+        m_Stats.fromCache = readCompiled(cachePath(), loaded);
+        if (!m_Stats.fromCache) {
+            loaded = SceneDescription();
+            if (!parse(path, loaded) || !validate(path, loaded)) {
+                return false;
+            }
+            writeCompiled(cachePath(), loaded);
+        }
+        scene = loaded;
+        m_Stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    // the file was edited since the last load(); one stat() per call
+    bool changed() const {
+        return !m_Path.empty() && hashFileStamp(m_Path) != m_Stamp;
+    }
+
+    const std::string& path() const {
+        return m_Path;
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x4e435352; // "RSCN"
+    static const uint32_t VERSION = 1;
+    // more records than this is a broken file
+    static const uint32_t MAX_RECORDS = 1u << 20;
+    // escorts= past this is a typo, not a fleet
+    static const int MAX_ESCORT_LIGHTS = 1 << 16;
+
+    std::string cachePath() const {
+        return m_Directory + "/" + hashToHex(m_Stamp) + ".scene";
+    }
+
+    // line 0 for errors of the whole scene
+    static void error(const std::string& what, const std::string& path, int line, const std::string& detail) {
+        std::cout << "ERROR::SCENE::" << what << " " << path;
+        if (line > 0) {
+            std::cout << ":" << line;
+        }
+        std::cout << " " << detail << std::endl;
+    }
+
+    // whitespace separated, double quotes keep spaces, # outside quotes ends the line
+    static std::vector<std::string> tokenize(const std::string& line) {
+        std::vector<std::string> tokens;
+        std::string token;
+        bool quoted = false, inToken = false;
+        for (char c : line) {
+            if (c == '"') {
+                quoted = !quoted;
+                inToken = true;
+            } else if (!quoted && c == '#') {
+                break;
+            } else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+                if (inToken) {
+                    tokens.push_back(token);
+                }
+                token.clear();
+                inToken = false;
+            } else {
+                token += c;
+                inToken = true;
+            }
+        }
+        if (inToken) {
+            tokens.push_back(token);
+        }
+        return tokens;
+    }
+
+    static bool parseFloat(const std::string& text, float& value) {
+        char* end = nullptr;
+        value = std::strtof(text.c_str(), &end);
+        return !text.empty() && end && *end == '\0';
+    }
+
+    static bool parseVec3(const std::string& text, glm::vec3& value) {
+        std::vector<float> components;
+        std::stringstream stream(text);
+        std::string part;
+        while (std::getline(stream, part, ',')) {
+            float component;
+            if (!parseFloat(part, component)) {
+                return false;
+            }
+            components.push_back(component);
+        }
+        if (components.size() == 1) {
+            value = glm::vec3(components[0]);
+        } else if (components.size() == 3) {
+            value = glm::vec3(components[0], components[1], components[2]);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // the transform keys objects and grids share; false if the key is not one of them
+    static bool parseTransformKey(const std::string& key, const std::string& value, SceneObject& object, bool& valid) {
+        if (key == "model") {
+            object.model = value;
+        } else if (key == "parent") {
+            object.parent = value;
+        } else if (key == "position") {
+            valid = parseVec3(value, object.position);
+        } else if (key == "scale") {
+            valid = parseVec3(value, object.scale);
+        } else if (key == "axis") {
+            valid = parseVec3(value, object.axis);
+        } else if (key == "angle") {
+            valid = parseFloat(value, object.angle);
+        } else if (key == "spin") {
+            valid = parseFloat(value, object.spin);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    static bool parseLightKey(const std::string& key, const std::string& value, SceneLight& light, bool& valid) {
+        std::map<std::string, glm::vec3*> vectors = {
+                {"ambient", &light.ambient}, {"diffuse", &light.diffuse}, {"specular", &light.specular},
+                {"attenuation", &light.attenuation}, {"shipAmbient", &light.shipAmbient},
+                {"shipDiffuse", &light.shipDiffuse}, {"shipSpecular", &light.shipSpecular},
+                {"shipAttenuation", &light.shipAttenuation},
+        };
+        auto vector = vectors.find(key);
+        if (vector != vectors.end()) {
+            valid = parseVec3(value, *vector->second);
+        } else if (key == "anchor") {
+            light.anchor = value;
+        } else if (key == "speed") {
+            valid = parseFloat(value, light.speed);
+        } else if (key == "height") {
+            valid = parseFloat(value, light.height);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    static bool parsePostKey(const std::string& key, const std::string& value, ScenePost& post, bool& valid) {
+        float number = 0.0f;
+        if (key == "sky") {
+            post.sky = value;
+            return true;
+        }
+        valid = parseFloat(value, number);
+        if (key == "hdr") {
+            post.hdr = number != 0.0f;
+        } else if (key == "bloom") {
+            post.bloom = number != 0.0f;
+        } else if (key == "exposure") {
+            post.exposure = number;
+        } else if (key == "ibl") {
+            post.iblIntensity = number;
+        } else if (key == "escorts") {
+            valid = valid && number >= 0.0f && number <= (float) MAX_ESCORT_LIGHTS;
+            post.escortLights = valid ? (int) number : 0;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    static bool parse(const std::string& path, SceneDescription& scene) {
+        std::ifstream in(path);
+        if (!in) {
+            std::cout << "ERROR::SCENE::CANNOT_OPEN " << path << std::endl;
+            return false;
+        }
+        std::string line;
+        int number = 0;
+        while (std::getline(in, line)) {
+            ++number;
+            std::vector<std::string> tokens = tokenize(line);
+            if (tokens.empty()) {
+                continue;
+            }
+            const std::string& record = tokens[0];
+            size_t first = 1;
+            if (record == "model") {
+                if (tokens.size() != 3) {
+                    error("MODEL_NEEDS_NAME_AND_PATH", path, number, line);
+                    return false;
+                }
+                scene.models.push_back(SceneModel{tokens[1], tokens[2]});
+                continue;
+            }
+            SceneObject object;
+            SceneLight light;
+            glm::vec3 count(1.0f), spacing(0.0f);
+            if (record == "object" || record == "grid" || record == "light") {
+                if (tokens.size() < 2 || tokens[1].find('=') != std::string::npos) {
+                    error("MISSING_NAME", path, number, line);
+                    return false;
+                }
+                object.name = light.name = tokens[1];
+                first = 2;
+            } else if (record != "post") {
+                error("UNKNOWN_RECORD", path, number, record);
+                return false;
+            }
+            if (record == "light") {
+                if (tokens.size() < 3 || (tokens[2] != "directional" && tokens[2] != "point")) {
+                    error("LIGHT_NEEDS_TYPE", path, number, line);
+                    return false;
+                }
+                light.type = tokens[2] == "directional" ? SceneLight::DIRECTIONAL : SceneLight::POINT;
+                first = 3;
+            }
+
+            for (size_t i = first; i < tokens.size(); ++i) {
+                size_t equals = tokens[i].find('=');
+                if (equals == std::string::npos) {
+                    error("EXPECTED_KEY_VALUE", path, number, tokens[i]);
+                    return false;
+                }
+                std::string key = tokens[i].substr(0, equals);
+                std::string value = tokens[i].substr(equals + 1);
+                bool valid = true, known;
+                if (record == "light") {
+                    known = parseLightKey(key, value, light, valid);
+                } else if (record == "post") {
+                    known = parsePostKey(key, value, scene.post, valid);
+                } else {
+                    known = parseTransformKey(key, value, object, valid);
+                    if (!known && record == "object" && key == "texture") {
+                        object.texture = value;
+                        known = true;
+                    } else if (!known && record == "object" && key == "role") {
+                        known = valid = value == "prop" || value == "ship" || value == "planet";
+                        object.role = value == "ship" ? SceneObject::SHIP
+                                      : value == "planet" ? SceneObject::PLANET : SceneObject::PROP;
+                    } else if (!known && record == "grid" && key == "count") {
+                        known = true;
+                        valid = parseVec3(value, count) && count.x >= 1.0f && count.y >= 1.0f && count.z >= 1.0f;
+                    } else if (!known && record == "grid" && key == "spacing") {
+                        known = true;
+                        valid = parseVec3(value, spacing);
+                    }
+                }
+                if (!known) {
+                    error("UNKNOWN_KEY", path, number, key);
+                    return false;
+                }
+                if (!valid) {
+                    error("BAD_VALUE", path, number, tokens[i]);
+                    return false;
+                }
+            }
+
+            if (record == "object") {
+                scene.objects.push_back(object);
+            } else if (record == "light") {
+                scene.lights.push_back(light);
+            } else if (record == "grid") {
+                // checked before a single cell is made, a typo like count=1e6 would be 10^18 of them
+                double cells = (double) std::floor(count.x) * std::floor(count.y) * std::floor(count.z);
+                if (scene.objects.size() + cells > MAX_RECORDS) {
+                    error("TOO_MANY_OBJECTS", path, number, line);
+                    return false;
+                }
+                glm::vec3 origin = object.position;
+                int index = 0;
+                for (int z = 0; z < (int) count.z; ++z) {
+                    for (int y = 0; y < (int) count.y; ++y) {
+                        for (int x = 0; x < (int) count.x; ++x) {
+                            SceneObject cell = object;
+                            cell.name = object.name + std::to_string(index++);
+                            cell.position = origin + glm::vec3(x * spacing.x, y * spacing.y, z * spacing.z);
+                            scene.objects.push_back(cell);
+                        }
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // references resolve and the renderer finds what it needs
+    static bool validate(const std::string& path, const SceneDescription& scene) {
+        std::set<std::string> names;
+        for (const SceneObject& object : scene.objects) {
+            if (!names.insert(object.name).second) {
+                error("DUPLICATE_OBJECT", path, 0, object.name);
+                return false;
+            }
+            if (!object.parent.empty() && !names.count(object.parent)) {
+                error("PARENT_NOT_DECLARED_BEFORE", path, 0, object.name + " " + object.parent);
+                return false;
+            }
+            if (!object.model.empty() && !scene.model(object.model)) {
+                error("UNKNOWN_MODEL", path, 0, object.name + " " + object.model);
+                return false;
+            }
+            if (object.role != SceneObject::PROP && object.model.empty()) {
+                error("ROLE_WITHOUT_MODEL", path, 0, object.name);
+                return false;
+            }
+        }
+        if (scene.objectWithRole(SceneObject::SHIP) < 0 || scene.objectWithRole(SceneObject::PLANET) < 0) {
+            error("NEEDS_SHIP_AND_PLANET", path, 0, "");
+            return false;
+        }
+        if (scene.objects[scene.objectWithRole(SceneObject::PLANET)].texture.empty()) {
+            error("PLANET_WITHOUT_TEXTURE", path, 0, scene.objects[scene.objectWithRole(SceneObject::PLANET)].name);
+            return false;
+        }
+        for (SceneLight::Type type : { SceneLight::DIRECTIONAL, SceneLight::POINT }) {
+            const SceneLight* light = scene.light(type);
+            if (!light || scene.object(light->anchor) < 0) {
+                error("NEEDS_ANCHORED_LIGHTS", path, 0, light ? light->name + " " + light->anchor : "");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename T>
+    static void writeValue(std::ofstream& out, const T& value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    static void readValue(std::ifstream& in, T& value) {
+        in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    }
+
+    static void writeString(std::ofstream& out, const std::string& s) {
+        writeValue(out, (uint32_t) s.size());
+        out.write(s.data(), s.size());
+    }
+
+    static bool readString(std::ifstream& in, std::string& s) {
+        uint32_t size = 0;
+        readValue(in, size);
+        // nothing in a scene is that long, a larger size is a broken file
+        if (!in || size > (1u << 16)) {
+            return false;
+        }
+        s.resize(size);
+        in.read(&s[0], size);
+        return (bool) in;
+    }
+
+    void writeCompiled(const std::string& file, const SceneDescription& scene) const {
+        mkdir(m_Directory.c_str(), 0755);
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "ERROR::SCENE::CANNOT_WRITE " << file << std::endl;
+            return;
+        }
+        // local copies, taking the address of the static constants would need a definition
+        uint32_t magic = MAGIC, version = VERSION;
+        writeValue(out, magic);
+        writeValue(out, version);
+        writeValue(out, (uint32_t) scene.models.size());
+        for (const SceneModel& model : scene.models) {
+            writeString(out, model.name);
+            writeString(out, model.path);
+        }
+        writeValue(out, (uint32_t) scene.objects.size());
+        for (const SceneObject& object : scene.objects) {
+            writeString(out, object.name);
+            writeString(out, object.model);
+            writeString(out, object.parent);
+            writeString(out, object.texture);
+            writeValue(out, (int32_t) object.role);
+            writeValue(out, object.position);
+            writeValue(out, object.scale);
+            writeValue(out, object.axis);
+            writeValue(out, object.angle);
+            writeValue(out, object.spin);
+        }
+        writeValue(out, (uint32_t) scene.lights.size());
+        for (const SceneLight& light : scene.lights) {
+            writeString(out, light.name);
+            writeString(out, light.anchor);
+            writeValue(out, (int32_t) light.type);
+            writeValue(out, light.speed);
+            writeValue(out, light.height);
+            for (const glm::vec3* color : { &light.ambient, &light.diffuse, &light.specular, &light.attenuation,
+                                            &light.shipAmbient, &light.shipDiffuse, &light.shipSpecular,
+                                            &light.shipAttenuation }) {
+                writeValue(out, *color);
+            }
+        }
+        const ScenePost& post = scene.post;
+        int32_t flags[3] = { post.hdr, post.bloom, post.escortLights };
+        writeValue(out, flags);
+        writeValue(out, post.exposure);
+        writeValue(out, post.iblIntensity);
+        writeString(out, post.sky);
+    }
+
+    bool readCompiled(const std::string& file, SceneDescription& scene) const {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        uint32_t magic = 0, version = 0, count = 0;
+        readValue(in, magic);
+        readValue(in, version);
+        if (!in || magic != MAGIC || version != VERSION) {
+            return false;
+        }
+        readValue(in, count);
+        if (!in || count > MAX_RECORDS) {
+            return false;
+        }
+        scene.models.resize(count);
+        for (SceneModel& model : scene.models) {
+            if (!readString(in, model.name) || !readString(in, model.path)) {
+                return false;
+            }
+        }
+        readValue(in, count);
+        if (!in || count > MAX_RECORDS) {
+            return false;
+        }
+        scene.objects.resize(count);
+        for (SceneObject& object : scene.objects) {
+            int32_t role = 0;
+            if (!readString(in, object.name) || !readString(in, object.model) || !readString(in, object.parent)
+                || !readString(in, object.texture)) {
+                return false;
+            }
+            readValue(in, role);
+            if (role < SceneObject::PROP || role > SceneObject::PLANET) {
+                return false;
+            }
+            object.role = (SceneObject::Role) role;
+            readValue(in, object.position);
+            readValue(in, object.scale);
+            readValue(in, object.axis);
+            readValue(in, object.angle);
+            readValue(in, object.spin);
+        }
+        readValue(in, count);
+        if (!in || count > MAX_RECORDS) {
+            return false;
+        }
+        scene.lights.resize(count);
+        for (SceneLight& light : scene.lights) {
+            int32_t type = 0;
+            if (!readString(in, light.name) || !readString(in, light.anchor)) {
+                return false;
+            }
+            readValue(in, type);
+            if (type != SceneLight::DIRECTIONAL && type != SceneLight::POINT) {
+                return false;
+            }
+            light.type = (SceneLight::Type) type;
+            readValue(in, light.speed);
+            readValue(in, light.height);
+            for (glm::vec3* color : { &light.ambient, &light.diffuse, &light.specular, &light.attenuation,
+                                      &light.shipAmbient, &light.shipDiffuse, &light.shipSpecular,
+                                      &light.shipAttenuation }) {
+                readValue(in, *color);
+            }
+        }
+        ScenePost& post = scene.post;
+        int32_t flags[3];
+        readValue(in, flags);
+        post.hdr = flags[0] != 0;
+        post.bloom = flags[1] != 0;
+        post.escortLights = flags[2];
+        if (post.escortLights < 0 || post.escortLights > MAX_ESCORT_LIGHTS) {
+            return false;
+        }
+        readValue(in, post.exposure);
+        readValue(in, post.iblIntensity);
+        return readString(in, post.sky);
+    }
+
+    std::string m_Directory = "resources/scene_cache";
+    std::string m_Path;
+    uint64_t m_Stamp = 0;
+    Stats m_Stats;
+};
+
+}
+
+#endif //PROJECT_BASE_SCENEFILE_H
@@ -0,0 +1,304 @@
+#ifndef PROJECT_BASE_SCENETRANSFORMS_H
+#define PROJECT_BASE_SCENETRANSFORMS_H
+
+#include <glm/glm.hpp>
+#include <rg/JobSystem.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace rg {
+
+// Positions, rotations and scales of the scene's nodes as structure of arrays, each node with
+// an optional parent, and the world matrices they make. The setters only mark a node dirty;
+// update() spreads that to the children and recomputes just the dirty nodes in two passes:
+//   local  translate * rotate * scale, four nodes at a time with one node per SSE lane, over
+//          the blocks of four that hold a dirty node
+//   world  parent world * local, depth by depth, so every parent is done before its children
+// Either pass goes over rg::JobSystem once it has PARALLEL_NODES to do. Rotations are unit
+// quaternions (x, y, z, w); setRotation(node, angle, axis) gives the rotation of glm::rotate.
+// Nodes are never removed, clear() starts over.
+class SceneTransforms {
+public:
+    typedef uint32_t Node;
+    static const Node NO_PARENT = 0xffffffffu;
+    // below this many nodes a pass stays on the calling thread
+    static const size_t PARALLEL_NODES = 8192;
+    static const size_t NODES_PER_JOB = 2048;
+
+    SceneTransforms() = default;
+    SceneTransforms(const SceneTransforms&) = delete;
+    SceneTransforms& operator=(const SceneTransforms&) = delete;
+
+    // an identity node; the parent must exist already
+    Node create(Node parent = NO_PARENT) {
+        Node node = (Node) m_Parent.size();
+        if (node % 4 == 0) {
+            // a whole block of four for the SIMD pass, the unused lanes stay identities
+            for (std::vector<float>* array : { &m_PositionX, &m_PositionY, &m_PositionZ, &m_RotationX, &m_RotationY,
+                                               &m_RotationZ }) {
+                array->resize(node + 4, 0.0f);
+            }
+            for (std::vector<float>* array : { &m_RotationW, &m_ScaleX, &m_ScaleY, &m_ScaleZ }) {
+                array->resize(node + 4, 1.0f);
+            }
+            m_Dirty.resize(node + 4, 0);
+            m_Local.resize(node + 4, glm::mat4(1.0f));
+        }
+        int depth = parent == NO_PARENT ? 0 : m_Depth[parent] + 1;
+        m_Parent.push_back(parent);
+        m_Depth.push_back(depth);
+        m_World.push_back(glm::mat4(1.0f));
+        if ((int) m_Levels.size() <= depth) {
+            m_Levels.resize(depth + 1);
+        }
+        m_Levels[depth].push_back(node);
+        m_Dirty[node] = 1;
+        return node;
+    }
+
+    void clear() {
+        for (std::vector<float>* array : { &m_PositionX, &m_PositionY, &m_PositionZ, &m_RotationX, &m_RotationY,
+                                           &m_RotationZ, &m_RotationW, &m_ScaleX, &m_ScaleY, &m_ScaleZ }) {
+            array->clear();
+        }
+        m_Parent.clear();
+        m_Depth.clear();
+        m_Dirty.clear();
+        m_Local.clear();
+        m_World.clear();
+        m_Levels.clear();
+    }
+
+    void setPosition(Node node, const glm::vec3& position) {
+        m_PositionX[node] = position.x;
+        m_PositionY[node] = position.y;
+        m_PositionZ[node] = position.z;
+        m_Dirty[node] = 1;
+    }
+
+    // angle in radians around axis, which doesn't have to be normalized
+    void setRotation(Node node, float angle, const glm::vec3& axis) {
+        glm::vec3 unit = glm::normalize(axis);
+        float s = std::sin(angle * 0.5f);
+        setRotation(node, glm::vec4(unit.x * s, unit.y * s, unit.z * s, std::cos(angle * 0.5f)));
+    }
+
+    void setRotation(Node node, const glm::vec4& quaternion) {
+        m_RotationX[node] = quaternion.x;
+        m_RotationY[node] = quaternion.y;
+        m_RotationZ[node] = quaternion.z;
+        m_RotationW[node] = quaternion.w;
+        m_Dirty[node] = 1;
+    }
+
+    void setScale(Node node, const glm::vec3& scale) {
+        m_ScaleX[node] = scale.x;
+        m_ScaleY[node] = scale.y;
+        m_ScaleZ[node] = scale.z;
+        m_Dirty[node] = 1;
+    }
+
+    glm::vec3 position(Node node) const {
+        return glm::vec3(m_PositionX[node], m_PositionY[node], m_PositionZ[node]);
+    }
+
+    Node parent(Node node) const {
+        return m_Parent[node];
+    }
+
+    // as of the last update()
+    const glm::mat4& world(Node node) const {
+        return m_World[node];
+    }
+
+    size_t size() const {
+        return m_Parent.size();
+    }
+
+    size_t depth() const {
+        return m_Levels.size();
+    }
+
+    // nodes whose world matrix the last update() recomputed
+    size_t updatedCount() const {
+        return m_Updated;
+    }
+
+    // simd false runs the scalar reference, parallel false keeps both passes on this thread
+    void update(bool simd = true, bool parallel = true) {
+        m_Updated = 0;
+        for (size_t level = 1; level < m_Levels.size(); ++level) {
+            for (Node node : m_Levels[level]) {
+                m_Dirty[node] |= m_Dirty[m_Parent[node]];
+            }
+        }
+        for (size_t node = 0; node < m_Parent.size(); ++node) {
+            m_Updated += m_Dirty[node];
+        }
+        if (m_Updated == 0) {
+            return;
+        }
+        bool jobs = parallel && m_Updated >= PARALLEL_NODES;
+
+        size_t blocks = m_Dirty.size() / 4;
+        auto local = [this, simd](size_t firstBlock, size_t lastBlock) {
+            for (size_t block = firstBlock; block < lastBlock; ++block) {
+                uint32_t dirty;
+                std::memcpy(&dirty, &m_Dirty[block * 4], sizeof(dirty));
+                if (dirty) {
+                    updateLocal(block * 4, simd);
+                }
+            }
+        };
+        if (jobs) {
+            JobSystem::instance().parallelFor(blocks, NODES_PER_JOB / 4, local);
+        } else {
+            local(0, blocks);
+        }
+
+        for (const std::vector<Node>& level : m_Levels) {
+            auto world = [this, &level, simd](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i) {
+                    Node node = level[i];
+                    if (!m_Dirty[node]) {
+                        continue;
+                    }
+                    if (m_Parent[node] == NO_PARENT) {
+                        m_World[node] = m_Local[node];
+                    } else {
+                        multiply(m_World[m_Parent[node]], m_Local[node], m_World[node], simd);
+                    }
+                }
+            };
+            if (jobs && level.size() >= PARALLEL_NODES) {
+                JobSystem::instance().parallelFor(level.size(), NODES_PER_JOB, world);
+            } else {
+                world(0, level.size());
+            }
+        }
+        std::fill(m_Dirty.begin(), m_Dirty.end(), 0);
+    }
+
+private:
+    // the local matrices of nodes first..first + 3
+    void updateLocal(size_t first, bool simd) {
+#if defined(__SSE2__)
+        if (simd) {
+            updateLocalSimd(first);
+            return;
+        }
+#endif
+        (void) simd;
+        for (size_t node = first; node < first + 4; ++node) {
+            float x = m_RotationX[node], y = m_RotationY[node], z = m_RotationZ[node], w = m_RotationW[node];
+            float sx = m_ScaleX[node], sy = m_ScaleY[node], sz = m_ScaleZ[node];
+            glm::mat4& m = m_Local[node];
+            m[0] = glm::vec4(sx * (1.0f - 2.0f * (y * y + z * z)), sx * 2.0f * (x * y + w * z),
+                             sx * 2.0f * (x * z - w * y), 0.0f);
+            m[1] = glm::vec4(sy * 2.0f * (x * y - w * z), sy * (1.0f - 2.0f * (x * x + z * z)),
+                             sy * 2.0f * (y * z + w * x), 0.0f);
+            m[2] = glm::vec4(sz * 2.0f * (x * z + w * y), sz * 2.0f * (y * z - w * x),
+                             sz * (1.0f - 2.0f * (x * x + y * y)), 0.0f);
+            m[3] = glm::vec4(m_PositionX[node], m_PositionY[node], m_PositionZ[node], 1.0f);
+        }
+    }
+
+    static void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& result, bool simd) {
+#if defined(__SSE2__)
+        if (simd) {
+            __m128 a0 = _mm_loadu_ps(&a[0][0]);
+            __m128 a1 = _mm_loadu_ps(&a[1][0]);
+            __m128 a2 = _mm_loadu_ps(&a[2][0]);
+            __m128 a3 = _mm_loadu_ps(&a[3][0]);
+            for (int column = 0; column < 4; ++column) {
+                const glm::vec4& c = b[column];
+                __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(c.x)), _mm_mul_ps(a1, _mm_set1_ps(c.y))),
+                                        _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(c.z)), _mm_mul_ps(a3, _mm_set1_ps(c.w))));
+                _mm_storeu_ps(&result[column][0], sum);
+            }
+            return;
+        }
+#endif
+        (void) simd;
+        result = a * b;
+    }
+
+#if defined(__SSE2__)
+    void updateLocalSimd(size_t first) {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 two = _mm_set1_ps(2.0f);
+        __m128 x = _mm_loadu_ps(&m_RotationX[first]);
+        __m128 y = _mm_loadu_ps(&m_RotationY[first]);
+        __m128 z = _mm_loadu_ps(&m_RotationZ[first]);
+        __m128 w = _mm_loadu_ps(&m_RotationW[first]);
+        __m128 sx = _mm_loadu_ps(&m_ScaleX[first]);
+        __m128 sy = _mm_loadu_ps(&m_ScaleY[first]);
+        __m128 sz = _mm_loadu_ps(&m_ScaleZ[first]);
+
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        // rows are lanes here: c0x holds the x of the first column of all four nodes
+        __m128 c0x = _mm_mul_ps(sx, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))));
+        __m128 c0y = _mm_mul_ps(sx, _mm_mul_ps(two, _mm_add_ps(xy, wz)));
+        __m128 c0z = _mm_mul_ps(sx, _mm_mul_ps(two, _mm_sub_ps(xz, wy)));
+        __m128 c0w = _mm_setzero_ps();
+        __m128 c1x = _mm_mul_ps(sy, _mm_mul_ps(two, _mm_sub_ps(xy, wz)));
+        __m128 c1y = _mm_mul_ps(sy, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))));
+        __m128 c1z = _mm_mul_ps(sy, _mm_mul_ps(two, _mm_add_ps(yz, wx)));
+        __m128 c1w = _mm_setzero_ps();
+        __m128 c2x = _mm_mul_ps(sz, _mm_mul_ps(two, _mm_add_ps(xz, wy)));
+        __m128 c2y = _mm_mul_ps(sz, _mm_mul_ps(two, _mm_sub_ps(yz, wx)));
+        __m128 c2z = _mm_mul_ps(sz, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))));
+        __m128 c2w = _mm_setzero_ps();
+        __m128 c3x = _mm_loadu_ps(&m_PositionX[first]);
+        __m128 c3y = _mm_loadu_ps(&m_PositionY[first]);
+        __m128 c3z = _mm_loadu_ps(&m_PositionZ[first]);
+        __m128 c3w = one;
+
+        // back to one column per register and node
+        _MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+        _MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+        _MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+        _MM_TRANSPOSE4_PS(c3x, c3y, c3z, c3w);
+        const __m128 columns[4][4] = {
+                { c0x, c1x, c2x, c3x },
+                { c0y, c1y, c2y, c3y },
+                { c0z, c1z, c2z, c3z },
+                { c0w, c1w, c2w, c3w },
+        };
+        for (int node = 0; node < 4; ++node) {
+            for (int column = 0; column < 4; ++column) {
+                _mm_storeu_ps(&m_Local[first + node][column][0], columns[node][column]);
+            }
+        }
+    }
+#endif
+
+    // padded to a multiple of four like m_Dirty and m_Local
+    std::vector<float> m_PositionX, m_PositionY, m_PositionZ;
+    std::vector<float> m_RotationX, m_RotationY, m_RotationZ, m_RotationW;
+    std::vector<float> m_ScaleX, m_ScaleY, m_ScaleZ;
+    std::vector<uint8_t> m_Dirty;
+    std::vector<glm::mat4> m_Local;
+
+    std::vector<Node> m_Parent;
+    std::vector<int> m_Depth;
+    std::vector<glm::mat4> m_World;
+    // the nodes of every depth, roots first
+    std::vector<std::vector<Node>> m_Levels;
+    size_t m_Updated = 0;
+};
+
+}
+
+#endif //PROJECT_BASE_SCENETRANSFORMS_H
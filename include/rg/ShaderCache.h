@@ -0,0 +1,159 @@
+#ifndef PROJECT_BASE_SHADERCACHE_H
+#define PROJECT_BASE_SHADERCACHE_H
+
+#include <glad/glad.h>
+#include <rg/GLExtensions.h>
+#include <rg/Hash.h>
+
+#include <sys/stat.h>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// On-disk cache of linked program binaries. The key is a hash of every source string
+// that goes into the program (defines are part of the source by the time it gets here)
+// and of the driver vendor/renderer/version string, so a driver update or an edited
+// shader simply misses the cache and the program is compiled from text again.
+class ShaderCache {
+public:
+    struct Stats {
+        unsigned int hits = 0;
+        unsigned int compiled = 0;
+        unsigned int rejected = 0; // found on disk, but the driver refused the binary
+        double milliseconds = 0.0;
+    };
+
+    static ShaderCache& instance() {
+        static ShaderCache cache;
+        return cache;
+    }
+
+    void setDirectory(const std::string& path) {
+        m_Directory = path;
+    }
+
+    bool enabled() const {
+        return m_Enabled && glext::programBinary;
+    }
+    void setEnabled(bool enabled) {
+        m_Enabled = enabled;
+    }
+
+    std::string key(const std::vector<std::string>& sources) {
+        if (m_Driver.empty()) {
+            m_Driver = glext::driverString();
+        }
+        uint64_t hash = hashString(m_Driver);
+        for (const std::string& source : sources) {
+            hash = hashString(source, hash);
+        }
+        return hashToHex(hash);
+    }
+
+    // returns true if the program was successfully created from the cached binary
+    bool load(GLuint program, const std::string& key) {
+        if (!enabled()) {
+            return false;
+        }
+        std::ifstream in(pathFor(key), std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        Header header;
+        in.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!in || header.magic != MAGIC || header.version != VERSION || header.length == 0) {
+            return false;
+        }
+        std::vector<char> binary(header.length);
+        in.read(binary.data(), binary.size());
+        if (!in) {
+            return false;
+        }
+
+        glProgramBinary(program, header.format, binary.data(), header.length);
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            ++m_Stats.rejected;
+            return false;
+        }
+        ++m_Stats.hits;
+        return true;
+    }
+
+    // program has to be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+    void store(GLuint program, const std::string& key) {
+        ++m_Stats.compiled;
+        if (!enabled()) {
+            return;
+        }
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+        Header header;
+        header.length = length;
+        std::vector<char> binary(length);
+        glGetProgramBinary(program, length, nullptr, &header.format, binary.data());
+
+        mkdir(m_Directory.c_str(), 0755);
+        std::ofstream out(pathFor(key), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "ERROR::SHADER_CACHE::CANNOT_WRITE " << pathFor(key) << std::endl;
+            return;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(binary.data(), binary.size());
+    }
+
+    void addTime(double milliseconds) {
+        m_Stats.milliseconds += milliseconds;
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+    void report(std::ostream& out) const {
+        out << "Shader startup: " << m_Stats.milliseconds << " ms ("
+            << m_Stats.hits << " from cache, " << m_Stats.compiled << " compiled";
+        if (m_Stats.rejected) {
+            out << ", " << m_Stats.rejected << " stale binaries";
+        }
+        if (!enabled()) {
+            out << ", program binaries unavailable";
+        }
+        out << ")" << std::endl;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x42534752; // "RGSB"
+    static const uint32_t VERSION = 1;
+
+    struct Header {
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+        GLenum format = 0;
+        uint32_t length = 0;
+    };
+
+    ShaderCache() = default;
+
+    std::string pathFor(const std::string& key) const {
+        return m_Directory + "/" + key + ".bin";
+    }
+
+    std::string m_Directory = "resources/shader_cache";
+    std::string m_Driver;
+    bool m_Enabled = true;
+    Stats m_Stats;
+};
+
+}
+
+#endif //PROJECT_BASE_SHADERCACHE_H
@@ -0,0 +1,183 @@
+#ifndef PROJECT_BASE_SHADERPREPROCESSOR_H
+#define PROJECT_BASE_SHADERPREPROCESSOR_H
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+struct PreprocessedSource {
+    std::string code;
+    // every file that went into code, the top level file first; the index of a file in
+    // this list is the source string number used in #line, so "2(14)" in a compiler
+    // error means line 14 of dependencies[2]
+    std::vector<std::string> dependencies;
+    bool ok = true;
+    std::string error;
+};
+
+// Expands #include "file" directives in GLSL sources. Includes are looked up next to the
+// including file first and then in the include paths in order. Every file is pasted at
+// most once per program, so a library can be included from several places without
+// redefining its structs. Touches no GL state, the file reader can be swapped out.
+class ShaderPreprocessor {
+public:
+    typedef std::function<bool(const std::string& path, std::string& contents)> FileReader;
+
+    explicit ShaderPreprocessor(std::vector<std::string> includePaths = {"resources/shaders"},
+                                FileReader reader = readFile)
+        : m_IncludePaths(std::move(includePaths))
+        , m_Reader(std::move(reader)) {
+    }
+
+    PreprocessedSource process(const std::string& path) const {
+        PreprocessedSource result;
+        std::vector<std::string> stack;
+        expand(normalizePath(path), result, stack);
+        return result;
+    }
+
+    static bool readFile(const std::string& path, std::string& contents) {
+        std::ifstream in(path);
+        if (!in) {
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        contents = buffer.str();
+        return true;
+    }
+
+    // collapses "." and "dir/.." components so that one file always gets one name
+    static std::string normalizePath(const std::string& path) {
+        std::vector<std::string> parts;
+        std::stringstream in(path);
+        std::string part;
+        while (std::getline(in, part, '/')) {
+            if (part.empty() || part == ".") {
+                continue;
+            }
+            if (part == ".." && !parts.empty() && parts.back() != "..") {
+                parts.pop_back();
+            } else {
+                parts.push_back(part);
+            }
+        }
+        std::string result = !path.empty() && path[0] == '/' ? "/" : "";
+        for (size_t i = 0; i < parts.size(); ++i) {
+            result += (i ? "/" : "") + parts[i];
+        }
+        return result;
+    }
+
+private:
+    static std::string directoryOf(const std::string& path) {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? "" : path.substr(0, slash);
+    }
+
+    static std::string join(const std::string& directory, const std::string& file) {
+        return normalizePath(directory.empty() ? file : directory + "/" + file);
+    }
+
+    // returns the include target of a line, or false if it is not an #include
+    static bool parseInclude(const std::string& line, std::string& target) {
+        size_t i = line.find_first_not_of(" \t");
+        if (i == std::string::npos || line.compare(i, 8, "#include") != 0) {
+            return false;
+        }
+        size_t open = line.find('"', i + 8);
+        size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+        if (close == std::string::npos) {
+            target.clear();
+            return true;
+        }
+        target = line.substr(open + 1, close - open - 1);
+        return true;
+    }
+
+    bool resolve(const std::string& includer, const std::string& target, std::string& path,
+                 std::string& contents) const {
+        path = join(directoryOf(includer), target);
+        if (m_Reader(path, contents)) {
+            return true;
+        }
+        for (const std::string& includePath : m_IncludePaths) {
+            path = join(includePath, target);
+            if (m_Reader(path, contents)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void expand(const std::string& path, PreprocessedSource& result, std::vector<std::string>& stack,
+                const std::string* preloaded = nullptr) const {
+        std::string contents;
+        if (preloaded) {
+            contents = *preloaded;
+        } else if (!m_Reader(path, contents)) {
+            fail(result, "cannot read " + path);
+            return;
+        }
+        size_t sourceNumber = result.dependencies.size();
+        result.dependencies.push_back(path);
+        stack.push_back(path);
+
+        std::istringstream in(contents);
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(in, line)) {
+            ++lineNumber;
+            std::string target;
+            if (!parseInclude(line, target)) {
+                result.code += line + '\n';
+                continue;
+            }
+            if (target.empty()) {
+                fail(result, path + ":" + std::to_string(lineNumber) + ": malformed #include");
+                break;
+            }
+            std::string includePath, includeContents;
+            if (!resolve(path, target, includePath, includeContents)) {
+                fail(result, path + ":" + std::to_string(lineNumber) + ": cannot find \"" + target + "\"");
+                break;
+            }
+            if (std::find(stack.begin(), stack.end(), includePath) != stack.end()) {
+                fail(result, path + ":" + std::to_string(lineNumber) + ": recursive include of " + includePath);
+                break;
+            }
+            bool alreadyIncluded = std::find(result.dependencies.begin(), result.dependencies.end(), includePath)
+                                   != result.dependencies.end();
+            if (!alreadyIncluded) {
+                result.code += "#line 0 " + std::to_string(result.dependencies.size()) + "\n";
+                expand(includePath, result, stack, &includeContents);
+                if (!result.ok) {
+                    break;
+                }
+            }
+            // continue with the next line of this file; in GLSL 3.30 the line after "#line n"
+            // is numbered n + 1 (4.20 changed that to n, all shaders here are 330)
+            result.code += "#line " + std::to_string(lineNumber) + " " + std::to_string(sourceNumber) + "\n";
+        }
+        stack.pop_back();
+    }
+
+    static void fail(PreprocessedSource& result, const std::string& error) {
+        if (result.ok) {
+            result.ok = false;
+            result.error = error;
+        }
+    }
+
+    std::vector<std::string> m_IncludePaths;
+    FileReader m_Reader;
+};
+
+}
+
+#endif //PROJECT_BASE_SHADERPREPROCESSOR_H
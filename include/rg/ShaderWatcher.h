@@ -0,0 +1,115 @@
+#ifndef PROJECT_BASE_SHADERWATCHER_H
+#define PROJECT_BASE_SHADERWATCHER_H
+
+#include <learnopengl/shader.h>
+
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace rg {
+
+// Watches shader source directories with inotify and reloads the shaders that use a file
+// once it changes. Nothing runs in the background: poll() drains the events without
+// blocking, so calling it once per frame keeps every GL call on the render thread.
+class ShaderWatcher {
+public:
+    explicit ShaderWatcher(const std::vector<std::string>& directories) {
+#ifdef __linux__
+        m_Fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_Fd < 0) {
+            std::cout << "ERROR::SHADER_WATCHER::INOTIFY_INIT_FAILED" << std::endl;
+            return;
+        }
+        for (const std::string& directory : directories) {
+            // editors either rewrite the file in place or write a temporary and rename it
+            int wd = inotify_add_watch(m_Fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (wd < 0) {
+                std::cout << "ERROR::SHADER_WATCHER::CANNOT_WATCH " << directory << std::endl;
+                continue;
+            }
+            m_Watches.push_back(Watch{wd, directory});
+        }
+#endif
+    }
+
+    ~ShaderWatcher() {
+#ifdef __linux__
+        if (m_Fd >= 0) {
+            close(m_Fd);
+        }
+#endif
+    }
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    void add(Shader& shader) {
+        m_Shaders.push_back(&shader);
+    }
+
+    // reloads every shader whose sources changed since the last call
+    void poll() {
+        std::set<std::string> changed = readChangedFiles();
+        if (changed.empty()) {
+            return;
+        }
+        for (Shader* shader : m_Shaders) {
+            for (const std::string& path : changed) {
+                if (shader->dependsOn(path)) {
+                    shader->reload();
+                    break;
+                }
+            }
+        }
+    }
+
+private:
+    struct Watch {
+        int wd;
+        std::string directory;
+    };
+
+    std::set<std::string> readChangedFiles() {
+        std::set<std::string> changed;
+#ifdef __linux__
+        if (m_Fd < 0) {
+            return changed;
+        }
+        alignas(inotify_event) char buffer[4096];
+        while (true) {
+            ssize_t length = read(m_Fd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+            for (char* p = buffer; p < buffer + length; ) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                if (event->len > 0) {
+                    for (const Watch& watch : m_Watches) {
+                        if (watch.wd == event->wd) {
+                            changed.insert(watch.directory + "/" + event->name);
+                        }
+                    }
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+#endif
+        return changed;
+    }
+
+    int m_Fd = -1;
+    std::vector<Watch> m_Watches;
+    std::vector<Shader*> m_Shaders;
+};
+
+}
+
+#endif //PROJECT_BASE_SHADERWATCHER_H
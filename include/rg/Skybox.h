@@ -0,0 +1,157 @@
+#ifndef PROJECT_BASE_SKYBOX_H
+#define PROJECT_BASE_SKYBOX_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <rg/GpuMemory.h>
+
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Sky drawn as one fullscreen triangle at the far plane after the opaque geometry. skybox.vs
+// turns each corner back into a world direction with the inverse view-projection, so there is
+// no cube mesh and no second projection. The depth test is LEQUAL against the cleared 1.0 with
+// depth writes off: every pixel already covered by a model fails early-Z and is never shaded.
+// All skies are uploaded once; select() only changes which one is bound.
+class Skybox {
+public:
+    Skybox() {
+        // the triangle is generated from gl_VertexID, core profile still wants a VAO
+        glGenVertexArrays(1, &m_VAO);
+    }
+
+    ~Skybox() {
+        if (m_Queries[0]) {
+            glDeleteQueries(LATENCY, m_Queries);
+        }
+        for (const Sky& sky : m_Skies) {
+            GpuMemory::instance().forget(GpuMemory::TEXTURE, sky.texture);
+            glDeleteTextures(1, &sky.texture);
+        }
+        glDeleteVertexArrays(1, &m_VAO);
+    }
+
+    Skybox(const Skybox&) = delete;
+    Skybox& operator=(const Skybox&) = delete;
+
+    // takes ownership of a cubemap texture
+    void add(const std::string& name, GLuint texture) {
+        m_Skies.push_back(Sky{name, texture});
+    }
+
+    void select(int index) {
+        if (index >= 0 && index < (int) m_Skies.size()) {
+            m_Current = index;
+        }
+    }
+
+    // draws the selected sky into the bound framebuffer; width and height are its size
+    void draw(Shader& shader, const glm::mat4& projection, const glm::mat4& view, int width, int height) {
+        if (!m_Queries[0]) {
+            glGenQueries(LATENCY, m_Queries);
+        }
+        collect();
+        m_ScreenPixels = (double) width * height;
+
+        // rotation only, the sky is infinitely far away
+        glm::mat4 rotation = glm::mat4(glm::mat3(view));
+        shader.use();
+        shader.setMat4("inverseViewProjection", glm::inverse(projection * rotation));
+        shader.setInt("skyboxTex", 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture());
+
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_BLEND);
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+        glBeginQuery(GL_SAMPLES_PASSED, m_Queries[m_CurrentQuery]);
+        glBindVertexArray(m_VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glEndQuery(GL_SAMPLES_PASSED);
+        m_Pending[m_CurrentQuery] = true;
+        m_CurrentQuery = (m_CurrentQuery + 1) % LATENCY;
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        if (blend)
+            glEnable(GL_BLEND);
+    }
+
+    // the sky's triangle with another shader that takes the same inverseViewProjection and
+    // only needs the view directions, like the mip feedback; depth tested the same way
+    void drawDirections(Shader& shader, const glm::mat4& projection, const glm::mat4& view) {
+        shader.setMat4("inverseViewProjection", glm::inverse(projection * glm::mat4(glm::mat3(view))));
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+        glBindVertexArray(m_VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+
+    int current() const {
+        return m_Current;
+    }
+    int count() const {
+        return (int) m_Skies.size();
+    }
+    const std::string& name(int index) const {
+        return m_Skies[index].name;
+    }
+    GLuint texture() const {
+        return m_Skies[m_Current].texture;
+    }
+
+    // pixels the sky shader ran on in a recent frame, read a few frames late like GpuTimer
+    double shadedPixels() const {
+        return m_ShadedPixels;
+    }
+    // share of the screen the depth test kept away from the sky shader, the fill rate saved
+    // by drawing the sky last instead of first
+    double rejectedFraction() const {
+        return m_ScreenPixels > 0.0 ? 1.0 - m_ShadedPixels / m_ScreenPixels : 0.0;
+    }
+
+private:
+    static const int LATENCY = 4;
+
+    struct Sky {
+        std::string name;
+        GLuint texture;
+    };
+
+    void collect() {
+        for (int i = 0; i < LATENCY; ++i) {
+            if (!m_Pending[i]) {
+                continue;
+            }
+            GLint available = 0;
+            glGetQueryObjectiv(m_Queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                continue;
+            }
+            GLuint samples = 0;
+            glGetQueryObjectuiv(m_Queries[i], GL_QUERY_RESULT, &samples);
+            m_Pending[i] = false;
+            m_ShadedPixels = samples;
+        }
+    }
+
+    std::vector<Sky> m_Skies;
+    int m_Current = 0;
+    GLuint m_VAO = 0;
+    GLuint m_Queries[LATENCY] = {};
+    bool m_Pending[LATENCY] = {};
+    int m_CurrentQuery = 0;
+    double m_ShadedPixels = 0.0;
+    double m_ScreenPixels = 0.0;
+};
+
+}
+
+#endif //PROJECT_BASE_SKYBOX_H
@@ -0,0 +1,191 @@
+#ifndef PROJECT_BASE_TEXTUREARRAYS_H
+#define PROJECT_BASE_TEXTUREARRAYS_H
+
+#include <glad/glad.h>
+#include <rg/GpuMemory.h>
+#include <stb_image.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace rg {
+
+// Texture binds of the mesh passes. Every bind through here is counted and marks the texture
+// as used for rg::GpuMemory's residency; bindCached skips a bind when the unit already holds
+// the texture since the last invalidate(), which callers do before each model or batch
+// because anything else may have bound the unit in between.
+class TextureBindings {
+public:
+    static const int UNITS = 16;
+
+    static TextureBindings& instance() {
+        static TextureBindings bindings;
+        return bindings;
+    }
+
+    void bind(GLuint unit, GLenum target, GLuint texture) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        GpuMemory::instance().touch(texture);
+        if (unit < (GLuint) UNITS) {
+            m_Bound[unit] = texture;
+        }
+        ++m_Binds;
+    }
+
+    void bindCached(GLuint unit, GLenum target, GLuint texture) {
+        if (unit < (GLuint) UNITS && m_Bound[unit] == texture) {
+            return;
+        }
+        bind(unit, target, texture);
+    }
+
+    void invalidate() {
+        for (GLuint& bound : m_Bound) {
+            bound = 0;
+        }
+    }
+
+    size_t binds() const {
+        return m_Binds;
+    }
+    void resetBinds() {
+        m_Binds = 0;
+    }
+
+private:
+    TextureBindings() {
+        invalidate();
+    }
+
+    GLuint m_Bound[UNITS];
+    size_t m_Binds = 0;
+};
+
+// Packs images of the same size and channel count into the layers of one GL_TEXTURE_2D_ARRAY,
+// so meshes whose textures share an array draw without rebinding and a multi-draw batch can
+// take them in one call. Layers keep their own [0, 1] texture coordinates, wrapping and mips,
+// unlike an atlas, so UVs stay as they are and only a layer index is added per mesh. Images are
+// decoded by add() and kept until build() knows how many layers every array needs.
+class TextureArrayPacker {
+public:
+    struct Placement {
+        GLuint array = 0;
+        int layer = -1;
+    };
+
+    TextureArrayPacker() = default;
+    TextureArrayPacker(const TextureArrayPacker&) = delete;
+    TextureArrayPacker& operator=(const TextureArrayPacker&) = delete;
+
+    // the image's index for placement(), or -1 if it can't be read; a file is only added once.
+    // flip is stb_image's vertical flip, as in rg::TextureSettings
+    int add(const std::string& filename, bool flip) {
+        auto found = m_Indices.find(filename);
+        if (found != m_Indices.end()) {
+            return found->second;
+        }
+        Image image;
+        stbi_set_flip_vertically_on_load(flip);
+        image.pixels = stbi_load(filename.c_str(), &image.width, &image.height, &image.channels, 0);
+        if (!image.pixels) {
+            std::cout << "ERROR::TEXTURE_ARRAY::LOAD_FAILED " << filename << std::endl;
+            m_Indices[filename] = -1;
+            return -1;
+        }
+        Key key(image.width, image.height, image.channels);
+        image.group = key;
+        image.layer = m_Layers[key]++;
+        int index = (int) m_Images.size();
+        m_Images.push_back(image);
+        m_Indices[filename] = index;
+        return index;
+    }
+
+    // creates an array per size and format, uploads the layers and frees the decoded images
+    void build() {
+        std::map<Key, GLuint> arrays;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (const auto& entry : m_Layers) {
+            int width, height, channels;
+            std::tie(width, height, channels) = entry.first;
+            GLenum format = formatFor(channels);
+            GLuint array;
+            glGenTextures(1, &array);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, width, height, entry.second, 0, format, GL_UNSIGNED_BYTE, nullptr);
+            arrays[entry.first] = array;
+            m_Arrays.push_back(array);
+            size_t texelBytes = channels == 3 ? 4 : (size_t) channels;
+            GpuMemory::instance().track(GpuMemory::TEXTURE, array,
+                                        textureBytes(width, height, texelBytes, mipLevels(width, height), entry.second),
+                                        "texture arrays");
+        }
+        for (Image& image : m_Images) {
+            GLenum format = formatFor(image.channels);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[image.group]);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, image.layer, image.width, image.height, 1, format,
+                            GL_UNSIGNED_BYTE, image.pixels);
+            stbi_image_free(image.pixels);
+            image.pixels = nullptr;
+            image.array = arrays[image.group];
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        // the sampling TextureFromFile sets up for single textures
+        for (GLuint array : m_Arrays) {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    Placement placement(int image) const {
+        Placement placement;
+        if (image >= 0) {
+            placement.array = m_Images[image].array;
+            placement.layer = m_Images[image].layer;
+        }
+        return placement;
+    }
+
+    // like the single textures of a model the arrays live as long as the context
+    const std::vector<GLuint>& arrays() const {
+        return m_Arrays;
+    }
+
+    size_t imageCount() const {
+        return m_Images.size();
+    }
+
+private:
+    // width, height, channels
+    typedef std::tuple<int, int, int> Key;
+
+    struct Image {
+        unsigned char* pixels = nullptr;
+        int width = 0, height = 0, channels = 0;
+        Key group;
+        int layer = 0;
+        GLuint array = 0;
+    };
+
+    static GLenum formatFor(int channels) {
+        return channels == 1 ? GL_RED : channels == 2 ? GL_RG : channels == 3 ? GL_RGB : GL_RGBA;
+    }
+
+    std::vector<Image> m_Images;
+    std::map<std::string, int> m_Indices;
+    std::map<Key, int> m_Layers;
+    std::vector<GLuint> m_Arrays;
+};
+
+}
+
+#endif //PROJECT_BASE_TEXTUREARRAYS_H
@@ -0,0 +1,288 @@
+#ifndef PROJECT_BASE_TEXTURECACHE_H
+#define PROJECT_BASE_TEXTURECACHE_H
+
+#include <glad/glad.h>
+#include <rg/GpuMemory.h>
+#include <rg/Hash.h>
+#include <stb_image.h>
+
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rg {
+
+// how a file is decoded and sampled; part of the cache key, the same image with other settings
+// is another texture
+struct TextureSettings {
+    bool srgb = false;
+    // stb_image's vertical flip, set for every decode instead of relying on its global state
+    bool flip = false;
+    GLint wrap = GL_REPEAT;
+    GLint minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    GLint magFilter = GL_LINEAR;
+};
+
+// Every 2D texture loaded from a file, shared by everyone who asks for the same image. Two
+// lookups, both hash maps:
+//   path     canonical path, file size and modification time, settings; repeated requests
+//            for a file skip reading it
+//   content  FNV-1a of the file's bytes and the settings; a copy of an image under another
+//            name or in another model's directory is decoded and uploaded only once
+// Textures are reference counted, acquire and release come in pairs. releaseAll() deletes
+// what is left before the context goes away. Every texture is evictable in rg::GpuMemory:
+// dropping a mip reads the smaller levels back and respecifies the texture from them under the
+// same name, restoring decodes the file again.
+class TextureCache {
+public:
+    struct Stats {
+        size_t requests = 0;
+        size_t pathHits = 0;
+        size_t contentHits = 0;         // different files with the same bytes
+        size_t uploads = 0;
+        size_t bytesUploaded = 0;
+        size_t bytesSaved = 0;          // what the hits would have uploaded again
+    };
+
+    static TextureCache& instance() {
+        static TextureCache cache;
+        return cache;
+    }
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    // the texture, or 0 if the file can't be read or decoded
+    GLuint acquire(const std::string& path, const TextureSettings& settings = TextureSettings()) {
+        ++m_Stats.requests;
+        int32_t fields[5] = { settings.srgb, settings.flip, settings.wrap, settings.minFilter, settings.magFilter };
+        uint64_t settingsHash = hashBytes(fields, sizeof(fields));
+        uint64_t pathKey = hashFileStamp(canonical(path), settingsHash);
+        auto byPath = m_ByPath.find(pathKey);
+        if (byPath != m_ByPath.end()) {
+            ++m_Stats.pathHits;
+            return retain(byPath->second);
+        }
+
+        std::ifstream file(path, std::ios::binary);
+        std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (bytes.empty()) {
+            std::cout << "ERROR::TEXTURE_CACHE::LOAD_FAILED " << path << std::endl;
+            return 0;
+        }
+        uint64_t contentKey = hashBytes(bytes.data(), bytes.size(), settingsHash);
+        auto byContent = m_ByContent.find(contentKey);
+        if (byContent != m_ByContent.end()) {
+            ++m_Stats.contentHits;
+            m_ByPath[pathKey] = byContent->second;
+            m_Entries[byContent->second].pathKeys.push_back(pathKey);
+            return retain(byContent->second);
+        }
+
+        Entry entry;
+        glGenTextures(1, &entry.id);
+        entry.path = path;
+        entry.settings = settings;
+        if (!upload(bytes, entry)) {
+            std::cout << "ERROR::TEXTURE_CACHE::DECODE_FAILED " << path << std::endl;
+            glDeleteTextures(1, &entry.id);
+            return 0;
+        }
+        entry.contentKey = contentKey;
+        entry.pathKeys.push_back(pathKey);
+        entry.references = 1;
+        m_ByPath[pathKey] = entry.id;
+        m_ByContent[contentKey] = entry.id;
+        m_Entries[entry.id] = entry;
+        ++m_Stats.uploads;
+        m_Stats.bytesUploaded += entry.bytes;
+        GLuint texture = entry.id;
+        GpuMemory::instance().track(GpuMemory::TEXTURE, texture, entry.bytes, "textures");
+        GpuMemory::Residency residency;
+        residency.dropTopMip = [this, texture]() { return dropTopMip(texture); };
+        residency.restore = [this, texture]() { return restore(texture); };
+        GpuMemory::instance().makeEvictable(texture, residency);
+        return texture;
+    }
+
+    // deletes the texture with its last reference
+    void release(GLuint texture) {
+        auto found = m_Entries.find(texture);
+        if (found == m_Entries.end() || --found->second.references > 0) {
+            return;
+        }
+        for (uint64_t pathKey : found->second.pathKeys) {
+            m_ByPath.erase(pathKey);
+        }
+        m_ByContent.erase(found->second.contentKey);
+        GpuMemory::instance().forget(GpuMemory::TEXTURE, texture);
+        glDeleteTextures(1, &texture);
+        m_Entries.erase(found);
+    }
+
+    void releaseAll() {
+        for (auto& entry : m_Entries) {
+            GpuMemory::instance().forget(GpuMemory::TEXTURE, entry.second.id);
+            glDeleteTextures(1, &entry.second.id);
+        }
+        m_Entries.clear();
+        m_ByPath.clear();
+        m_ByContent.clear();
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+    size_t textureCount() const {
+        return m_Entries.size();
+    }
+
+    std::vector<GLuint> textures() const {
+        std::vector<GLuint> textures;
+        for (const auto& entry : m_Entries) {
+            textures.push_back(entry.first);
+        }
+        return textures;
+    }
+
+    // resident bytes of the live textures, mips included
+    size_t residentBytes() const {
+        size_t bytes = 0;
+        for (const auto& entry : m_Entries) {
+            bytes += entry.second.bytes;
+        }
+        return bytes;
+    }
+
+private:
+    struct Entry {
+        GLuint id = 0;
+        uint64_t contentKey = 0;
+        std::vector<uint64_t> pathKeys;
+        size_t references = 0;
+        size_t bytes = 0;
+        // what restore() needs to decode the file again
+        std::string path;
+        TextureSettings settings;
+        int width = 0, height = 0, channels = 0;
+        int dropped = 0;
+    };
+
+    TextureCache() = default;
+
+    static std::string canonical(const std::string& path) {
+        char resolved[PATH_MAX];
+        return realpath(path.c_str(), resolved) ? std::string(resolved) : path;
+    }
+
+    GLuint retain(GLuint texture) {
+        Entry& entry = m_Entries[texture];
+        ++entry.references;
+        m_Stats.bytesSaved += entry.bytes;
+        return texture;
+    }
+
+    static GLenum dataFormat(int channels) {
+        return channels == 1 ? GL_RED : channels == 2 ? GL_RG : channels == 3 ? GL_RGB : GL_RGBA;
+    }
+
+    static size_t texelBytes(int channels) {
+        // 3-channel textures are stored as 4 by most drivers
+        return channels == 3 ? 4 : (size_t) channels;
+    }
+
+    // the upload loadTexture and TextureFromFile used to do on their own, into entry.id
+    static bool upload(const std::vector<unsigned char>& bytes, Entry& entry) {
+        const TextureSettings& settings = entry.settings;
+        int width, height, channels;
+        stbi_set_flip_vertically_on_load(settings.flip);
+        unsigned char* data = stbi_load_from_memory(bytes.data(), (int) bytes.size(), &width, &height, &channels, 0);
+        if (!data) {
+            return false;
+        }
+        GLenum format = dataFormat(channels);
+        GLenum internalFormat = format;
+        if (settings.srgb && channels == 3)
+            internalFormat = GL_SRGB;
+        else if (settings.srgb && channels == 4)
+            internalFormat = GL_SRGB_ALPHA;
+
+        glBindTexture(GL_TEXTURE_2D, entry.id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, settings.wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, settings.wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, settings.minFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, settings.magFilter);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        stbi_image_free(data);
+
+        entry.width = width;
+        entry.height = height;
+        entry.channels = channels;
+        entry.dropped = 0;
+        entry.bytes = textureBytes(width, height, texelBytes(channels), mipLevels(width, height));
+        return true;
+    }
+
+    // level 1 and below move up one level, the texture keeps its name; returns the new size
+    size_t dropTopMip(GLuint texture) {
+        Entry& entry = m_Entries[texture];
+        int width = std::max(entry.width >> entry.dropped, 1);
+        int height = std::max(entry.height >> entry.dropped, 1);
+        int levels = mipLevels(width, height);
+        if (levels < 2) {
+            return entry.bytes;
+        }
+        GLenum format = dataFormat(entry.channels);
+        GLint internalFormat;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        std::vector<std::vector<unsigned char>> chain(levels - 1);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        for (int level = 1; level < levels; ++level) {
+            chain[level - 1].resize((size_t) std::max(width >> level, 1) * std::max(height >> level, 1) * entry.channels);
+            glGetTexImage(GL_TEXTURE_2D, level, format, GL_UNSIGNED_BYTE, chain[level - 1].data());
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int level = 0; level < levels - 1; ++level) {
+            glTexImage2D(GL_TEXTURE_2D, level, internalFormat, std::max(width >> (level + 1), 1),
+                         std::max(height >> (level + 1), 1), 0, format, GL_UNSIGNED_BYTE, chain[level].data());
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        ++entry.dropped;
+        entry.bytes = textureBytes(width >> 1, height >> 1, texelBytes(entry.channels), levels - 1);
+        return entry.bytes;
+    }
+
+    // the full resolution from the file again; returns the new size
+    size_t restore(GLuint texture) {
+        Entry& entry = m_Entries[texture];
+        std::ifstream file(entry.path, std::ios::binary);
+        std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (bytes.empty() || !upload(bytes, entry)) {
+            std::cout << "ERROR::TEXTURE_CACHE::RESTORE_FAILED " << entry.path << std::endl;
+        }
+        return entry.bytes;
+    }
+
+    std::unordered_map<uint64_t, GLuint> m_ByPath;
+    std::unordered_map<uint64_t, GLuint> m_ByContent;
+    std::unordered_map<GLuint, Entry> m_Entries;
+    Stats m_Stats;
+};
+
+}
+
+#endif //PROJECT_BASE_TEXTURECACHE_H
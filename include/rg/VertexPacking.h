@@ -0,0 +1,191 @@
+#ifndef PROJECT_BASE_VERTEXPACKING_H
+#define PROJECT_BASE_VERTEXPACKING_H
+
+#include <glm/glm.hpp>
+#include <rg/HalfFloat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace rg {
+
+// How Mesh stores its vertices on the GPU.
+//   FLOAT32  the learnopengl layout: one interleaved stream of 56 byte vertices
+//   SNORM16  16-bit integer positions in the mesh's bounding box, scaled back in the shader
+//   HALF     half float positions relative to the bounding box center
+// Both packed layouts split the vertex into streams so a pass only fetches what it reads:
+//   0  position xyz, bitangent sign in w                 8 bytes
+//   1  octahedral normal (2x16-bit), half float uv       8 bytes
+//   2  octahedral tangent (2x16-bit), optional           4 bytes
+// Depth-only passes read stream 0 alone. Shaders include lib/vertex.glsl and are compiled with
+// PACKED_VERTICES for the packed layouts.
+struct VertexLayout {
+    enum Positions { FLOAT32, SNORM16, HALF };
+
+    Positions positions = FLOAT32;
+    // false leaves stream 2 out; no shader in the scene reads tangents yet
+    bool tangents = true;
+
+    bool packed() const {
+        return positions != FLOAT32;
+    }
+
+    bool operator==(const VertexLayout& other) const {
+        return positions == other.positions && tangents == other.tangents;
+    }
+    bool operator!=(const VertexLayout& other) const {
+        return !(*this == other);
+    }
+};
+
+// the streams of a packed layout, and what the shader needs to undo the quantization:
+// position = offset + stored * scale
+struct PackedVertices {
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    std::vector<int16_t> positions;       // SNORM16: 4 per vertex
+    std::vector<uint16_t> halfPositions;  // HALF: 4 per vertex
+    std::vector<uint16_t> attributes;     // 4 per vertex: normal as int16 bits, uv as half bits
+    std::vector<int16_t> tangents;        // 2 per vertex, empty without tangents
+};
+
+// octahedral encoding into [-32767, 32767], the same mapping as OctEncode in lib/octahedral.glsl
+void octEncode16(glm::vec3 n, int16_t* out) {
+    float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (sum == 0.0f) {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+    n /= sum;
+    glm::vec2 f(n.x, n.y);
+    if (n.z < 0.0f) {
+        f = glm::vec2((1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    out[0] = (int16_t) std::lround(std::min(std::max(f.x, -1.0f), 1.0f) * 32767.0f);
+    out[1] = (int16_t) std::lround(std::min(std::max(f.y, -1.0f), 1.0f) * 32767.0f);
+}
+
+// V is learnopengl's Vertex; anything with Position, Normal, TexCoords, Tangent and Bitangent works
+template <typename V>
+PackedVertices packVertices(const std::vector<V>& vertices, const VertexLayout& layout) {
+    PackedVertices packed;
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (const V& vertex : vertices) {
+        lo = glm::min(lo, vertex.Position);
+        hi = glm::max(hi, vertex.Position);
+    }
+    if (vertices.empty()) {
+        lo = hi = glm::vec3(0.0f);
+    }
+    packed.offset = (lo + hi) * 0.5f;
+    glm::vec3 extent = glm::max((hi - lo) * 0.5f, glm::vec3(1e-6f));
+    // the shader reads the shorts as plain integers, so the 1/32767 goes into the scale
+    packed.scale = layout.positions == VertexLayout::SNORM16 ? extent / 32767.0f : glm::vec3(1.0f);
+
+    size_t count = vertices.size();
+    if (layout.positions == VertexLayout::SNORM16)
+        packed.positions.resize(count * 4);
+    else
+        packed.halfPositions.resize(count * 4);
+    packed.attributes.resize(count * 4);
+    if (layout.tangents)
+        packed.tangents.resize(count * 2);
+
+    for (size_t i = 0; i < count; ++i) {
+        const V& vertex = vertices[i];
+        glm::vec3 local = vertex.Position - packed.offset;
+        float bitangentSign = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+        if (layout.positions == VertexLayout::SNORM16) {
+            glm::vec3 q = glm::clamp(local / extent, -1.0f, 1.0f) * 32767.0f;
+            packed.positions[i * 4 + 0] = (int16_t) std::lround(q.x);
+            packed.positions[i * 4 + 1] = (int16_t) std::lround(q.y);
+            packed.positions[i * 4 + 2] = (int16_t) std::lround(q.z);
+            packed.positions[i * 4 + 3] = (int16_t) (bitangentSign * 32767.0f);
+        } else {
+            packed.halfPositions[i * 4 + 0] = floatToHalf(local.x);
+            packed.halfPositions[i * 4 + 1] = floatToHalf(local.y);
+            packed.halfPositions[i * 4 + 2] = floatToHalf(local.z);
+            packed.halfPositions[i * 4 + 3] = floatToHalf(bitangentSign);
+        }
+        int16_t normal[2];
+        octEncode16(vertex.Normal, normal);
+        packed.attributes[i * 4 + 0] = (uint16_t) normal[0];
+        packed.attributes[i * 4 + 1] = (uint16_t) normal[1];
+        packed.attributes[i * 4 + 2] = floatToHalf(vertex.TexCoords.x);
+        packed.attributes[i * 4 + 3] = floatToHalf(vertex.TexCoords.y);
+        if (layout.tangents)
+            octEncode16(vertex.Tangent, &packed.tangents[i * 2]);
+    }
+    return packed;
+}
+
+// a run of triangles drawn with one glDrawElementsBaseVertex, its indices relative to baseVertex
+struct IndexRange {
+    unsigned int first = 0;       // first index in the index buffer
+    unsigned int count = 0;
+    unsigned int baseVertex = 0;
+};
+
+// The index buffer at the narrowest width that fits. Meshes with more than 65536 vertices are cut
+// into ranges that each span fewer, so they still get 16-bit indices; after optimizeVertexFetch
+// the vertices are in first-use order and the ranges come out few and long. wide is only set
+// when a single triangle spans more than 65535 vertices, then the 32-bit indices stay as they are.
+struct PackedIndices {
+    bool wide = false;
+    std::vector<uint16_t> indices;
+    std::vector<IndexRange> ranges;
+};
+
+PackedIndices packIndices(const std::vector<unsigned int>& indices, bool allowShort = true) {
+    PackedIndices packed;
+    const unsigned int limit = 65536;
+    size_t triangleCount = indices.size() / 3;
+
+    IndexRange range;
+    unsigned int lo = ~0u, hi = 0;
+    for (size_t t = 0; t < triangleCount && allowShort; ++t) {
+        const unsigned int* triangle = &indices[t * 3];
+        unsigned int triangleLo = std::min(triangle[0], std::min(triangle[1], triangle[2]));
+        unsigned int triangleHi = std::max(triangle[0], std::max(triangle[1], triangle[2]));
+        if (triangleHi - triangleLo >= limit) {
+            allowShort = false;
+            break;
+        }
+        if (range.count > 0 && (std::max(hi, triangleHi) - std::min(lo, triangleLo) >= limit)) {
+            range.baseVertex = lo;
+            packed.ranges.push_back(range);
+            range.first += range.count;
+            range.count = 0;
+            lo = ~0u;
+            hi = 0;
+        }
+        lo = std::min(lo, triangleLo);
+        hi = std::max(hi, triangleHi);
+        range.count += 3;
+    }
+    if (!allowShort) {
+        packed.wide = true;
+        packed.ranges.assign(1, IndexRange{0, (unsigned int) indices.size(), 0});
+        return packed;
+    }
+    if (range.count > 0) {
+        range.baseVertex = lo;
+        packed.ranges.push_back(range);
+    }
+
+    packed.indices.resize(triangleCount * 3);
+    for (const IndexRange& r : packed.ranges) {
+        for (unsigned int i = r.first; i < r.first + r.count; ++i) {
+            packed.indices[i] = (uint16_t) (indices[i] - r.baseVertex);
+        }
+    }
+    return packed;
+}
+
+}
+
+#endif //PROJECT_BASE_VERTEXPACKING_H
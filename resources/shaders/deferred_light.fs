@@ -0,0 +1,58 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+#include "lib/bloom.glsl"
+
+#include "lib/lighting.glsl"
+#include "lib/gbuffer.glsl"
+#include "lib/shadows.glsl"
+#include "lib/ibl.glsl"
+
+#ifdef LIGHT_VOLUME
+flat in vec4 PositionRadius;
+flat in vec3 Color;
+#else
+uniform DirLight dirLight;
+uniform PointLight pointLight;
+// the ship's colors for the same two lights, as its forward shader gets them
+uniform DirLight shipDirLight;
+uniform PointLight shipPointLight;
+#endif
+
+uniform vec3 viewPosition;
+uniform float shininess;
+uniform float shipShininess;
+
+void main()
+{
+    Surface surface;
+    if (!ReadGBuffer(surface))
+        discard;
+
+    vec3 viewDir = normalize(viewPosition - surface.position);
+    vec3 specularColor = vec3(surface.specular);
+    bool ship = surface.lightingModel == LIGHTING_SHIP;
+    float surfaceShininess = ship ? shipShininess : shininess;
+#ifdef LIGHT_VOLUME
+    vec3 toLight = PositionRadius.xyz - surface.position;
+    if (dot(toLight, toLight) >= PositionRadius.w * PositionRadius.w)
+        discard;
+    vec3 result = CalcWindowedLight(PositionRadius.xyz, PositionRadius.w, Color, surface.normal, surface.position,
+                                    viewDir, surface.albedo, specularColor, surfaceShininess);
+#else
+    vec3 result;
+    if (ship) {
+        // the ship's forward shader receives no shadows
+        result = CalcDirLight(shipDirLight, surface.normal, viewDir, surface.albedo, specularColor, surfaceShininess);
+        result += CalcPointLight(shipPointLight, surface.normal, surface.position, viewDir, surface.albedo, specularColor,
+                                 surfaceShininess);
+    } else {
+        float shadow = CascadeShadow(surface.position, surface.normal, normalize(-dirLight.direction));
+        result = CalcDirLight(dirLight, surface.normal, viewDir, surface.albedo, specularColor, surfaceShininess, shadow);
+        result += CalcPointLight(pointLight, surface.normal, surface.position, viewDir, surface.albedo, specularColor,
+                                 surfaceShininess, PointShadow(surface.position, surface.normal));
+    }
+    result += CalcAmbientIBL(surface.normal, viewDir, surface.albedo, specularColor, surfaceShininess);
+#endif
+    FragColor = vec4(result, 1.0);
+    WriteBrightColor(result);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+// A fullscreen triangle for the directional pass, or with LIGHT_VOLUME one screen space
+// rectangle per point light, computed on the CPU from the light's bounding sphere.
+#ifdef LIGHT_VOLUME
+layout (location = 0) in vec2 aCorner;
+layout (location = 1) in vec4 aRect;            // NDC min.xy, max.xy
+layout (location = 2) in vec4 aPositionRadius;
+layout (location = 3) in vec3 aColor;
+
+flat out vec4 PositionRadius;
+flat out vec3 Color;
+#endif
+
+void main()
+{
+#ifdef LIGHT_VOLUME
+    PositionRadius = aPositionRadius;
+    Color = aColor;
+    gl_Position = vec4(mix(aRect.xy, aRect.zw, aCorner), 0.0, 1.0);
+#else
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+#endif
+}
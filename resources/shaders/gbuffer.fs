@@ -0,0 +1,31 @@
+#version 330 core
+layout (location = 0) out vec4 gAlbedoSpecular;
+layout (location = 1) out vec2 gNormal;
+
+in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 Normal;
+
+#include "lib/gbuffer_pack.glsl"
+
+#ifdef SINGLE_TEXTURE
+// surfaces without a specular map (the planet) use their own color for the highlights
+uniform sampler2D tex;
+#else
+#include "lib/material.glsl"
+#endif
+
+void main()
+{
+#ifdef SINGLE_TEXTURE
+    vec3 albedo = texture(tex, TexCoords).rgb;
+    vec3 specularColor = albedo;
+    int lightingModel = LIGHTING_PLANET;
+#else
+    vec3 albedo = MaterialDiffuse(TexCoords);
+    vec3 specularColor = MaterialSpecular(TexCoords);
+    int lightingModel = LIGHTING_SHIP;
+#endif
+    gAlbedoSpecular = vec4(albedo, PackSpecularLighting(dot(specularColor, vec3(0.2126, 0.7152, 0.0722)), lightingModel));
+    gNormal = OctEncode(normalize(Normal));
+}
@@ -1,105 +1,36 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+#include "lib/bloom.glsl"
 
 in vec2 TexCoords;
 in vec3 FragPos;
 in vec3 Normal;
 
-
-struct DirLight {
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct PointLight{
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-
-struct Material{
-    sampler2D texture_diffuse1;
-    sampler2D texture_specular1;
-    float shininess;
-};
+#include "lib/lighting.glsl"
+#include "lib/clustered.glsl"
+#include "lib/ibl.glsl"
+#include "lib/material.glsl"
 
 
 uniform PointLight pointLight;
 uniform DirLight dirLight;
 uniform vec3 viewPosition;
-uniform Material material;
 // uniform sampler2D shipTex;
-uniform bool blinn;
-
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 
 void main()
 {
    vec3 normal = normalize(Normal);
    vec3 viewDir = normalize(viewPosition - FragPos);
-   vec3 result = CalcDirLight(dirLight, normal, viewDir);
-   result += CalcPointLight(pointLight, normal, FragPos, viewDir);
-
-   FragColor = vec4(result, 1.0);
-}
+   vec3 albedo = MaterialDiffuse(TexCoords);
+   vec3 specularColor = MaterialSpecular(TexCoords);
 
+   vec3 result = CalcDirLight(dirLight, normal, viewDir, albedo, specularColor, material.shininess);
+   result += CalcPointLight(pointLight, normal, FragPos, viewDir, albedo, specularColor, material.shininess);
+#ifdef CLUSTERED_LIGHTS
+   result += CalcClusteredLights(normal, FragPos, viewDir, albedo, specularColor, material.shininess);
+#endif
+   result += CalcAmbientIBL(normal, viewDir, albedo, specularColor, material.shininess);
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-
-    float spec = 0.0f;
-    if(blinn){
-
-        vec3 halfwayDir = normalize(lightDir + viewDir);
-        spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-
-    }else{
-
-        spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    }
-
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-
-    // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords).rgb);
-    ambient *= attenuation *1.2f;
-    diffuse *= attenuation;
-    specular *= attenuation;
-    return (ambient + diffuse + specular);
+   FragColor = vec4(result, 1.0);
+   WriteBrightColor(FragColor.rgb);
 }
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
-{
-    vec3 lightDir = normalize(-light.direction);
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
-    return (ambient + diffuse + specular);
-}
\ No newline at end of file
@@ -1,21 +1,25 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aTexCoords;
+#include "lib/vertex.glsl"
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+#ifdef TEXTURE_ARRAYS
+flat out vec2 MaterialLayer;
+#endif
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    mat4 modelMatrix = ModelMatrix();
+    FragPos = vec3(modelMatrix * vec4(VertexPosition(), 1.0));
+    Normal = mat3(transpose(inverse(modelMatrix))) * VertexNormal();
     TexCoords = aTexCoords;
+#ifdef TEXTURE_ARRAYS
+    MaterialLayer = MaterialLayers();
+#endif
 
     gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+}
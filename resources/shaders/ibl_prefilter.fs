@@ -0,0 +1,77 @@
+#version 330 core
+// One face of one mip of rg::ImageBasedLighting's specular cubemap: the sky convolved with a
+// GGX lobe around the texel's direction (normal = view = reflection, as usual for prefiltering).
+// Samples read a blurrier sky mip where they are sparse so few of them are enough.
+layout (location = 0) out vec4 FragColor;
+
+in vec2 FaceCoords;
+
+uniform samplerCube sky;
+uniform int face;
+uniform float roughness;
+uniform float sourceSize;
+
+const int SAMPLE_COUNT = 64;
+const float PI = 3.14159265359;
+
+// same face layout as the GL cubemap faces and ImageBasedLighting::faceBasis
+vec3 FaceDirection(vec2 uv)
+{
+    if (face == 0) return vec3(1.0, -uv.y, -uv.x);
+    if (face == 1) return vec3(-1.0, -uv.y, uv.x);
+    if (face == 2) return vec3(uv.x, 1.0, uv.y);
+    if (face == 3) return vec3(uv.x, -1.0, -uv.y);
+    if (face == 4) return vec3(uv.x, -uv.y, 1.0);
+    return vec3(-uv.x, -uv.y, -1.0);
+}
+
+vec2 Hammersley(uint i)
+{
+    uint bits = i;
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return vec2(float(i) / float(SAMPLE_COUNT), float(bits) * 2.3283064365386963e-10);
+}
+
+vec3 ImportanceSampleGGX(vec2 xi, vec3 n, float a)
+{
+    float phi = 2.0 * PI * xi.x;
+    float cosTheta = sqrt((1.0 - xi.y) / (1.0 + (a * a - 1.0) * xi.y));
+    float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+    vec3 h = vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+    vec3 up = abs(n.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, n));
+    vec3 bitangent = cross(n, tangent);
+    return normalize(tangent * h.x + bitangent * h.y + n * h.z);
+}
+
+void main()
+{
+    vec3 n = normalize(FaceDirection(FaceCoords));
+    if (roughness == 0.0) {
+        FragColor = vec4(textureLod(sky, n, 0.0).rgb, 1.0);
+        return;
+    }
+    float a = roughness * roughness;
+    float texelSolidAngle = 4.0 * PI / (6.0 * sourceSize * sourceSize);
+    vec3 sum = vec3(0.0);
+    float weight = 0.0;
+    for (int i = 0; i < SAMPLE_COUNT; ++i) {
+        vec3 h = ImportanceSampleGGX(Hammersley(uint(i)), n, a);
+        vec3 l = normalize(2.0 * dot(n, h) * h - n);
+        float nDotL = dot(n, l);
+        if (nDotL <= 0.0)
+            continue;
+        // with n = v the pdf of l is D(h) / 4
+        float nDotH = max(dot(n, h), 0.0);
+        float d = (a * a) / (PI * pow(nDotH * nDotH * (a * a - 1.0) + 1.0, 2.0));
+        float sampleSolidAngle = 1.0 / (float(SAMPLE_COUNT) * d * 0.25 + 0.0001);
+        float lod = 0.5 * log2(sampleSolidAngle / texelSolidAngle) + 1.0;
+        sum += textureLod(sky, l, max(lod, 0.0)).rgb * nDotL;
+        weight += nDotL;
+    }
+    FragColor = vec4(sum / max(weight, 0.0001), 1.0);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+// fullscreen triangle over one face of the target cubemap
+out vec2 FaceCoords;
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    FaceCoords = corner * 2.0 - 1.0;
+    gl_Position = vec4(FaceCoords, 0.0, 1.0);
+}
@@ -0,0 +1,12 @@
+// BLOOM_OUTPUT adds the bright-pass target the bloom blur reads from.
+#ifdef BLOOM_OUTPUT
+layout (location = 1) out vec4 BrightColor;
+#endif
+
+void WriteBrightColor(vec3 color)
+{
+#ifdef BLOOM_OUTPUT
+    float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    BrightColor = brightness > 1.0 ? vec4(color, 1.0) : vec4(0.0, 0.0, 0.0, 1.0);
+#endif
+}
@@ -0,0 +1,36 @@
+// Point lights assigned to view frustum clusters on the CPU (rg::ClusteredLighting).
+// Needs lib/lighting.glsl for CalcWindowedLight.
+#ifdef CLUSTERED_LIGHTS
+uniform samplerBuffer clusterLights;   // per light: (position, radius), (color, 0)
+uniform usamplerBuffer clusterGrid;    // per cluster: (first index, count)
+uniform usamplerBuffer clusterIndices;
+uniform mat4 clusterView;
+uniform vec4 clusterParams;            // tile width, tile height, depth slice scale, depth slice bias
+
+const int CLUSTERS_X = 16;
+const int CLUSTERS_Y = 9;
+const int CLUSTERS_Z = 24;
+
+int ClusterIndex(vec3 fragPos)
+{
+    float depth = -(clusterView * vec4(fragPos, 1.0)).z;
+    int slice = clamp(int(log(max(depth, 1e-4)) * clusterParams.z + clusterParams.w), 0, CLUSTERS_Z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterParams.xy), ivec2(0), ivec2(CLUSTERS_X - 1, CLUSTERS_Y - 1));
+    return (slice * CLUSTERS_Y + tile.y) * CLUSTERS_X + tile.x;
+}
+
+vec3 CalcClusteredLights(vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess)
+{
+    uvec2 range = texelFetch(clusterGrid, ClusterIndex(fragPos)).xy;
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; ++i)
+    {
+        int light = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLights, light * 2);
+        vec3 color = texelFetch(clusterLights, light * 2 + 1).rgb;
+        result += CalcWindowedLight(positionRadius.xyz, positionRadius.w, color, normal, fragPos, viewDir,
+                                    albedo, specularColor, shininess);
+    }
+    return result;
+}
+#endif
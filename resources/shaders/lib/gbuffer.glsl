@@ -0,0 +1,37 @@
+// Reads the deferred G-buffer (rg::DeferredRenderer):
+//   gAlbedoSpecular  SRGB8_ALPHA8  albedo; specular intensity in the low 7 bits of alpha and
+//                                  the lighting model in the top bit
+//   gNormal          RG16F         octahedral world space normal
+//   gDepth           DEPTH24       world position is reconstructed from it
+#include "gbuffer_pack.glsl"
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+
+struct Surface {
+    vec3 position;
+    vec3 normal;
+    vec3 albedo;
+    float specular;
+    int lightingModel;
+};
+
+// false where nothing was drawn, the skybox fills those pixels later
+bool ReadGBuffer(out Surface surface)
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, texel, 0).r;
+    if (depth == 1.0)
+        return false;
+
+    vec2 uv = gl_FragCoord.xy / vec2(textureSize(gDepth, 0));
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    surface.position = world.xyz / world.w;
+    surface.normal = OctDecode(texelFetch(gNormal, texel, 0).xy);
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, texel, 0);
+    surface.albedo = albedoSpecular.rgb;
+    UnpackSpecularLighting(albedoSpecular.a, surface.specular, surface.lightingModel);
+    return true;
+}
@@ -0,0 +1,20 @@
+// Channel packing of the deferred G-buffer, shared by gbuffer.fs and lib/gbuffer.glsl.
+#include "octahedral.glsl"
+
+// the forward path lights the planet and the ship with different light colors, the light pass
+// picks them by this
+#define LIGHTING_PLANET 0
+#define LIGHTING_SHIP 1
+
+// specular intensity in the low 7 bits of an 8 bit alpha, the lighting model in the top bit
+float PackSpecularLighting(float specular, int lightingModel)
+{
+    return (round(clamp(specular, 0.0, 1.0) * 127.0) + float(lightingModel) * 128.0) / 255.0;
+}
+
+void UnpackSpecularLighting(float alpha, out float specular, out int lightingModel)
+{
+    float bits = round(alpha * 255.0);
+    lightingModel = bits >= 128.0 ? LIGHTING_SHIP : LIGHTING_PLANET;
+    specular = (bits - float(lightingModel) * 128.0) / 127.0;
+}
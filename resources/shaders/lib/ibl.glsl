@@ -0,0 +1,35 @@
+// Ambient light from rg::ImageBasedLighting: diffuse from the sky's spherical harmonics,
+// specular from its prefiltered mips. Without IBL there is no ambient term.
+#ifdef IBL
+uniform vec3 shIrradiance[9];    // already convolved with the cosine lobe and divided by pi
+uniform samplerCube prefilteredSky;
+uniform float prefilteredMaxLod;
+uniform float iblIntensity;
+
+vec3 IrradianceSH(vec3 n)
+{
+    return shIrradiance[0] * 0.282095
+         + shIrradiance[1] * 0.488603 * n.y
+         + shIrradiance[2] * 0.488603 * n.z
+         + shIrradiance[3] * 0.488603 * n.x
+         + shIrradiance[4] * 1.092548 * n.x * n.y
+         + shIrradiance[5] * 1.092548 * n.y * n.z
+         + shIrradiance[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+         + shIrradiance[7] * 1.092548 * n.x * n.z
+         + shIrradiance[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+#endif
+
+vec3 CalcAmbientIBL(vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess)
+{
+#ifdef IBL
+    vec3 diffuse = max(IrradianceSH(normal), vec3(0.0)) * albedo;
+    // the Blinn-Phong exponent mapped onto the GGX roughness the mips were filtered with
+    float roughness = sqrt(2.0 / (shininess + 2.0));
+    vec3 reflected = reflect(-viewDir, normal);
+    vec3 specular = textureLod(prefilteredSky, reflected, roughness * prefilteredMaxLod).rgb * specularColor;
+    return (diffuse + specular) * iblIntensity;
+#else
+    return vec3(0.0);
+#endif
+}
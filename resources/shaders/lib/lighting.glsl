@@ -0,0 +1,90 @@
+// Shared lighting code. Surface colors are sampled once by the caller and passed in,
+// instead of every light function sampling the material textures again.
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// BLINN selects Blinn-Phong at compile time. RUNTIME_BLINN keeps the old per-fragment
+// uniform branch around, only for comparing the two in the performance window.
+#if defined(RUNTIME_BLINN)
+uniform bool blinn;
+#elif defined(BLINN)
+const bool blinn = true;
+#else
+const bool blinn = false;
+#endif
+
+float SpecularFactor(vec3 normal, vec3 lightDir, vec3 viewDir, float shininess)
+{
+    if(blinn){
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        return pow(max(dot(normal, halfwayDir), 0.0), shininess);
+    }
+    vec3 reflectDir = reflect(-lightDir, normal);
+    return pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+}
+
+// shadow scales the direct part only, 1 is fully lit
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess, float shadow)
+{
+    vec3 lightDir = normalize(-light.direction);
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = SpecularFactor(normal, lightDir, viewDir, shininess);
+    return (light.ambient + light.diffuse * diff * shadow) * albedo + light.specular * spec * shadow * specularColor;
+}
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess)
+{
+    return CalcDirLight(light, normal, viewDir, albedo, specularColor, shininess, 1.0);
+}
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess, float shadow)
+{
+    vec3 toLight = light.position - fragPos;
+    float distanceSquared = dot(toLight, toLight);
+    float invDistance = inversesqrt(distanceSquared);
+    vec3 lightDir = toLight * invDistance;
+    float distance = distanceSquared * invDistance;
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * distanceSquared);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = SpecularFactor(normal, lightDir, viewDir, shininess);
+    return ((light.ambient + light.diffuse * diff * shadow) * albedo + light.specular * spec * shadow * specularColor) * attenuation;
+}
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess)
+{
+    return CalcPointLight(light, normal, fragPos, viewDir, albedo, specularColor, shininess, 1.0);
+}
+
+// Light with a finite radius: a smooth window takes it to exactly zero at the radius, so
+// it can be culled to the clusters or the screen rectangle it touches.
+vec3 CalcWindowedLight(vec3 position, float radius, vec3 color, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess)
+{
+    vec3 toLight = position - fragPos;
+    float distanceSquared = dot(toLight, toLight);
+    float falloff = clamp(1.0 - distanceSquared / (radius * radius), 0.0, 1.0);
+    float attenuation = falloff * falloff / (1.0 + distanceSquared);
+    vec3 lightDir = toLight * inversesqrt(max(distanceSquared, 1e-8));
+
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = SpecularFactor(normal, lightDir, viewDir, shininess);
+    return (diff * albedo + spec * specularColor) * color * attenuation;
+}
@@ -0,0 +1,39 @@
+// The model's material textures: sampler2Ds per mesh, or with TEXTURE_ARRAYS layers of the
+// texture arrays rg::TextureArrayPacker builds, the layers passed on by the vertex shader.
+// Meshes without a specular map sample the diffuse one for it.
+struct Material{
+#ifdef TEXTURE_ARRAYS
+    sampler2DArray texture_diffuse_array;
+    sampler2DArray texture_specular_array;
+#else
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+#endif
+    float shininess;
+};
+uniform Material material;
+
+#ifdef TEXTURE_ARRAYS
+flat in vec2 MaterialLayer;     // diffuse, specular; negative without a specular map
+
+vec3 MaterialDiffuse(vec2 uv)
+{
+    return texture(material.texture_diffuse_array, vec3(uv, MaterialLayer.x)).rgb;
+}
+
+vec3 MaterialSpecular(vec2 uv)
+{
+    float layer = MaterialLayer.y < 0.0 ? MaterialLayer.x : MaterialLayer.y;
+    return texture(material.texture_specular_array, vec3(uv, layer)).rgb;
+}
+#else
+vec3 MaterialDiffuse(vec2 uv)
+{
+    return texture(material.texture_diffuse1, uv).rgb;
+}
+
+vec3 MaterialSpecular(vec2 uv)
+{
+    return texture(material.texture_specular1, uv).rgb;
+}
+#endif
@@ -0,0 +1,22 @@
+// Octahedral normal encoding: a unit vector is projected onto the octahedron |x|+|y|+|z| = 1
+// and the lower half is folded over the upper one, so two signed components are enough.
+// Stored in RG16F this keeps about the precision of three 8 bit channels at half the size.
+
+vec2 OctWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 OctEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+}
+
+vec3 OctDecode(vec2 f)
+{
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
@@ -0,0 +1,73 @@
+// Directional light shadows from rg::CascadedShadowMaps and point light shadows from
+// rg::PointShadowMap. Without CASCADED_SHADOWS / POINT_SHADOWS everything is lit and the
+// functions compile away.
+#ifdef CASCADED_SHADOWS
+const int MAX_CASCADES = 4;
+
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 cascadeMatrices[MAX_CASCADES];
+uniform vec4 cascadeSplits;       // view space distance where each cascade ends
+uniform vec4 cascadeTexelSizes;   // world size of one shadow map texel per cascade
+uniform int cascadeCount;
+uniform mat4 shadowView;
+
+// 0 in shadow, 1 lit; lightDir points towards the light
+float CascadeShadow(vec3 fragPos, vec3 normal, vec3 lightDir)
+{
+    float depth = -(shadowView * vec4(fragPos, 1.0)).z;
+    int cascade = 0;
+    while (cascade < cascadeCount && depth > cascadeSplits[cascade])
+        ++cascade;
+    if (cascade == cascadeCount)
+        return 1.0;
+
+    // push the lookup out along the normal, more at grazing angles, to keep acne away
+    float texel = cascadeTexelSizes[cascade];
+    float grazing = 1.0 - max(dot(normal, lightDir), 0.0);
+    vec4 position = cascadeMatrices[cascade] * vec4(fragPos + normal * texel * (0.5 + 1.5 * grazing), 1.0);
+    vec3 coord = position.xyz / position.w * 0.5 + 0.5;
+
+    // 3x3 taps, each one already a bilinear 2x2 comparison
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int x = -1; x <= 1; ++x)
+        for (int y = -1; y <= 1; ++y)
+            lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texelSize, float(cascade), coord.z));
+    return lit / 9.0;
+}
+#else
+float CascadeShadow(vec3 fragPos, vec3 normal, vec3 lightDir)
+{
+    return 1.0;
+}
+#endif
+
+#ifdef POINT_SHADOWS
+uniform samplerCubeShadow pointShadowMap;
+uniform vec3 pointShadowPosition;
+uniform float pointShadowFar;
+
+// 0 in shadow, 1 lit
+float PointShadow(vec3 fragPos, vec3 normal)
+{
+    vec3 fromLight = fragPos - pointShadowPosition;
+    float distance = length(fromLight);
+    vec3 lightDir = -fromLight / distance;
+    // the map stores linear distance, so the bias is in world units and grows at grazing angles
+    float bias = 0.05 + 0.3 * (1.0 - max(dot(normal, lightDir), 0.0));
+    float reference = (distance - bias) / pointShadowFar;
+
+    // four taps around the lookup direction, each a bilinear 2x2 comparison
+    const vec3 offsets[4] = vec3[](vec3(1.0, 1.0, 1.0), vec3(1.0, -1.0, -1.0), vec3(-1.0, 1.0, -1.0), vec3(-1.0, -1.0, 1.0));
+    float spread = 0.002 * distance;
+    float lit = 0.0;
+    for (int i = 0; i < 4; ++i)
+        lit += texture(pointShadowMap, vec4(fromLight + offsets[i] * spread, reference));
+    return lit * 0.25;
+}
+#else
+float PointShadow(vec3 fragPos, vec3 normal)
+{
+    return 1.0;
+}
+#endif
@@ -0,0 +1,91 @@
+// Mesh vertex attributes in the layouts of rg::VertexLayout. Without PACKED_VERTICES they are
+// the float layout of learnopengl's Vertex; with it positions are 16-bit values scaled back
+// with the mesh's positionOffset / positionScale and normals are octahedral 16-bit integers.
+// Define POSITION_ONLY before including this in depth-only shaders.
+// ModelMatrix() is the model uniform, or with MULTI_DRAW the draw's entry in rg::MultiDrawBatch's
+// drawData buffer, which also holds the draw's positionOffset / positionScale.
+#ifdef MULTI_DRAW
+layout (location = 5) in uint aDrawId;      // the command's baseInstance
+uniform samplerBuffer drawData;             // per draw: 4 model matrix columns, offset, scale
+
+mat4 ModelMatrix()
+{
+    int base = int(aDrawId) * 6;
+    return mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1),
+                texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+}
+#else
+uniform mat4 model;
+
+mat4 ModelMatrix()
+{
+    return model;
+}
+#endif
+
+// MaterialLayers() is the diffuse and specular layer of a TEXTURE_ARRAYS material, see material.glsl.
+#ifdef TEXTURE_ARRAYS
+#ifdef MULTI_DRAW
+vec2 MaterialLayers()
+{
+    int base = int(aDrawId) * 6;
+    return vec2(texelFetch(drawData, base + 4).w, texelFetch(drawData, base + 5).w);
+}
+#else
+uniform vec2 materialLayers;
+
+vec2 MaterialLayers()
+{
+    return materialLayers;
+}
+#endif
+#endif
+
+#ifdef PACKED_VERTICES
+#include "octahedral.glsl"
+
+layout (location = 0) in vec4 aPos;         // w is the bitangent sign
+#ifndef MULTI_DRAW
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+#endif
+#ifndef POSITION_ONLY
+layout (location = 1) in vec2 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+#endif
+
+vec3 VertexPosition()
+{
+#ifdef MULTI_DRAW
+    int base = int(aDrawId) * 6;
+    return texelFetch(drawData, base + 4).xyz + aPos.xyz * texelFetch(drawData, base + 5).xyz;
+#else
+    return positionOffset + aPos.xyz * positionScale;
+#endif
+}
+
+#ifndef POSITION_ONLY
+vec3 VertexNormal()
+{
+    return OctDecode(aNormal / 32767.0);
+}
+#endif
+#else
+layout (location = 0) in vec3 aPos;
+#ifndef POSITION_ONLY
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+#endif
+
+vec3 VertexPosition()
+{
+    return aPos;
+}
+
+#ifndef POSITION_ONLY
+vec3 VertexNormal()
+{
+    return aNormal;
+}
+#endif
+#endif
@@ -0,0 +1,37 @@
+#version 330 core
+// Mip feedback for rg::MipStreaming: the streamed texture a pixel samples and the finest level
+// it would sample on screen. Drawn with planetLight.vs for 2D textures, with skybox.vs and
+// CUBE_FEEDBACK for a sky. The target is RG8: the stream's id (0 for none) and the level.
+layout (location = 0) out vec2 Feedback;
+
+uniform float streamId;
+uniform vec2 textureSize0;      // texels of level 0
+uniform float lodBias;          // log2 of the screen pixels per feedback pixel
+
+#ifdef CUBE_FEEDBACK
+in vec3 TexCoords;
+
+float RequestedLod()
+{
+    // a face spans 90 degrees with size texels, about size / 2 texels per radian at its center
+    vec3 direction = normalize(TexCoords);
+    float radians = max(length(dFdx(direction)), length(dFdy(direction)));
+    return log2(radians * textureSize0.x * 0.5);
+}
+#else
+in vec2 TexCoords;
+
+float RequestedLod()
+{
+    vec2 texels = TexCoords * textureSize0;
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    return 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+}
+#endif
+
+void main()
+{
+    float lod = clamp(floor(RequestedLod() - lodBias), 0.0, 15.0);
+    Feedback = vec2(streamId, lod) / 255.0;
+}
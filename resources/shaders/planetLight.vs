@@ -1,20 +1,19 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aTexCoords;
+#include "lib/vertex.glsl"
 
 out vec2 TexCoords;
 out vec3 FragPos;
 out vec3 Normal;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
+    mat4 modelMatrix = ModelMatrix();
+    vec3 position = VertexPosition();
     TexCoords = aTexCoords;
-    Normal = mat3(transpose(inverse(model))) * aNormal;
-    FragPos = aPos;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    Normal = mat3(transpose(inverse(modelMatrix))) * VertexNormal();
+    FragPos = vec3(modelMatrix * vec4(position, 1.0));
+    gl_Position = projection * view * modelMatrix * vec4(position, 1.0);
+}
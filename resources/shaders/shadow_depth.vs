@@ -0,0 +1,11 @@
+#version 330 core
+#define POSITION_ONLY
+#include "lib/vertex.glsl"
+
+uniform mat4 lightSpace;
+
+void main()
+{
+    mat4 modelMatrix = ModelMatrix();
+    gl_Position = lightSpace * modelMatrix * vec4(VertexPosition(), 1.0);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+in vec3 WorldPos;
+
+uniform vec3 lightPosition;
+uniform float farPlane;
+
+void main()
+{
+    // linear distance, so the cached cube can be compared against from a nearby light position
+    gl_FragDepth = length(WorldPos - lightPosition) / farPlane;
+}
@@ -0,0 +1,34 @@
+#version 330 core
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 18) out;
+
+uniform mat4 faceMatrices[6];
+
+out vec3 WorldPos;
+
+void main()
+{
+    for (int face = 0; face < 6; ++face)
+    {
+        vec4 clip[3];
+        for (int i = 0; i < 3; ++i)
+            clip[i] = faceMatrices[face] * gl_in[i].gl_Position;
+        // skip the faces the triangle is entirely outside of on one side
+        bvec3 left = bvec3(clip[0].x < -clip[0].w, clip[1].x < -clip[1].w, clip[2].x < -clip[2].w);
+        bvec3 right = bvec3(clip[0].x > clip[0].w, clip[1].x > clip[1].w, clip[2].x > clip[2].w);
+        bvec3 bottom = bvec3(clip[0].y < -clip[0].w, clip[1].y < -clip[1].w, clip[2].y < -clip[2].w);
+        bvec3 top = bvec3(clip[0].y > clip[0].w, clip[1].y > clip[1].w, clip[2].y > clip[2].w);
+        bvec3 behind = bvec3(clip[0].w <= 0.0, clip[1].w <= 0.0, clip[2].w <= 0.0);
+        if (all(left) || all(right) || all(bottom) || all(top) || all(behind))
+            continue;
+
+        gl_Layer = face;
+        for (int i = 0; i < 3; ++i)
+        {
+            WorldPos = gl_in[i].gl_Position.xyz;
+            gl_Position = clip[i];
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
@@ -0,0 +1,20 @@
+#version 330 core
+#define POSITION_ONLY
+#include "lib/vertex.glsl"
+
+// LAYERED leaves the projection to shadow_point.gs, which draws all six faces
+#ifndef LAYERED
+uniform mat4 faceMatrix;
+out vec3 WorldPos;
+#endif
+
+void main()
+{
+    mat4 modelMatrix = ModelMatrix();
+#ifdef LAYERED
+    gl_Position = modelMatrix * vec4(VertexPosition(), 1.0);
+#else
+    WorldPos = vec3(modelMatrix * vec4(VertexPosition(), 1.0));
+    gl_Position = faceMatrix * vec4(WorldPos, 1.0);
+#endif
+}
@@ -8,4 +8,4 @@ uniform samplerCube skyboxTex;
 void main()
 {
     FragColor = texture(skyboxTex, TexCoords);
-}
\ No newline at end of file
+}
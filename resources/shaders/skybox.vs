@@ -1,14 +1,13 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-
+// One triangle covering the screen at the far plane; the corners are unprojected to world
+// directions, which interpolate linearly because the view has no translation.
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+uniform mat4 inverseViewProjection;
 
 void main()
 {
-    TexCoords = aPos;
-    vec4 pos = projection * view * vec4(aPos, 1.0);
-    gl_Position = pos.xyww;
-}
\ No newline at end of file
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    TexCoords = (inverseViewProjection * vec4(corner, 1.0, 1.0)).xyz;
+    gl_Position = vec4(corner, 1.0, 1.0);
+}
@@ -14,8 +14,35 @@
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
 //#include <rg/Camera.h>
-
+#include <rg/GpuTimer.h>
+#include <rg/ShaderWatcher.h>
+#include <rg/ClusteredLighting.h>
+#include <rg/DeferredRenderer.h>
+#include <rg/CascadedShadowMaps.h>
+#include <rg/PointShadowMap.h>
+#include <rg/ImageBasedLighting.h>
+#include <rg/Skybox.h>
+#include <rg/CubemapImporter.h>
+#include <rg/VertexPacking.h>
+#include <rg/MultiDraw.h>
+#include <rg/LodSelector.h>
+#include <rg/Meshlets.h>
+#include <rg/TextureArrays.h>
+#include <rg/TextureCache.h>
+#include <rg/GpuMemory.h>
+#include <rg/MipStreaming.h>
+#include <rg/JobSystem.h>
+#include <rg/SceneTransforms.h>
+#include <rg/SceneFile.h>
+
+#include <dirent.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <thread>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
@@ -26,7 +53,6 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
-unsigned int loadCubemap(vector<std::string> faces);
 unsigned int loadTexture(const char *path, bool gammaCorrection);
 //unsigned int loadTexture(const char *path);
 void renderQuad();
@@ -50,6 +76,127 @@ bool bloom = false;
 bool bloomKeyPressed = false;
 float exposure = 1.2f;
 
+// performance
+// false compiles the lighting shaders with the old per-fragment blinn branch, for comparison
+bool specializedShaders = true;
+rg::GpuTimer halconTimer;
+rg::GpuTimer planetTimer;
+// engine glow lights of an escort fleet around the planet, lit through the clustered path
+int escortLightCount = 0;
+// G-buffer + light volumes instead of lighting every fragment in the model shaders
+bool deferredShading = false;
+rg::GpuTimer deferredTimer;
+rg::GpuTimer deferredLightingTimer;
+
+// light sweep, started from the performance window: every escort light count is rendered
+// with both paths for a while and the averages are printed to stdout
+struct RendererBenchmark {
+    bool running = false;
+    int step = 0;
+    int frame = 0;
+    double frameMs = 0.0;
+    double gpuMs = 0.0;
+    double megabytes = 0.0;
+    int savedLightCount = 0;
+    bool savedDeferred = false;
+};
+RendererBenchmark rendererBenchmark;
+// cascaded shadow maps of the planet's directional light
+bool shadows = true;
+int shadowCascades = 4;
+int shadowResolution = 2048;
+rg::GpuTimer shadowTimers[rg::CascadedShadowMaps::MAX_CASCADES];
+// cube shadows of the light that follows the ship
+bool pointShadows = true;
+bool pointShadowCaching = true;
+bool pointShadowLayered = true;
+rg::GpuTimer pointShadowTimer;
+// ambient light baked from the skybox; the buttons in the performance window only raise a
+// request, the render loop does the work where the sky and the prefilter shader are in scope
+bool imageBasedLighting = true;
+float iblIntensity = 0.6f;
+bool iblRebakeRequested = false;
+bool iblReloadRequested = false;
+// how the models keep their vertices on the GPU; changing it re-uploads them
+rg::VertexLayout vertexLayout{rg::VertexLayout::SNORM16, false};
+size_t vertexBufferBytes = 0;
+// 16-bit indices for meshes whose vertex ranges fit, off draws everything with 32-bit ones
+bool compactIndices = true;
+size_t indexBufferBytes = 0;
+// one glMultiDrawElementsIndirect per pass instead of a draw call per mesh, GL 4.3 only
+bool multiDraw = false;
+bool submissionBenchmarkRequested = false;
+// simplified meshes for models that are small on screen, picked per model every frame
+bool levelsOfDetail = true;
+rg::LodSelector lodSelector;
+struct LodStats {
+    int lod = 0;
+    size_t drawn = 0;
+    size_t full = 0;
+};
+LodStats shipTriangles, planetTriangles;
+// forward and G-buffer draws of the ship and the planet skip meshlets outside the view or facing away
+bool meshletCulling = true;
+bool meshletSimd = true;
+rg::MeshletStats meshletStats;
+// the ship's diffuse maps as layers of texture arrays, so its meshes share texture binds
+bool textureArrays = true;
+size_t shipTextureArrays = 0;
+size_t textureBinds = 0;
+size_t halconTextureBinds = 0;
+// file textures lose their top mips, least recently bound first, while GPU memory is over this; 0 is off
+int gpuMemoryBudgetMB = 0;
+// sky picked in the performance window
+int skyboxIndex = 0;
+rg::GpuTimer skyboxTimer;
+// the skies and the planet texture start with their small mips and load finer ones as the view
+// asks for them, see rg::MipStreaming; read at startup
+bool mipStreaming = true;
+// camera path from far away down to the planet and around it, started from the performance
+// window; resident streamed texture memory is printed along the way
+struct Flythrough {
+    bool running = false;
+    int frame = 0;
+    size_t peakBytes = 0;
+    double averageBytes = 0.0;
+    glm::vec3 savedPosition;
+    float savedYaw = 0.0f;
+    float savedPitch = 0.0f;
+};
+Flythrough flythrough;
+// what is drawn comes from a scene file in resources/scenes, picked in the performance window and
+// loaded again when it is saved, see rg::SceneFile. Models stay loaded by path across scenes, so a
+// reload only reads the models it didn't have.
+const char* const DEFAULT_SCENE = "resources/scenes/space.scene";
+struct SceneBindings {
+    int ship = -1;
+    int planet = -1;
+    int sunAnchor = -1;
+    int engineAnchor = -1;
+    rg::SceneLight sun;
+    rg::SceneLight engine;
+    // per object, null for pivots
+    std::vector<Model*> models;
+    // model space bounds for culling shadow casters, per object
+    std::vector<glm::vec4> bounds;
+    // objects with a model that are neither the ship nor the planet
+    std::vector<int> props;
+};
+rg::SceneFile sceneFile;
+rg::SceneDescription scene;
+SceneBindings sceneBindings;
+rg::SceneTransforms sceneTransforms;
+std::map<std::string, Model*> sceneModels;
+std::map<std::string, unsigned int> planetTextures;
+unsigned int planetTex = 0;
+std::vector<std::string> sceneFiles;
+int sceneFileIndex = 0;
+bool sceneReloadRequested = false;
+// what the loaded models were last set to, the render loop brings them up to date
+rg::VertexLayout modelLayout;
+bool modelCompactIndices = compactIndices;
+bool modelTextureArrays = textureArrays;
+
 
 // timing
 float deltaTime = 0.0f;
@@ -126,9 +273,108 @@ void ProgramState::LoadFromFile(std::string filename) {
 }
 
 ProgramState *programState;
+rg::ClusteredLighting *clusteredLighting;
+rg::DeferredRenderer *deferredRenderer;
+rg::CascadedShadowMaps *cascadedShadows;
+rg::PointShadowMap *pointShadowMap;
+rg::ImageBasedLighting *ibl;
+rg::Skybox *skybox;
+rg::MultiDrawBatch *shadowBatch;
+rg::MultiDrawBatch *shipBatch;
+rg::MipStreaming *mipStreamer;
 
 
 void DrawImGui(ProgramState *programState);
+void startRendererBenchmark();
+void runSubmissionBenchmark(Model& model, Shader& depthShader, const glm::mat4& lightSpace, const glm::mat4& transform);
+void drawVisible(Model& model, Shader& shader, const glm::mat4& projectionView, const glm::mat4& transform);
+void runMeshletBenchmark();
+void runMemoryStress();
+void runJobBenchmark();
+void runTransformBenchmark();
+void startFlythrough();
+void updateFlythrough(const glm::vec3& planetPosition, float planetRadius, GLuint planetTexture);
+void updateRendererBenchmark();
+bool loadScene(const std::string& path);
+std::vector<std::string> listScenes(const std::string& directory);
+float worldScale(const glm::mat4& transform);
+
+// adds the vertex layout permutation every shader that reads model vertices needs
+std::vector<std::string> vertexDefines(std::vector<std::string> defines = {}) {
+    if (vertexLayout.packed())
+        defines.push_back("PACKED_VERTICES");
+    return defines;
+}
+
+// shaders that draw through a rg::MultiDrawBatch read their transforms from its draw buffer
+std::vector<std::string> batchedDefines(std::vector<std::string> defines) {
+    if (multiDraw)
+        defines.push_back("MULTI_DRAW");
+    return defines;
+}
+
+// the ship's shaders read its material from texture arrays when they are on
+std::vector<std::string> materialDefines(std::vector<std::string> defines) {
+    if (textureArrays)
+        defines.push_back("TEXTURE_ARRAYS");
+    return defines;
+}
+
+// picks the lighting shader permutation for the current toggles
+std::vector<std::string> lightingDefines(bool receivesShadows = false) {
+    std::vector<std::string> defines = vertexDefines();
+    if (!specializedShaders)
+        defines.push_back("RUNTIME_BLINN");
+    else if (blinn)
+        defines.push_back("BLINN");
+    if (bloom)
+        defines.push_back("BLOOM_OUTPUT");
+    if (escortLightCount > 0)
+        defines.push_back("CLUSTERED_LIGHTS");
+    if (shadows && receivesShadows)
+        defines.push_back("CASCADED_SHADOWS");
+    if (pointShadows && receivesShadows)
+        defines.push_back("POINT_SHADOWS");
+    if (imageBasedLighting)
+        defines.push_back("IBL");
+    return defines;
+}
+
+// light pass permutations of the deferred path; escort lights come as light volumes there
+std::vector<std::string> deferredDefines(bool lightVolume) {
+    std::vector<std::string> defines;
+    if (!specializedShaders)
+        defines.push_back("RUNTIME_BLINN");
+    else if (blinn)
+        defines.push_back("BLINN");
+    if (bloom)
+        defines.push_back("BLOOM_OUTPUT");
+    if (lightVolume)
+        defines.push_back("LIGHT_VOLUME");
+    if (shadows && !lightVolume)
+        defines.push_back("CASCADED_SHADOWS");
+    if (pointShadows && !lightVolume)
+        defines.push_back("POINT_SHADOWS");
+    if (imageBasedLighting && !lightVolume)
+        defines.push_back("IBL");
+    return defines;
+}
+
+// deterministic spread of orbits, heights and speeds so the fleet looks the same every run
+std::vector<rg::ClusterLight> escortLights(int count, glm::vec3 center, float time) {
+    std::vector<rg::ClusterLight> lights(count);
+    for (int i = 0; i < count; ++i) {
+        float a = std::fmod(i * 0.618034f, 1.0f);
+        float b = std::fmod(i * 0.381966f + 0.5f, 1.0f);
+        float c = std::fmod(i * 0.754878f, 1.0f);
+        float orbit = 34.0f + 18.0f * a;
+        float angle = 6.2831853f * i / count - time * (0.3f + 0.4f * c);
+        lights[i].position = center + glm::vec3(sin(angle) * orbit, -8.0f + 16.0f * b, cos(angle) * orbit);
+        lights[i].radius = 7.0f;
+        lights[i].color = glm::vec3(0.6f, 0.8f, 2.4f) * (0.6f + 0.8f * c);
+    }
+    return lights;
+}
 
 int main() {
     // glfw: initialize and configure
@@ -164,8 +410,13 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    rg::glext::load((GLADloadproc) glfwGetProcAddress);
+    multiDraw = rg::glext::multiDrawIndirect;
 
 
+    // the workers start here, the main thread is the job system's thread 0
+    rg::JobSystem::instance();
+
     programState = new ProgramState;
     programState->LoadFromFile("resources/program_state.txt");
     if (programState->ImGuiEnabled) {
@@ -180,8 +431,6 @@ int main() {
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 330 core");
 
-    glm::vec3 planetPosition = glm::vec3(30.0f);
-
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
@@ -197,82 +446,100 @@ int main() {
     Shader HdrShader("resources/shaders/hdr.vs", "resources/shaders/hdr.fs");
 //    Shader bloomShader("resources/shaders/bloom.vs", "resources/shaders/bloom.fs");
     Shader blurShader("resources/shaders/blur.vs", "resources/shaders/blur.fs");
+    Shader gbufferShader("resources/shaders/halcon.vs", "resources/shaders/gbuffer.fs");
+    Shader deferredLightShader("resources/shaders/deferred_light.vs", "resources/shaders/deferred_light.fs");
+    Shader shadowDepthShader("resources/shaders/shadow_depth.vs", "resources/shaders/shadow_depth.fs");
+    Shader pointShadowShader("resources/shaders/shadow_point.vs", "resources/shaders/shadow_point.fs",
+                             "resources/shaders/shadow_point.gs", {"LAYERED"});
+    Shader pointShadowFaceShader("resources/shaders/shadow_point.vs", "resources/shaders/shadow_point.fs");
+    Shader iblPrefilterShader("resources/shaders/ibl_prefilter.vs", "resources/shaders/ibl_prefilter.fs");
+    Shader mipFeedbackShader("resources/shaders/planetLight.vs", "resources/shaders/mip_feedback.fs");
+    Shader skyFeedbackShader("resources/shaders/skybox.vs", "resources/shaders/mip_feedback.fs", nullptr, {"CUBE_FEEDBACK"});
+    rg::ShaderCache::instance().report(std::cout);
+
+    // edited shader files are picked up without restarting
+    rg::ShaderWatcher shaderWatcher({"resources/shaders", "resources/shaders/lib"});
+    shaderWatcher.add(skyboxShader);
+    shaderWatcher.add(halconShader);
+    shaderWatcher.add(planetShader);
+    shaderWatcher.add(HdrShader);
+    shaderWatcher.add(blurShader);
+    shaderWatcher.add(gbufferShader);
+    shaderWatcher.add(deferredLightShader);
+    shaderWatcher.add(shadowDepthShader);
+    shaderWatcher.add(pointShadowShader);
+    shaderWatcher.add(pointShadowFaceShader);
+    shaderWatcher.add(iblPrefilterShader);
+    shaderWatcher.add(mipFeedbackShader);
+    shaderWatcher.add(skyFeedbackShader);
+
+    clusteredLighting = new rg::ClusteredLighting;
+    clusteredLighting->setViewport(SCR_WIDTH, SCR_HEIGHT);
+    deferredRenderer = new rg::DeferredRenderer(SCR_WIDTH, SCR_HEIGHT);
+    cascadedShadows = new rg::CascadedShadowMaps(shadowCascades, shadowResolution);
+    pointShadowMap = new rg::PointShadowMap(1024, 100.0f);
 
 
-    float skyboxVertices[] = {
-            // aPos
-            -1.0f,  1.0f, -1.0f,
-            -1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f,  -1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f,  1.0f, -1.0f,
-            -1.0f,  1.0f, -1.0f,
-
-            -1.0f, -1.0f,  1.0f,
-            -1.0f, -1.0f, -1.0f,
-            -1.0f,  1.0f, -1.0f,
-            -1.0f,  1.0f, -1.0f,
-            -1.0f,  1.0f,  1.0f,
-            -1.0f, -1.0f,  1.0f,
-
-            1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-
-            -1.0f, -1.0f,  1.0f,
-            -1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f, -1.0f,  1.0f,
-            -1.0f, -1.0f,  1.0f,
-
-            -1.0f,  1.0f, -1.0f,
-            1.0f,  1.0f, -1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            -1.0f,  1.0f,  1.0f,
-            -1.0f,  1.0f, -1.0f,
-
-            -1.0f, -1.0f, -1.0f,
-            -1.0f, -1.0f,  1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            -1.0f, -1.0f,  1.0f,
-            1.0f, -1.0f,  1.0f
-    };
-
-    // configuring Skybox
-
-    unsigned int skyboxVAO, skyboxVBO;
-    glGenVertexArrays(1, &skyboxVAO);
-    glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-
     // load textures.
-    unsigned int planetTex = loadTexture("resources/objects/planet/texture planete 01.jpg", true);
+    mipStreamer = new rg::MipStreaming(SCR_WIDTH, SCR_HEIGHT);
     unsigned int mTex = loadTexture("resources/objects/Moon/Moon.jpg", true);
 
     // order for skybox: x+, x-, y+, y-, z+, z-
     // 1 3 6 5 2 4 -> works for skybox2 :) ; also for skybox1
-    // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
-    vector<std::string> faces{
-            FileSystem::getPath("resources/textures/skybox1/1.png"),
-            FileSystem::getPath("resources/textures/skybox1/3.png"),
-            FileSystem::getPath("resources/textures/skybox1/6.png"),
-            FileSystem::getPath("resources/textures/skybox1/5.png"),
-            FileSystem::getPath("resources/textures/skybox1/2.png"),
-            FileSystem::getPath("resources/textures/skybox1/4.png")
+    // those two are stored upside down, the others use the usual right/left/top/bottom/front/back.
+    // A single cross or equirectangular image (.hdr too) works as well, see rg::CubemapSource.
+    // All of them are uploaded now so switching skies at runtime loads nothing.
+    struct SkySource {
+        const char* name;
+        rg::CubemapSource source;
     };
-    stbi_set_flip_vertically_on_load(true);
+    auto sixFaces = [](const std::string& prefix, std::initializer_list<const char*> names,
+                       const std::string& extension, bool flip) {
+        rg::CubemapSource source;
+        source.layout = rg::CubemapSource::FACES;
+        source.flip = flip;
+        for (const char* name : names)
+            source.files.push_back(FileSystem::getPath(prefix + name + extension));
+        return source;
+    };
+    vector<SkySource> skies{
+            {"skybox1", sixFaces("resources/textures/skybox1/", {"1", "3", "6", "5", "2", "4"}, ".png", true)},
+            {"skybox2", sixFaces("resources/textures/skybox2/", {"1", "3", "6", "5", "2", "4"}, ".png", true)},
+            {"skybox3", sixFaces("resources/textures/skybox3/corona_", {"rt", "lf", "up", "dn", "ft", "bk"}, ".png", false)},
+            {"galaxy", sixFaces("resources/textures/galaxy/galaxy", {"+X", "-X", "+Y", "-Y", "+Z", "-Z"}, ".tga", false)},
+    };
+
+    skybox = new rg::Skybox;
+    rg::CubemapImporter cubemapImporter;
+    // where the streamed skies' finer levels come from, the IBL bake reads level 0 there
+    vector<rg::BakedMips> skyMips(skies.size());
+    for (size_t i = 0; i < skies.size(); ++i) {
+        const SkySource& sky = skies[i];
+        GLuint texture = cubemapImporter.import(sky.source, mipStreaming);
+        skybox->add(sky.name, texture);
+        const rg::CubemapImporter::Stats& stats = cubemapImporter.stats();
+        if (texture && mipStreaming) {
+            skyMips[i] = cubemapImporter.bakedMips();
+            mipStreamer->add(texture, cubemapImporter.bakedMips(), stats.firstMip, "skyboxes");
+        }
+        std::cout << "Cubemap " << sky.name << ": " << stats.faceSize << "px " << (stats.hdr ? "RGB16F" : "RGB8")
+                  << ", " << stats.mips << " mips, " << stats.bytes / (1024.0 * 1024.0) << " MB, ";
+        if (stats.fromCache)
+            std::cout << "cache ";
+        else
+            std::cout << "decode " << stats.decodeMilliseconds << " ms, convert " << stats.convertMilliseconds << " ms, ";
+        std::cout << "upload " << stats.uploadMilliseconds << " ms, total " << stats.totalMilliseconds << " ms"
+                  << std::endl;
+    }
+    // model textures are flipped on the y-axis by rg::TextureCache, see MODEL_TEXTURE_FLIP in model.h
 
-    unsigned int cubemapTexture = loadCubemap(faces);
+    // ambient light from the sky, baked once per sky and then loaded from resources/ibl_cache
+    ibl = new rg::ImageBasedLighting;
+    shadowBatch = new rg::MultiDrawBatch(false);
+    shipBatch = new rg::MultiDrawBatch(true);
+    int iblSky = skybox->current();
+    ibl->load(skybox->texture(), rg::ImageBasedLighting::sourceKey(skies[iblSky].source.files), iblPrefilterShader,
+              false, &skyMips[iblSky]);
 
     // configure framebuffers.
 
@@ -286,6 +553,8 @@ int main() {
     {
         glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+        rg::GpuMemory::instance().track(rg::GpuMemory::TEXTURE, colorBuffers[i], rg::textureBytes(SCR_WIDTH, SCR_HEIGHT, 8),
+                                        "hdr and bloom");
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -296,7 +565,10 @@ int main() {
     unsigned int rboDepth;
     glGenRenderbuffers(1, &rboDepth);
     glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
+    // sized, the deferred path blits its G-buffer depth (DEPTH24) in here
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SCR_WIDTH, SCR_HEIGHT);
+    rg::GpuMemory::instance().track(rg::GpuMemory::RENDERBUFFER, rboDepth, rg::textureBytes(SCR_WIDTH, SCR_HEIGHT, 4),
+                                    "hdr and bloom");
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
     unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
     glDrawBuffers(2, attachments);
@@ -314,6 +586,8 @@ int main() {
         glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
         glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+        rg::GpuMemory::instance().track(rg::GpuMemory::TEXTURE, pingpongColorbuffers[i],
+                                        rg::textureBytes(SCR_WIDTH, SCR_HEIGHT, 8), "hdr and bloom");
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -330,9 +604,6 @@ int main() {
     skyboxShader.use();
     skyboxShader.setInt("skyboxTex", 0);
 
-    planetShader.use();
-    planetShader.setInt("tex", 4);
-
     HdrShader.use();
     HdrShader.setInt("hdrBuffer", 0);
     HdrShader.setInt("bloomBlur", 1);
@@ -347,25 +618,22 @@ int main() {
 
     // load and configure models.
     // -----------
-    Model deathStar2("resources/objects/planet/planet.obj");
-    deathStar2.SetShaderTextureNamePrefix("material.");
-    Model shipHalcon("resources/objects/halcon/Halcon_Milenario.obj");
-    shipHalcon.SetShaderTextureNamePrefix("material.");
-    Model deathStar("resources/objects/Moon/Moon.obj");
-    deathStar.SetShaderTextureNamePrefix("material.");
+    sceneFiles = listScenes("resources/scenes");
+    auto defaultScene = std::find(sceneFiles.begin(), sceneFiles.end(), std::string(DEFAULT_SCENE));
+    sceneFileIndex = defaultScene != sceneFiles.end() ? (int) (defaultScene - sceneFiles.begin()) : 0;
+    if (!loadScene(DEFAULT_SCENE)) {
+        std::cout << "Failed to load " << DEFAULT_SCENE << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    const rg::TextureCache::Stats& textureStats = rg::TextureCache::instance().stats();
+    std::cout << "Texture cache: " << textureStats.requests << " requests, " << textureStats.uploads << " uploads, "
+              << textureStats.pathHits << " repeated paths, " << textureStats.contentHits << " duplicate images, "
+              << textureStats.bytesSaved / (1024.0 * 1024.0) << " MB not uploaded again" << std::endl;
 
     // TODO : fix later.
 
-
     PointLight& planetLight = programState->pointLight; // for planet
-    planetLight.position = glm::vec3(30.0f, 30.0f, 30.0f);
-    planetLight.ambient = glm::vec3(0.42f);
-    planetLight.diffuse = glm::vec3(0.39f);
-    planetLight.specular = glm::vec3(2.7f);
-
-    planetLight.constant = 1.0f;
-    planetLight.linear = 0.07f;
-    planetLight.quadratic = 0.0016f;
 
 
     // draw in wireframe
@@ -383,6 +651,48 @@ int main() {
         // input
         // -----
         processInput(window);
+        shaderWatcher.poll();
+        // another scene picked in the performance window, or the current one saved
+        if (sceneReloadRequested || sceneFile.changed()) {
+            loadScene(sceneReloadRequested ? sceneFiles[sceneFileIndex] : sceneFile.path());
+            sceneReloadRequested = false;
+        }
+        Model& shipHalcon = *sceneBindings.models[sceneBindings.ship];
+        Model& deathStar = *sceneBindings.models[sceneBindings.planet];
+        glm::vec4 halconBounds = sceneBindings.bounds[sceneBindings.ship];
+        glm::vec4 deathStarBounds = sceneBindings.bounds[sceneBindings.planet];
+        skybox->select(skyboxIndex);
+        if (vertexLayout != modelLayout) {
+            size_t before = 0;
+            vertexBufferBytes = 0;
+            for (auto& loaded : sceneModels) {
+                before += loaded.second->VertexBufferBytes();
+                loaded.second->SetVertexLayout(vertexLayout);
+                vertexBufferBytes += loaded.second->VertexBufferBytes();
+            }
+            modelLayout = vertexLayout;
+            std::cout << "Vertex buffers: " << before / (1024.0 * 1024.0) << " MB -> "
+                      << vertexBufferBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+        }
+        if (compactIndices != modelCompactIndices) {
+            indexBufferBytes = 0;
+            for (auto& loaded : sceneModels) {
+                loaded.second->SetCompactIndices(compactIndices);
+                indexBufferBytes += loaded.second->IndexBufferBytes();
+            }
+            modelCompactIndices = compactIndices;
+        }
+        if (textureArrays != modelTextureArrays) {
+            shipHalcon.SetTextureArrays(textureArrays);
+            shipTextureArrays = shipHalcon.TextureArrayCount();
+            modelTextureArrays = textureArrays;
+        }
+        if (iblRebakeRequested || iblReloadRequested || iblSky != skybox->current()) {
+            iblSky = skybox->current();
+            ibl->load(skybox->texture(), rg::ImageBasedLighting::sourceKey(skies[iblSky].source.files), iblPrefilterShader,
+                      iblRebakeRequested, &skyMips[iblSky]);
+            iblRebakeRequested = iblReloadRequested = false;
+        }
 
 
         // render
@@ -397,109 +707,412 @@ int main() {
 //        pointLight.diffuse += glm::vec3(counter  * 0.002f);
 //        pointLight.specular += glm::vec3(counter  * 0.002f);
 
-        glm::vec3 halconPosition = glm::vec3(planetPosition.x + sin(-currentFrame/2)*41.0f, 26.5f, planetPosition.z + cos(-currentFrame/2) * 41.0f);
-
-        glDepthFunc(GL_LESS);
-
-        // render the ship.
-        halconShader.use();
-        halconShader.setVec3("pointLight.position", glm::vec3(halconPosition.x, 32.0f, halconPosition.z));
-//        halconShader.setVec3("pointLight.position", glm::vec3(10.0f * cos(currentFrame), 7.0f, 10.0f * sin(currentFrame)));
-        halconShader.setVec3("pointLight.ambient", glm::vec3(0.44f, 0.44f, 0.44f) + glm::vec3(counter * 0.05f));
-        halconShader.setVec3("pointLight.diffuse", glm::vec3(0.8f, 0.8f, 0.8f) + glm::vec3(counter * 0.05f));
-        halconShader.setVec3("pointLight.specular", glm::vec3(1.6f, 1.6f, 1.6f) + glm::vec3(counter * 0.05f));
-        halconShader.setFloat("pointLight.constant", 1.0f);
-        halconShader.setFloat("pointLight.linear", 0.09f);
-        halconShader.setFloat("pointLight.quadratic", 0.032f);
-        halconShader.setVec3("viewPosition", programState->camera.Position);
-        halconShader.setFloat("material.shininess", 32.0f);
+        // objects with a spin in the scene file turn, in space.scene the ship goes round the planet
+        scene.animate(sceneTransforms, currentFrame);
+        sceneTransforms.update();
+        glm::mat4 halconModel = sceneTransforms.world(sceneBindings.ship);
+        glm::mat4 planetModel = sceneTransforms.world(sceneBindings.planet);
+        float halconScale = worldScale(halconModel);
+        float planetScale = worldScale(planetModel);
+        glm::vec3 planetPosition = glm::vec3(planetModel[3]);
+        if (flythrough.running)
+            updateFlythrough(planetPosition, deathStarBounds.w * planetScale, planetTex);
+
+        const rg::SceneLight& sun = sceneBindings.sun;
+        const rg::SceneLight& engine = sceneBindings.engine;
+        glm::vec3 engineAnchor = glm::vec3(sceneTransforms.world(sceneBindings.engineAnchor)[3]);
+        glm::vec3 halconLightPosition = glm::vec3(engineAnchor.x, engine.height, engineAnchor.z);
+        glm::vec3 sunAnchor = glm::vec3(sceneTransforms.world(sceneBindings.sunAnchor)[3]);
+        glm::vec3 planetLightDirection = sunAnchor + glm::vec3(cos(sun.speed * currentFrame), 0.0f,
+                                                               sin(sun.speed * currentFrame));
+
         // view/projection transformations
         glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
                                                 (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 400.0f);
         glm::mat4 view = programState->camera.GetViewMatrix();
 
-        // make ship go round.
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, halconPosition);
-        model = glm::rotate(model, currentFrame / 4, glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.015f));
-
-        halconShader.use();
-        halconShader.setMat4("projection", projection);
-        halconShader.setMat4("view", view);
-        halconShader.setMat4("model", model);
-
-//        halconShader.setVec3("dirLight.direction", halconPosition);
-//        halconShader.setVec3("dirLight.direction", programState->camera.Position);
-//        halconShader.setVec3("dirLight.direction", glm::vec3(planetPosition.x + cos(currentFrame), planetPosition.y, planetPosition.z + sin(currentFrame)));
-        halconShader.setVec3("dirLight.ambient", glm::vec3(0.57f));
-        halconShader.setVec3("dirLight.diffuse", glm::vec3(0.75f));
-        halconShader.setVec3("dirLight.specular", glm::vec3(0.85f));
-        halconShader.setBool("blinn", blinn);
-
-        glEnable(GL_CULL_FACE);
-        glDepthFunc(GL_LESS);
-        glCullFace(GL_BACK);
-        shipHalcon.Draw(halconShader);
-        glDisable(GL_CULL_FACE);
-
-        // render the deathstar.
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, planetPosition);
-        model = glm::rotate(model, currentFrame / 6, glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(3.06f));
-
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, planetTex);
+        // through the bindings, so the memory budget sees the planet texture used every frame
+        rg::TextureBindings::instance().bind(4, GL_TEXTURE_2D, planetTex);
 //        glBindTexture(GL_TEXTURE_2D, mTex);
 
         planetLight.diffuse += glm::vec3(counter * 0.009f);
         planetLight.ambient += glm::vec3(counter * 0.009f);
         planetLight.specular += glm::vec3(counter * 0.009f);
 
-        glDepthFunc(GL_LESS);
-        planetShader.use();
-        planetShader.setVec3("dirLight.direction", glm::vec3(planetPosition.x + cos(currentFrame), planetPosition.y, planetPosition.z + sin(currentFrame)));
-        planetShader.setVec3("dirLight.ambient", glm::vec3(0.42f) + glm::vec3(counter * 0.17f));
-        planetShader.setVec3("dirLight.diffuse", glm::vec3(0.65f) + glm::vec3(counter * 0.17f));
-        planetShader.setVec3("dirLight.specular", glm::vec3(0.85f));
-
-        planetShader.setVec3("pointLight.position", glm::vec3(halconPosition.x, 32.0f, halconPosition.z));
-        planetShader.setVec3("pointLight.ambient", planetLight.ambient);
-        planetShader.setVec3("pointLight.diffuse", planetLight.diffuse);
-        planetShader.setVec3("pointLight.specular", planetLight.specular);
-        planetShader.setFloat("pointLight.constant", planetLight.constant);
-        planetShader.setFloat("pointLight.linear", planetLight.linear);
-        planetShader.setFloat("pointLight.quadratic", planetLight.quadratic);
-        planetShader.setVec3("viewPos", programState->camera.Position);
-//        planetShader.setVec3("lightPos", planetPosition);
-        planetShader.setBool("blinn", blinn);
-        planetShader.setMat4("projection", projection);
-        planetShader.setMat4("view", view);
-        planetShader.setMat4("model", model);
-//        deathStar2.Draw(planetShader);
-        deathStar.Draw(planetShader);
-        // render another planet?
-
-
-        //draw skybox as last
-        glDepthFunc(GL_LEQUAL);
-        skyboxShader.use();
-        model = glm::mat4(1.0f);
-        projection = glm::perspective(glm::radians(programState->camera.Zoom),
-                                                (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix()));
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); //depth function back to normal state.
+        // shadow maps of the directional light, every cascade only draws the casters inside it.
+        glm::vec3 halconCenter = glm::vec3(halconModel * glm::vec4(glm::vec3(halconBounds), 1.0f));
+        glm::vec3 planetCenter = glm::vec3(planetModel * glm::vec4(glm::vec3(deathStarBounds), 1.0f));
+        std::vector<glm::vec4> propSpheres;
+        for (int prop : sceneBindings.props) {
+            const glm::mat4& world = sceneTransforms.world(prop);
+            glm::vec4 bounds = sceneBindings.bounds[prop];
+            propSpheres.push_back(glm::vec4(glm::vec3(world * glm::vec4(glm::vec3(bounds), 1.0f)),
+                                            bounds.w * worldScale(world)));
+        }
+        // the shadow passes draw the same LOD as the camera sees
+        float fovY = glm::radians(programState->camera.Zoom);
+        int halconLod = shipTriangles.lod, planetLod = planetTriangles.lod;
+        if (levelsOfDetail) {
+            float halconPixels = rg::LodSelector::pixelsPerUnit(glm::length(halconCenter - programState->camera.Position),
+                                                                halconBounds.w * halconScale, halconScale, fovY, SCR_HEIGHT);
+            float planetPixels = rg::LodSelector::pixelsPerUnit(glm::length(planetCenter - programState->camera.Position),
+                                                                deathStarBounds.w * planetScale, planetScale, fovY, SCR_HEIGHT);
+            halconLod = lodSelector.select(shipHalcon, halconPixels, halconLod);
+            planetLod = lodSelector.select(deathStar, planetPixels, planetLod);
+        } else {
+            halconLod = planetLod = 0;
+        }
+        shipHalcon.SetLod(halconLod);
+        deathStar.SetLod(planetLod);
+        shipTriangles.lod = halconLod;
+        shipTriangles.drawn = shipHalcon.TriangleCount();
+        planetTriangles.lod = planetLod;
+        planetTriangles.drawn = deathStar.TriangleCount();
+        // which levels of the streamed textures the view needs: the planet and the sky, with the
+        // ship only occluding them
+        if (mipStreaming && mipStreamer->beginFeedback()) {
+            Shader& feedback = mipFeedbackShader.variant(vertexDefines());
+            feedback.use();
+            feedback.setMat4("projection", projection);
+            feedback.setMat4("view", view);
+            feedback.setMat4("model", halconModel);
+            mipStreamer->streamTo(feedback, 0);
+            shipHalcon.Draw(feedback);
+            feedback.setMat4("model", planetModel);
+            mipStreamer->streamTo(feedback, planetTex);
+            deathStar.Draw(feedback);
+            Shader& skyFeedback = skyFeedbackShader.variant({"CUBE_FEEDBACK"});
+            skyFeedback.use();
+            mipStreamer->streamTo(skyFeedback, skybox->texture());
+            skybox->drawDirections(skyFeedback, projection, view);
+            mipStreamer->endFeedback(hdrFBO);
+        }
+        if (mipStreaming)
+            mipStreamer->update();
+        meshletStats = rg::MeshletStats();
+        textureBinds = rg::TextureBindings::instance().binds();
+        rg::TextureBindings::instance().resetBinds();
+        if (shadows) {
+            cascadedShadows->configure(shadowCascades, shadowResolution);
+            cascadedShadows->update(view, glm::radians(programState->camera.Zoom), (float) SCR_WIDTH / (float) SCR_HEIGHT,
+                                    0.1f, planetLightDirection);
+            Shader& shadowDepth = shadowDepthShader.variant(batchedDefines(vertexDefines()));
+            shadowDepth.use();
+            glDepthFunc(GL_LESS);
+            if (submissionBenchmarkRequested) {
+                // draws into the first cascade, which the loop below clears again
+                cascadedShadows->beginCascade(0);
+                runSubmissionBenchmark(shipHalcon, shadowDepthShader, cascadedShadows->matrix(0), halconModel);
+                submissionBenchmarkRequested = false;
+                shadowDepth.use();
+            }
+            for (int i = 0; i < cascadedShadows->cascadeCount(); ++i) {
+                shadowTimers[i].begin();
+                cascadedShadows->beginCascade(i);
+                shadowDepth.setMat4("lightSpace", cascadedShadows->matrix(i));
+                bool halconVisible = cascadedShadows->casterVisible(i, halconCenter, halconBounds.w * halconScale);
+                bool planetVisible = cascadedShadows->casterVisible(i, planetCenter, deathStarBounds.w * planetScale);
+                if (multiDraw) {
+                    shadowBatch->clear();
+                    if (halconVisible)
+                        shadowBatch->add(shipHalcon, halconModel);
+                    if (planetVisible)
+                        shadowBatch->add(deathStar, planetModel);
+                    for (size_t p = 0; p < propSpheres.size(); ++p) {
+                        if (cascadedShadows->casterVisible(i, glm::vec3(propSpheres[p]), propSpheres[p].w))
+                            shadowBatch->add(*sceneBindings.models[sceneBindings.props[p]],
+                                             sceneTransforms.world(sceneBindings.props[p]));
+                    }
+                    shadowBatch->submit(shadowDepth, 14);
+                } else {
+                    if (halconVisible) {
+                        shadowDepth.setMat4("model", halconModel);
+                        shipHalcon.Draw(shadowDepth);
+                    }
+                    if (planetVisible) {
+                        shadowDepth.setMat4("model", planetModel);
+                        deathStar.Draw(shadowDepth);
+                    }
+                    for (size_t p = 0; p < propSpheres.size(); ++p) {
+                        if (cascadedShadows->casterVisible(i, glm::vec3(propSpheres[p]), propSpheres[p].w)) {
+                            shadowDepth.setMat4("model", sceneTransforms.world(sceneBindings.props[p]));
+                            sceneBindings.models[sceneBindings.props[p]]->Draw(shadowDepth);
+                        }
+                    }
+                }
+                shadowTimers[i].end();
+            }
+            cascadedShadows->endPass(hdrFBO);
+        }
+
+        // cube shadows of the ship light. Objects that don't move, nor any of their parents, can
+        // stay in the cache of static casters.
+        if (pointShadows) {
+            std::vector<rg::ShadowCaster> casters = {
+                rg::ShadowCaster{halconCenter, halconBounds.w * halconScale, halconModel,
+                                 !scene.animated(sceneBindings.ship),
+                                 [&shipHalcon](Shader& shader) { shipHalcon.Draw(shader); }},
+                rg::ShadowCaster{planetCenter, deathStarBounds.w * planetScale, planetModel,
+                                 !scene.animated(sceneBindings.planet),
+                                 [&deathStar](Shader& shader) { deathStar.Draw(shader); }},
+            };
+            for (size_t p = 0; p < propSpheres.size(); ++p) {
+                Model* model = sceneBindings.models[sceneBindings.props[p]];
+                casters.push_back(rg::ShadowCaster{glm::vec3(propSpheres[p]), propSpheres[p].w,
+                                                   sceneTransforms.world(sceneBindings.props[p]),
+                                                   !scene.animated(sceneBindings.props[p]),
+                                                   [model](Shader& shader) { model->Draw(shader); }});
+            }
+            if (pointShadowMap->caching() != pointShadowCaching)
+                pointShadowMap->setCaching(pointShadowCaching);
+            pointShadowMap->setLayered(pointShadowLayered);
+            pointShadowTimer.begin();
+            pointShadowMap->render(halconLightPosition, casters, pointShadowShader.variant(vertexDefines({"LAYERED"})),
+                                   pointShadowFaceShader.variant(vertexDefines()), hdrFBO);
+            pointShadowTimer.end();
+        }
+
+        std::vector<rg::ClusterLight> escorts;
+        if (escortLightCount > 0)
+            escorts = escortLights(escortLightCount, planetPosition, currentFrame);
+
+        if (deferredShading) {
+            // geometry pass: surfaces only, no lighting.
+            glDepthFunc(GL_LESS);
+            deferredTimer.begin();
+            deferredRenderer->beginGeometryPass();
+            Shader& gbufferHalcon = gbufferShader.variant(materialDefines(batchedDefines(vertexDefines())));
+            gbufferHalcon.use();
+            gbufferHalcon.setMat4("projection", projection);
+            gbufferHalcon.setMat4("view", view);
+            gbufferHalcon.setMat4("model", halconModel);
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_BACK);
+            if (multiDraw) {
+                shipBatch->clear();
+                shipBatch->add(shipHalcon, halconModel);
+                shipBatch->submit(gbufferHalcon, 14);
+            } else {
+                drawVisible(shipHalcon, gbufferHalcon, projection * view, halconModel);
+            }
+            glDisable(GL_CULL_FACE);
+
+            Shader& gbufferPlanet = gbufferShader.variant(vertexDefines({"SINGLE_TEXTURE"}));
+            gbufferPlanet.use();
+            gbufferPlanet.setInt("tex", 4);
+            gbufferPlanet.setMat4("projection", projection);
+            gbufferPlanet.setMat4("view", view);
+            gbufferPlanet.setMat4("model", planetModel);
+            drawVisible(deathStar, gbufferPlanet, projection * view, planetModel);
+
+            // props with their own materials; those sharing the ship's model read its texture arrays
+            for (int arrays = 0; arrays < 2; ++arrays) {
+                Shader& gbufferProps = gbufferShader.variant(arrays ? materialDefines(vertexDefines()) : vertexDefines());
+                bool bound = false;
+                for (int prop : sceneBindings.props) {
+                    Model& model = *sceneBindings.models[prop];
+                    if ((&model == &shipHalcon) != (arrays == 1))
+                        continue;
+                    if (!bound) {
+                        gbufferProps.use();
+                        gbufferProps.setMat4("projection", projection);
+                        gbufferProps.setMat4("view", view);
+                        bound = true;
+                    }
+                    gbufferProps.setMat4("model", sceneTransforms.world(prop));
+                    drawVisible(model, gbufferProps, projection * view, sceneTransforms.world(prop));
+                }
+            }
+            deferredRenderer->endGeometryPass(hdrFBO);
+            deferredTimer.end();
+
+            // lighting pass: the planet's lights once over the whole screen, then the escort
+            // lights added over the screen rectangles they cover.
+            deferredLightingTimer.begin();
+            glDisable(GL_DEPTH_TEST);
+            glDisable(GL_BLEND);
+            Shader& sceneLights = deferredLightShader.variant(deferredDefines(false));
+            sceneLights.use();
+            deferredRenderer->bind(sceneLights, projection, view, 0);
+            sceneLights.setVec3("dirLight.direction", planetLightDirection);
+            sceneLights.setVec3("dirLight.ambient", sun.ambient + glm::vec3(counter * 0.17f));
+            sceneLights.setVec3("dirLight.diffuse", sun.diffuse + glm::vec3(counter * 0.17f));
+            sceneLights.setVec3("dirLight.specular", sun.specular);
+            sceneLights.setVec3("pointLight.position", halconLightPosition);
+            sceneLights.setVec3("pointLight.ambient", planetLight.ambient);
+            sceneLights.setVec3("pointLight.diffuse", planetLight.diffuse);
+            sceneLights.setVec3("pointLight.specular", planetLight.specular);
+            sceneLights.setFloat("pointLight.constant", planetLight.constant);
+            sceneLights.setFloat("pointLight.linear", planetLight.linear);
+            sceneLights.setFloat("pointLight.quadratic", planetLight.quadratic);
+            // the ship's surfaces get the colors its forward shader is lit with
+            sceneLights.setVec3("shipDirLight.direction", planetLightDirection);
+            sceneLights.setVec3("shipDirLight.ambient", sun.shipAmbient);
+            sceneLights.setVec3("shipDirLight.diffuse", sun.shipDiffuse);
+            sceneLights.setVec3("shipDirLight.specular", sun.shipSpecular);
+            sceneLights.setVec3("shipPointLight.position", halconLightPosition);
+            sceneLights.setVec3("shipPointLight.ambient", (engine.shipAmbient + glm::vec3(counter * 0.05f)) * 1.2f);
+            sceneLights.setVec3("shipPointLight.diffuse", engine.shipDiffuse + glm::vec3(counter * 0.05f));
+            sceneLights.setVec3("shipPointLight.specular", engine.shipSpecular + glm::vec3(counter * 0.05f));
+            sceneLights.setFloat("shipPointLight.constant", engine.shipAttenuation.x);
+            sceneLights.setFloat("shipPointLight.linear", engine.shipAttenuation.y);
+            sceneLights.setFloat("shipPointLight.quadratic", engine.shipAttenuation.z);
+            sceneLights.setVec3("viewPosition", programState->camera.Position);
+            // BLINN_SHININESS and PHONG_SHININESS of planetLight.fs
+            sceneLights.setFloat("shininess", blinn ? 32.0f : 8.0f);
+            sceneLights.setFloat("shipShininess", 32.0f);
+            if (!specializedShaders)
+                sceneLights.setBool("blinn", blinn);
+            if (shadows)
+                cascadedShadows->bind(sceneLights, 11);
+            if (pointShadows)
+                pointShadowMap->bind(sceneLights, 12);
+            if (imageBasedLighting)
+                ibl->bind(sceneLights, 13, iblIntensity);
+            deferredRenderer->drawFullscreen();
+
+            if (!escorts.empty()) {
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE);
+                Shader& volumeLights = deferredLightShader.variant(deferredDefines(true));
+                volumeLights.use();
+                deferredRenderer->bind(volumeLights, projection, view, 0);
+                volumeLights.setVec3("viewPosition", programState->camera.Position);
+                volumeLights.setFloat("shininess", blinn ? 32.0f : 8.0f);
+                volumeLights.setFloat("shipShininess", 32.0f);
+                if (!specializedShaders)
+                    volumeLights.setBool("blinn", blinn);
+                deferredRenderer->drawLightVolumes(escorts, projection, view, 0.1f);
+            }
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glEnable(GL_DEPTH_TEST);
+            deferredLightingTimer.end();
+        } else {
+            glDepthFunc(GL_LESS);
+
+            // render the ship.
+            if (escortLightCount > 0) {
+                clusteredLighting->setProjection(projection, 0.1f, 400.0f);
+                clusteredLighting->update(escorts, view);
+            }
+            // the props are lit like the ship
+            auto shipLighting = [&](Shader& shader) {
+                shader.setVec3("pointLight.position", halconLightPosition);
+//                halconShader.setVec3("pointLight.position", glm::vec3(10.0f * cos(currentFrame), 7.0f, 10.0f * sin(currentFrame)));
+                // the ship used to scale its point light ambient by 1.2 in the shader
+                shader.setVec3("pointLight.ambient", (engine.shipAmbient + glm::vec3(counter * 0.05f)) * 1.2f);
+                shader.setVec3("pointLight.diffuse", engine.shipDiffuse + glm::vec3(counter * 0.05f));
+                shader.setVec3("pointLight.specular", engine.shipSpecular + glm::vec3(counter * 0.05f));
+                shader.setFloat("pointLight.constant", engine.shipAttenuation.x);
+                shader.setFloat("pointLight.linear", engine.shipAttenuation.y);
+                shader.setFloat("pointLight.quadratic", engine.shipAttenuation.z);
+                shader.setVec3("viewPosition", programState->camera.Position);
+                shader.setFloat("material.shininess", 32.0f);
+
+                if (escortLightCount > 0)
+                    clusteredLighting->bind(shader, view, 8);
+                if (imageBasedLighting)
+                    ibl->bind(shader, 13, iblIntensity);
+
+                shader.setMat4("projection", projection);
+                shader.setMat4("view", view);
+
+//                halconShader.setVec3("dirLight.direction", halconPosition);
+//                halconShader.setVec3("dirLight.direction", programState->camera.Position);
+//                halconShader.setVec3("dirLight.direction", glm::vec3(planetPosition.x + cos(currentFrame), planetPosition.y, planetPosition.z + sin(currentFrame)));
+                // the sun's direction; unset it was a zero vector the shader normalized
+                shader.setVec3("dirLight.direction", planetLightDirection);
+                shader.setVec3("dirLight.ambient", sun.shipAmbient);
+                shader.setVec3("dirLight.diffuse", sun.shipDiffuse);
+                shader.setVec3("dirLight.specular", sun.shipSpecular);
+                if (!specializedShaders)
+                    shader.setBool("blinn", blinn);
+            };
+            Shader& halcon = halconShader.variant(materialDefines(batchedDefines(lightingDefines())));
+            halcon.use();
+            shipLighting(halcon);
+            halcon.setMat4("model", halconModel);
+
+            glEnable(GL_CULL_FACE);
+            glDepthFunc(GL_LESS);
+            glCullFace(GL_BACK);
+            halconTimer.begin();
+            size_t bindsBefore = rg::TextureBindings::instance().binds();
+            if (multiDraw) {
+                shipBatch->clear();
+                shipBatch->add(shipHalcon, halconModel);
+                shipBatch->submit(halcon, 14);
+            } else {
+                drawVisible(shipHalcon, halcon, projection * view, halconModel);
+            }
+            halconTextureBinds = rg::TextureBindings::instance().binds() - bindsBefore;
+            halconTimer.end();
+
+            for (int arrays = 0; arrays < 2; ++arrays) {
+                Shader& props = halconShader.variant(arrays ? materialDefines(lightingDefines()) : lightingDefines());
+                bool bound = false;
+                for (int prop : sceneBindings.props) {
+                    Model& model = *sceneBindings.models[prop];
+                    if ((&model == &shipHalcon) != (arrays == 1))
+                        continue;
+                    if (!bound) {
+                        props.use();
+                        shipLighting(props);
+                        bound = true;
+                    }
+                    props.setMat4("model", sceneTransforms.world(prop));
+                    drawVisible(model, props, projection * view, sceneTransforms.world(prop));
+                }
+            }
+            glDisable(GL_CULL_FACE);
+
+            // render the deathstar.
+            glDepthFunc(GL_LESS);
+            Shader& planet = planetShader.variant(lightingDefines(true));
+            planet.use();
+            planet.setInt("tex", 4);
+            planet.setVec3("dirLight.direction", planetLightDirection);
+            planet.setVec3("dirLight.ambient", sun.ambient + glm::vec3(counter * 0.17f));
+            planet.setVec3("dirLight.diffuse", sun.diffuse + glm::vec3(counter * 0.17f));
+            planet.setVec3("dirLight.specular", sun.specular);
+
+            planet.setVec3("pointLight.position", halconLightPosition);
+            planet.setVec3("pointLight.ambient", planetLight.ambient);
+            planet.setVec3("pointLight.diffuse", planetLight.diffuse);
+            planet.setVec3("pointLight.specular", planetLight.specular);
+            planet.setFloat("pointLight.constant", planetLight.constant);
+            planet.setFloat("pointLight.linear", planetLight.linear);
+            planet.setFloat("pointLight.quadratic", planetLight.quadratic);
+            planet.setVec3("viewPos", programState->camera.Position);
+//            planetShader.setVec3("lightPos", planetPosition);
+            if (!specializedShaders)
+                planet.setBool("blinn", blinn);
+            if (escortLightCount > 0)
+                clusteredLighting->bind(planet, view, 8);
+            if (shadows)
+                cascadedShadows->bind(planet, 11);
+            if (pointShadows)
+                pointShadowMap->bind(planet, 12);
+            if (imageBasedLighting)
+                ibl->bind(planet, 13, iblIntensity);
+            planet.setMat4("projection", projection);
+            planet.setMat4("view", view);
+            planet.setMat4("model", planetModel);
+//            deathStar2.Draw(planetShader);
+            planetTimer.begin();
+            drawVisible(deathStar, planet, projection * view, planetModel);
+            planetTimer.end();
+            // render another planet?
+        }
+
+        updateRendererBenchmark();
+
+
+        //draw skybox as last, only where no model was drawn.
+        skyboxTimer.begin();
+        skybox->draw(skyboxShader, projection, view, SCR_WIDTH, SCR_HEIGHT);
+        skyboxTimer.end();
 
 //
         // 2. blur
@@ -540,6 +1153,9 @@ int main() {
 //        if (programState->ImGuiEnabled)
             DrawImGui(programState);
 
+        // after the frame's binds, so the textures it used count as recently used
+        rg::GpuMemory::instance().setBudget((size_t) gpuMemoryBudgetMB << 20);
+        rg::GpuMemory::instance().update();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
@@ -547,10 +1163,19 @@ int main() {
         glfwPollEvents();
     }
 
-    glDeleteVertexArrays(1, &skyboxVAO);
-    glDeleteBuffers(1, &skyboxVAO);
     programState->SaveToFile("resources/program_state.txt");
     delete programState;
+    delete clusteredLighting;
+    delete deferredRenderer;
+    delete cascadedShadows;
+    delete pointShadowMap;
+    delete ibl;
+    delete shadowBatch;
+    delete shipBatch;
+    delete mipStreamer;
+    rg::GeometryArena::releaseAll();
+    rg::TextureCache::instance().releaseAll();
+    delete skybox;
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -668,6 +1293,212 @@ void DrawImGui(ProgramState *programState) {
 
     }
 
+    {
+        ImGui::Begin("Performance");
+        ImGui::Text("Frame: %.2f ms", deltaTime * 1000.0f);
+        const rg::ShaderCache::Stats& shaderStats = rg::ShaderCache::instance().stats();
+        ImGui::Text("Shaders: %.1f ms (%u cached, %u compiled)", shaderStats.milliseconds, shaderStats.hits, shaderStats.compiled);
+        ImGui::Checkbox("Specialized lighting shaders", &specializedShaders);
+        ImGui::Checkbox("Deferred shading", &deferredShading);
+        if (deferredShading) {
+            ImGui::Text("Geometry pass: %.3f ms GPU", deferredTimer.milliseconds());
+            ImGui::Text("Lighting pass: %.3f ms GPU", deferredLightingTimer.milliseconds());
+            ImGui::Text("G-buffer: %d B/pixel, %.1f MB", rg::DeferredRenderer::GBUFFER_BYTES_PER_PIXEL,
+                        deferredRenderer->gbufferBytes() / 1.0e6);
+            ImGui::Text("Light volumes: %zu on screen, %.2f Mpixels", deferredRenderer->visibleLights(),
+                        deferredRenderer->volumePixels() / 1.0e6);
+            ImGui::Text("Estimated traffic: %.1f MB/frame", deferredRenderer->estimatedBytes() / 1.0e6);
+        } else {
+            ImGui::Text("Halcon pass: %.3f ms GPU", halconTimer.milliseconds());
+            ImGui::Text("Planet pass: %.3f ms GPU", planetTimer.milliseconds());
+        }
+
+        // a scene file may ask for a count of its own, the list then shows it next to the presets
+        std::vector<int> lightCounts = { 0, 16, 256, 1024 };
+        if (std::find(lightCounts.begin(), lightCounts.end(), escortLightCount) == lightCounts.end())
+            lightCounts.insert(std::upper_bound(lightCounts.begin(), lightCounts.end(), escortLightCount), escortLightCount);
+        std::vector<std::string> lightCountLabels;
+        std::vector<const char*> lightCountNames;
+        int selected = 0;
+        for (size_t i = 0; i < lightCounts.size(); ++i) {
+            lightCountLabels.push_back(std::to_string(lightCounts[i]));
+            if (lightCounts[i] == escortLightCount)
+                selected = (int) i;
+        }
+        for (const std::string& label : lightCountLabels)
+            lightCountNames.push_back(label.c_str());
+        if (ImGui::Combo("Escort lights", &selected, lightCountNames.data(), (int) lightCountNames.size()))
+            escortLightCount = lightCounts[selected];
+        if (escortLightCount > 0 && !deferredShading) {
+            ImGui::Text("Light assignment: %.3f ms CPU", clusteredLighting->assignMilliseconds());
+            ImGui::Text("Cluster light indices: %zu", clusteredLighting->indexCount());
+            if (clusteredLighting->droppedIndices())
+                ImGui::Text("Dropped indices: %zu", clusteredLighting->droppedIndices());
+        }
+        ImGui::Checkbox("Shadows", &shadows);
+        if (shadows) {
+            ImGui::SliderInt("Cascades", &shadowCascades, 1, rg::CascadedShadowMaps::MAX_CASCADES);
+            const int resolutions[] = { 512, 1024, 2048, 4096 };
+            const char* resolutionNames[] = { "512", "1024", "2048", "4096" };
+            int resolution = 0;
+            for (int i = 0; i < 4; ++i)
+                if (resolutions[i] == shadowResolution)
+                    resolution = i;
+            if (ImGui::Combo("Shadow map size", &resolution, resolutionNames, 4))
+                shadowResolution = resolutions[resolution];
+            for (int i = 0; i < cascadedShadows->cascadeCount(); ++i)
+                ImGui::Text("Cascade %d (to %.1f): %.3f ms GPU", i, cascadedShadows->split(i), shadowTimers[i].milliseconds());
+        }
+        ImGui::Checkbox("Ship light shadows", &pointShadows);
+        if (pointShadows) {
+            ImGui::Checkbox("Single pass (geometry shader)", &pointShadowLayered);
+            ImGui::Checkbox("Cache static casters", &pointShadowCaching);
+            ImGui::Text("Cube shadow pass: %.3f ms GPU, %u casters drawn", pointShadowTimer.milliseconds(),
+                        pointShadowMap->drawnCasters());
+            if (pointShadowCaching)
+                ImGui::Text("Static cache rebuilds: %u (%s)", pointShadowMap->cacheRebuilds(),
+                            pointShadowMap->cacheHit() ? "hit"
+                            : pointShadowMap->cacheRebuilt() ? "rebuilt"
+                            : pointShadowMap->lightMoving() ? "skipped, the light moves faster than the bias"
+                            : "no static casters");
+        }
+        // the shadow passes only fetch positions, their timings above show the vertex fetch cost
+        int positions = vertexLayout.positions;
+        const char* positionNames[] = { "32-bit float (56 B)", "16-bit normalized", "16-bit half float" };
+        if (ImGui::Combo("Vertex format", &positions, positionNames, 3))
+            vertexLayout.positions = (rg::VertexLayout::Positions) positions;
+        if (vertexLayout.packed())
+            ImGui::Checkbox("Tangent stream", &vertexLayout.tangents);
+        ImGui::Text("Vertex buffers: %.2f MB", vertexBufferBytes / (1024.0 * 1024.0));
+        ImGui::Checkbox("16-bit indices", &compactIndices);
+        ImGui::Text("Index buffers: %.2f MB", indexBufferBytes / (1024.0 * 1024.0));
+        // one vertex and index buffer pair per format, shared by all meshes in it
+        rg::GeometryArena::forEach([&](const rg::GeometryArena& arena) {
+            ImGui::Text("Arena %s%s: %.2f + %.2f of %.2f MB, %zu free blocks", positionNames[arena.layout().positions],
+                        arena.layout().packed() && arena.layout().tangents ? " + tangents" : "", arena.vertexBytes() / (1024.0 * 1024.0),
+                        arena.indexBytes() / (1024.0 * 1024.0), arena.capacityBytes() / (1024.0 * 1024.0),
+                        arena.freeBlocks());
+        });
+        ImGui::Checkbox("Levels of detail", &levelsOfDetail);
+        if (levelsOfDetail) {
+            ImGui::SliderFloat("LOD pixel error", &lodSelector.pixelError, 0.25f, 8.0f);
+            ImGui::SliderFloat("LOD hysteresis", &lodSelector.hysteresis, 0.0f, 0.5f);
+        }
+        ImGui::Text("Ship LOD %d, planet LOD %d", shipTriangles.lod, planetTriangles.lod);
+        ImGui::Text("Triangles per scene pass: %zu (%zu at full detail)", shipTriangles.drawn + planetTriangles.drawn,
+                    shipTriangles.full + planetTriangles.full);
+        if (rg::glext::multiDrawIndirect) {
+            ImGui::Checkbox("Multi-draw indirect", &multiDraw);
+            if (multiDraw)
+                ImGui::Text("Shadow batch: %zu draws", shadowBatch->drawCount());
+        } else {
+            ImGui::Text("Multi-draw indirect: needs GL 4.3");
+        }
+        // runs in the shadow pass, results go to stdout
+        if (shadows && ImGui::Button("Draw submission benchmark"))
+            submissionBenchmarkRequested = true;
+        ImGui::Checkbox("Texture arrays (ship)", &textureArrays);
+        if (textureArrays)
+            ImGui::Text("Ship textures: %zu arrays", shipTextureArrays);
+        ImGui::Text("Texture binds: %zu last frame, %zu in the forward ship pass", textureBinds, halconTextureBinds);
+        ImGui::Checkbox("Meshlet culling", &meshletCulling);
+        if (meshletCulling) {
+            ImGui::Checkbox("SIMD meshlet culling", &meshletSimd);
+            ImGui::Text("Meshlets: %zu, %zu outside the frustum, %zu facing away", meshletStats.meshlets,
+                        meshletStats.frustumCulled, meshletStats.coneCulled);
+            ImGui::Text("Meshlet triangles: %zu of %zu drawn in %zu ranges", meshletStats.trianglesDrawn,
+                        meshletStats.triangles, meshletStats.ranges);
+        }
+        if (ImGui::Button("Meshlet culling benchmark"))
+            runMeshletBenchmark();
+        const rg::TextureCache& textureCache = rg::TextureCache::instance();
+        ImGui::Text("Texture cache: %zu textures, %.2f MB; %zu duplicate hits saved %.2f MB", textureCache.textureCount(),
+                    textureCache.residentBytes() / (1024.0 * 1024.0),
+                    textureCache.stats().pathHits + textureCache.stats().contentHits,
+                    textureCache.stats().bytesSaved / (1024.0 * 1024.0));
+        const rg::GpuMemory& gpuMemory = rg::GpuMemory::instance();
+        ImGui::Text("GPU memory: %.1f MB in %zu allocations (textures %.1f, buffers %.1f, renderbuffers %.1f)",
+                    gpuMemory.total() / (1024.0 * 1024.0), gpuMemory.allocationCount(),
+                    gpuMemory.total(rg::GpuMemory::TEXTURE) / (1024.0 * 1024.0),
+                    gpuMemory.total(rg::GpuMemory::BUFFER) / (1024.0 * 1024.0),
+                    gpuMemory.total(rg::GpuMemory::RENDERBUFFER) / (1024.0 * 1024.0));
+        if (ImGui::TreeNode("GPU memory by owner")) {
+            for (const auto& owner : gpuMemory.byOwner()) {
+                size_t bytes = owner.second[rg::GpuMemory::TEXTURE] + owner.second[rg::GpuMemory::BUFFER]
+                               + owner.second[rg::GpuMemory::RENDERBUFFER];
+                ImGui::Text("%-20s %8.2f MB", owner.first.c_str(), bytes / (1024.0 * 1024.0));
+            }
+            ImGui::TreePop();
+        }
+        ImGui::SliderInt("GPU memory budget (MB, 0 = off)", &gpuMemoryBudgetMB, 0, 1024);
+        ImGui::Text("Textures with dropped mips: %zu of %zu; %zu evictions, %zu restorations",
+                    gpuMemory.degradedCount(), gpuMemory.evictableCount(), gpuMemory.stats().evictions,
+                    gpuMemory.stats().restorations);
+        if (ImGui::Button("GPU memory stress"))
+            runMemoryStress();
+        if (ImGui::BeginCombo("Sky", skybox->name(skyboxIndex).c_str())) {
+            for (int i = 0; i < skybox->count(); ++i) {
+                if (ImGui::Selectable(skybox->name(i).c_str(), i == skyboxIndex))
+                    skyboxIndex = i;
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::Text("Sky: %.3f ms GPU, %.0f%% of the screen rejected by depth (%.0f px shaded)",
+                    skyboxTimer.milliseconds(), skybox->rejectedFraction() * 100.0, skybox->shadedPixels());
+        if (mipStreaming) {
+            const rg::MipStreaming::Stats& streamingStats = mipStreamer->stats();
+            ImGui::Text("Streamed textures: %zu, %.2f of %.2f MB resident; %zu levels loaded, %zu dropped",
+                        mipStreamer->streamCount(), mipStreamer->residentBytes() / (1024.0 * 1024.0),
+                        mipStreamer->fullBytes() / (1024.0 * 1024.0), streamingStats.levelsLoaded,
+                        streamingStats.levelsDropped);
+            ImGui::Text("Sky level %d", mipStreamer->residentLevel(skybox->texture()));
+            if (flythrough.running)
+                ImGui::Text("Flythrough running (%d frames)...", flythrough.frame);
+            else if (ImGui::Button("Streaming flythrough"))
+                startFlythrough();
+        }
+        ImGui::Checkbox("Sky ambient (IBL)", &imageBasedLighting);
+        if (imageBasedLighting) {
+            ImGui::SliderFloat("Sky intensity", &iblIntensity, 0.0f, 2.0f);
+            const rg::ImageBasedLighting::Timings& iblTimings = ibl->timings();
+            if (iblTimings.fromCache)
+                ImGui::Text("Loaded from cache in %.2f ms", iblTimings.loadMilliseconds);
+            else
+                ImGui::Text("Baked in %.2f ms: SH %.2f ms (%u threads), prefilter %.2f ms",
+                            iblTimings.bakeMilliseconds, iblTimings.shMilliseconds, iblTimings.threads,
+                            iblTimings.prefilterMilliseconds);
+            if (ImGui::Button("Rebake"))
+                iblRebakeRequested = true;
+            ImGui::SameLine();
+            if (ImGui::Button("Reload from cache"))
+                iblReloadRequested = true;
+        }
+        if (!sceneFiles.empty() && ImGui::BeginCombo("Scene", sceneFiles[sceneFileIndex].c_str())) {
+            for (int i = 0; i < (int) sceneFiles.size(); ++i) {
+                if (ImGui::Selectable(sceneFiles[i].c_str(), i == sceneFileIndex)) {
+                    sceneFileIndex = i;
+                    sceneReloadRequested = true;
+                }
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::Text("Scene: %zu objects, %zu props, %zu models, %s in %.2f ms", scene.objects.size(),
+                    sceneBindings.props.size(), sceneModels.size(),
+                    sceneFile.stats().fromCache ? "loaded from cache" : "parsed", sceneFile.stats().milliseconds);
+        if (ImGui::Button("Reload scene"))
+            sceneReloadRequested = true;
+        ImGui::Text("Job system: %u threads", rg::JobSystem::instance().threadCount());
+        if (ImGui::Button("Job system benchmark"))
+            runJobBenchmark();
+        if (ImGui::Button("Transform benchmark"))
+            runTransformBenchmark();
+        if (rendererBenchmark.running)
+            ImGui::Text("Light sweep running (%d/8)...", rendererBenchmark.step + 1);
+        else if (ImGui::Button("Run light sweep"))
+            startRendererBenchmark();
+        ImGui::End();
+    }
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
@@ -733,116 +1564,17 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 }
 
 
-unsigned int loadCubemap(vector<std::string> faces)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    return textureID;
-}
-
+// textures main.cpp loads itself; the cache shares them with any model using the same image
 unsigned int loadTexture(char const * path, bool gammaCorrection)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum internalFormat;
-        GLenum dataFormat;
-        if (nrComponents == 1)
-        {
-            internalFormat = dataFormat = GL_RED;
-        }
-        else if (nrComponents == 3)
-        {
-            internalFormat = gammaCorrection ? GL_SRGB : GL_RGB;
-            dataFormat = GL_RGB;
-        }
-        else if (nrComponents == 4)
-        {
-            internalFormat = gammaCorrection ? GL_SRGB_ALPHA : GL_RGBA;
-            dataFormat = GL_RGBA;
-        }
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path:: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    rg::TextureSettings settings;
+    settings.srgb = gammaCorrection;
+    return rg::TextureCache::instance().acquire(path, settings);
 }
 
 unsigned int loadTexture(char const * path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return loadTexture(path, false);
 }
 
 
@@ -865,6 +1597,7 @@ void renderQuad()
         glBindVertexArray(quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+        rg::GpuMemory::instance().track(rg::GpuMemory::BUFFER, quadVBO, sizeof(quadVertices), "hdr and bloom");
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
@@ -873,4 +1606,632 @@ void renderQuad()
     glBindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
     glBindVertexArray(0);
-}
\ No newline at end of file
+}
+
+// forward and deferred at every escort light count, 8 steps
+static const int BENCHMARK_LIGHT_COUNTS[] = { 0, 16, 256, 1024 };
+static const int BENCHMARK_WARMUP_FRAMES = 60;
+static const int BENCHMARK_SAMPLE_FRAMES = 120;
+
+void applyRendererBenchmarkStep(int step) {
+    escortLightCount = BENCHMARK_LIGHT_COUNTS[step / 2];
+    deferredShading = step % 2 == 1;
+    rendererBenchmark.frame = 0;
+    rendererBenchmark.frameMs = 0.0;
+    rendererBenchmark.gpuMs = 0.0;
+    rendererBenchmark.megabytes = 0.0;
+}
+
+void startRendererBenchmark() {
+    rendererBenchmark.running = true;
+    rendererBenchmark.step = 0;
+    rendererBenchmark.savedLightCount = escortLightCount;
+    rendererBenchmark.savedDeferred = deferredShading;
+    applyRendererBenchmarkStep(0);
+    std::cout << "lights  path      frame ms  lighting GPU ms  est. MB/frame" << std::endl;
+}
+
+// called once per frame after the scene is lit
+void updateRendererBenchmark() {
+    RendererBenchmark& b = rendererBenchmark;
+    if (!b.running)
+        return;
+    // the GPU timers are smoothed, give them and the light volumes time to settle first
+    if (b.frame >= BENCHMARK_WARMUP_FRAMES) {
+        b.frameMs += deltaTime * 1000.0;
+        if (deferredShading) {
+            b.gpuMs += deferredTimer.milliseconds() + deferredLightingTimer.milliseconds();
+            b.megabytes += deferredRenderer->estimatedBytes() / 1.0e6;
+        } else {
+            b.gpuMs += halconTimer.milliseconds() + planetTimer.milliseconds();
+        }
+    }
+    if (++b.frame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_SAMPLE_FRAMES)
+        return;
+
+    std::cout << std::fixed << std::setprecision(2)
+              << std::setw(6) << escortLightCount << "  "
+              << std::setw(8) << std::left << (deferredShading ? "deferred" : "forward") << std::right
+              << std::setw(10) << b.frameMs / BENCHMARK_SAMPLE_FRAMES
+              << std::setw(17) << b.gpuMs / BENCHMARK_SAMPLE_FRAMES;
+    // forward writes depend on overdraw and are not estimated
+    if (deferredShading)
+        std::cout << std::setw(15) << b.megabytes / BENCHMARK_SAMPLE_FRAMES;
+    else
+        std::cout << std::setw(15) << "-";
+    std::cout << std::defaultfloat << std::endl;
+
+    if (++b.step < 8) {
+        applyRendererBenchmarkStep(b.step);
+    } else {
+        b.running = false;
+        escortLightCount = b.savedLightCount;
+        deferredShading = b.savedDeferred;
+    }
+}
+
+// at least this many depth-only draws, as copies of one model
+static const size_t SUBMISSION_BENCHMARK_DRAWS = 10240;
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// CPU time to submit the same draws one call per mesh and as one multi-draw batch. The depth
+// shader is the base shader, its variants are compiled and both paths run once before timing.
+// "submit" stops when the last call returns, "finished" after glFinish.
+void runSubmissionBenchmark(Model& model, Shader& depthShader, const glm::mat4& lightSpace, const glm::mat4& transform) {
+    size_t drawsPerCopy = 0;
+    for (const Mesh& mesh : model.meshes)
+        drawsPerCopy += mesh.IndexRangeCount();
+    if (drawsPerCopy == 0)
+        return;
+    size_t copies = (SUBMISSION_BENCHMARK_DRAWS + drawsPerCopy - 1) / drawsPerCopy;
+    int side = (int) std::ceil(std::sqrt((double) copies));
+    std::vector<glm::mat4> transforms(copies);
+    for (size_t i = 0; i < copies; ++i) {
+        glm::vec3 offset((float) ((int) i % side - side / 2), 0.0f, (float) ((int) i / side - side / 2));
+        transforms[i] = glm::translate(glm::mat4(1.0f), offset * 2.0f) * transform;
+    }
+
+    Shader& single = depthShader.variant(vertexDefines());
+    auto drawSingle = [&]() {
+        single.use();
+        single.setMat4("lightSpace", lightSpace);
+        for (const glm::mat4& m : transforms) {
+            single.setMat4("model", m);
+            model.Draw(single);
+        }
+    };
+    drawSingle();
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    drawSingle();
+    double singleSubmit = millisecondsSince(start);
+    glFinish();
+    double singleFinished = millisecondsSince(start);
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "Draw submission, " << copies * drawsPerCopy << " draws (" << copies << " x " << drawsPerCopy << ")" << std::endl
+              << "  per mesh     submit " << std::setw(8) << singleSubmit << " ms  finished " << std::setw(8) << singleFinished << " ms" << std::endl;
+    if (!rg::glext::multiDrawIndirect) {
+        std::cout << "  multi-draw   not supported by this context (needs GL 4.3)" << std::defaultfloat << std::endl;
+        return;
+    }
+
+    Shader& batched = depthShader.variant(vertexDefines({"MULTI_DRAW"}));
+    double buildMs = 0.0;
+    auto drawBatched = [&]() {
+        auto build = std::chrono::steady_clock::now();
+        shadowBatch->clear();
+        for (const glm::mat4& m : transforms)
+            shadowBatch->add(model, m);
+        buildMs = millisecondsSince(build);
+        batched.use();
+        batched.setMat4("lightSpace", lightSpace);
+        shadowBatch->resetCallCount();
+        shadowBatch->submit(batched, 14);
+    };
+    drawBatched();
+    glFinish();
+    start = std::chrono::steady_clock::now();
+    drawBatched();
+    double batchedSubmit = millisecondsSince(start);
+    glFinish();
+    double batchedFinished = millisecondsSince(start);
+    std::cout << "  multi-draw   submit " << std::setw(8) << batchedSubmit << " ms  finished " << std::setw(8) << batchedFinished
+              << " ms  (" << buildMs << " ms building, " << shadowBatch->multiDrawCalls() << " calls)"
+              << std::defaultfloat << std::endl;
+}
+
+// Model::Draw, or with meshlet culling only the meshlets the camera may see
+void drawVisible(Model& model, Shader& shader, const glm::mat4& projectionView, const glm::mat4& transform) {
+    if (meshletCulling)
+        model.DrawCulled(shader, projectionView, transform, programState->camera.Position, meshletStats, meshletSimd);
+    else
+        model.Draw(shader);
+}
+
+// camera positions on rings around the model, at each of these multiples of its radius
+static const float MESHLET_BENCHMARK_DISTANCES[] = { 1.5f, 3.0f, 6.0f };
+static const int MESHLET_BENCHMARK_VIEWS = 64;
+static const int MESHLET_BENCHMARK_REPEATS = 20;
+
+// Triangles the meshlet culling removes from the Death Star model, seen from every side at a
+// few distances, and the CPU time of the SIMD and scalar culling. Nothing is drawn; the model is
+// loaded on first use and kept.
+void runMeshletBenchmark() {
+    static Model* model = nullptr;
+    if (!model) {
+        model = new Model("resources/objects/deathStar/Estrella_Muerte.obj");
+        model->SetMeshlets(true);
+    }
+    glm::vec4 bounds = model->BoundingSphere();
+    glm::vec3 center(bounds);
+    glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
+                                            (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 400.0f * bounds.w);
+    glm::mat4 transform(1.0f);
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "Meshlet culling, Estrella_Muerte.obj: " << model->TriangleCount() << " triangles in "
+              << model->MeshletCount() << " meshlets, " << MESHLET_BENCHMARK_VIEWS << " views per distance" << std::endl;
+    for (float distance : MESHLET_BENCHMARK_DISTANCES) {
+        std::vector<glm::mat4> projectionViews;
+        std::vector<glm::vec3> cameras;
+        for (int i = 0; i < MESHLET_BENCHMARK_VIEWS; ++i) {
+            // around the equator and up and down over the poles
+            float angle = 6.2831853f * i / MESHLET_BENCHMARK_VIEWS;
+            float elevation = 0.6f * std::sin(3.0f * angle);
+            glm::vec3 direction(std::cos(angle) * std::cos(elevation), std::sin(elevation), std::sin(angle) * std::cos(elevation));
+            glm::vec3 camera = center + direction * distance * bounds.w;
+            // looking a little past the center, so part of the model leaves the frustum up close
+            glm::vec3 target = center + glm::vec3(-direction.z, 0.0f, direction.x) * 0.5f * bounds.w;
+            projectionViews.push_back(projection * glm::lookAt(camera, target, glm::vec3(0.0f, 1.0f, 0.0f)));
+            cameras.push_back(camera);
+        }
+
+        rg::MeshletStats stats;
+        double milliseconds[2];
+        for (int simd = 1; simd >= 0; --simd) {
+            auto start = std::chrono::steady_clock::now();
+            for (int repeat = 0; repeat < MESHLET_BENCHMARK_REPEATS; ++repeat) {
+                rg::MeshletStats run;
+                for (size_t v = 0; v < cameras.size(); ++v)
+                    model->CullMeshlets(projectionViews[v], transform, cameras[v], run, simd == 1);
+                stats = run;
+            }
+            milliseconds[simd] = millisecondsSince(start) / (MESHLET_BENCHMARK_REPEATS * cameras.size());
+        }
+        double culled = 100.0 * (stats.triangles - stats.trianglesDrawn) / std::max<size_t>(stats.triangles, 1);
+        std::cout << "  " << std::setw(4) << distance << " radii: " << std::setw(5) << culled << "% of the triangles culled ("
+                  << stats.frustumCulled * 100.0 / stats.meshlets << "% meshlets outside, "
+                  << stats.coneCulled * 100.0 / stats.meshlets << "% facing away), "
+                  << (double) stats.ranges / cameras.size() << " draw ranges per view" << std::endl
+                  << std::setprecision(4) << "        cull " << milliseconds[1] << " ms SIMD, " << milliseconds[0]
+                  << " ms scalar" << std::setprecision(1) << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
+
+// every model under resources/objects; the skies are all resident from startup anyway
+static const char* MEMORY_STRESS_MODELS[] = {
+        "resources/objects/planet/planet.obj",
+        "resources/objects/halcon/Halcon_Milenario.obj",
+        "resources/objects/deathStar/Estrella_Muerte.obj",
+        "resources/objects/vader_ship/source/Tie_Fighter_Modelo.obj",
+        "resources/objects/Moon/Moon.obj",
+};
+static const int MEMORY_STRESS_FRAMES = 240;
+// frames a quarter of the textures stays in use before the next quarter takes over
+static const int MEMORY_STRESS_PHASE = 30;
+
+void printMemoryOwners(const char* title) {
+    const rg::GpuMemory& memory = rg::GpuMemory::instance();
+    std::cout << title << ": " << memory.total() / (1024.0 * 1024.0) << " MB in " << memory.allocationCount()
+              << " allocations" << std::endl;
+    for (const auto& owner : memory.byOwner()) {
+        std::cout << "  " << std::left << std::setw(22) << owner.first << std::right
+                  << std::setw(9) << owner.second[rg::GpuMemory::TEXTURE] / (1024.0 * 1024.0) << " MB textures "
+                  << std::setw(9) << owner.second[rg::GpuMemory::BUFFER] / (1024.0 * 1024.0) << " MB buffers "
+                  << std::setw(9) << owner.second[rg::GpuMemory::RENDERBUFFER] / (1024.0 * 1024.0) << " MB renderbuffers"
+                  << std::endl;
+    }
+}
+
+// Loads every model next to the scene, then squeezes the file textures into half their size:
+// a quarter of them is bound per simulated frame, the quarter changes every MEMORY_STRESS_PHASE
+// frames, and rg::GpuMemory drops and restores mips to follow. Prints the owners before and
+// after and what the budget cost per frame. The models are loaded on first use and kept.
+void runMemoryStress() {
+    static std::vector<Model*> models;
+    if (models.empty()) {
+        for (const char* path : MEMORY_STRESS_MODELS)
+            models.push_back(new Model(path));
+    }
+    rg::GpuMemory& memory = rg::GpuMemory::instance();
+    std::cout << std::fixed << std::setprecision(2);
+    printMemoryOwners("GPU memory, all models loaded");
+
+    size_t fileTextures = rg::TextureCache::instance().residentBytes();
+    size_t budget = memory.total() - fileTextures / 2;
+    std::vector<GLuint> textures = rg::TextureCache::instance().textures();
+    rg::GpuMemory::Stats before = memory.stats();
+    memory.setBudget(budget);
+    double totalMs = 0.0, worstMs = 0.0;
+    size_t peak = 0;
+    for (int frame = 0; frame < MEMORY_STRESS_FRAMES; ++frame) {
+        size_t quarter = (size_t) (frame / MEMORY_STRESS_PHASE) % 4;
+        for (size_t i = quarter; i < textures.size(); i += 4)
+            memory.touch(textures[i]);
+        auto start = std::chrono::steady_clock::now();
+        memory.update();
+        double milliseconds = millisecondsSince(start);
+        totalMs += milliseconds;
+        worstMs = std::max(worstMs, milliseconds);
+        peak = std::max(peak, memory.total());
+    }
+    glFinish();
+
+    std::cout << "Budget " << budget / (1024.0 * 1024.0) << " MB over " << MEMORY_STRESS_FRAMES << " frames: "
+              << memory.stats().evictions - before.evictions << " mips dropped ("
+              << (memory.stats().evictedBytes - before.evictedBytes) / (1024.0 * 1024.0) << " MB), "
+              << memory.stats().restorations - before.restorations << " textures restored, "
+              << memory.degradedCount() << " of " << textures.size() << " textures degraded at the end" << std::endl
+              << std::setprecision(4) << "  update " << totalMs / MEMORY_STRESS_FRAMES << " ms average, " << worstMs
+              << " ms worst; peak " << std::setprecision(2) << peak / (1024.0 * 1024.0) << " MB" << std::endl;
+    printMemoryOwners("GPU memory after the stress");
+    std::cout << std::defaultfloat;
+    // the frame loop sets the UI budget again; textures that are drawn come back under it
+    memory.setBudget((size_t) gpuMemoryBudgetMB << 20);
+}
+
+// approach from 40 planet radii down to 1.5, orbit, then look away into the sky for longer
+// than rg::MipStreaming keeps unrequested levels
+static const int FLYTHROUGH_FRAMES = 1200;
+static const int FLYTHROUGH_REPORT_FRAMES = 100;
+static const float FLYTHROUGH_FAR = 40.0f;
+static const float FLYTHROUGH_NEAR = 1.5f;
+
+void startFlythrough() {
+    flythrough = Flythrough();
+    flythrough.running = true;
+    flythrough.savedPosition = programState->camera.Position;
+    flythrough.savedYaw = programState->camera.Yaw;
+    flythrough.savedPitch = programState->camera.Pitch;
+    std::cout << "frame  distance  resident MB  planet level  sky level" << std::endl;
+}
+
+// called once per frame before the view is set up; samples what the previous frame left resident
+void updateFlythrough(const glm::vec3& planetPosition, float planetRadius, GLuint planetTexture) {
+    Flythrough& f = flythrough;
+    size_t resident = mipStreamer->residentBytes();
+    if (f.frame > 0) {
+        f.peakBytes = std::max(f.peakBytes, resident);
+        f.averageBytes += (double) resident / FLYTHROUGH_FRAMES;
+    }
+    if (f.frame == FLYTHROUGH_FRAMES) {
+        std::cout << std::fixed << std::setprecision(2) << "Streamed textures over the flythrough: "
+                  << f.averageBytes / (1024.0 * 1024.0) << " MB average, " << f.peakBytes / (1024.0 * 1024.0)
+                  << " MB peak, " << mipStreamer->fullBytes() / (1024.0 * 1024.0) << " MB with every level resident; "
+                  << mipStreamer->stats().levelsLoaded << " levels loaded, " << mipStreamer->stats().levelsDropped
+                  << " dropped, " << mipStreamer->stats().bytesRead / (1024.0 * 1024.0) << " MB read"
+                  << std::defaultfloat << std::endl;
+        programState->camera.Position = f.savedPosition;
+        programState->camera.Yaw = f.savedYaw;
+        programState->camera.Pitch = f.savedPitch;
+        programState->camera.ProcessMouseMovement(0.0f, 0.0f);
+        f.running = false;
+        return;
+    }
+
+    float t = (float) f.frame / FLYTHROUGH_FRAMES;
+    float distance = FLYTHROUGH_NEAR;
+    float angle = 0.0f;
+    if (t < 0.4f)
+        distance = FLYTHROUGH_FAR * std::pow(FLYTHROUGH_NEAR / FLYTHROUGH_FAR, t / 0.4f);
+    else
+        angle = 2.0f * std::min(t - 0.4f, 0.3f) / 0.3f;
+    glm::vec3 outward = glm::normalize(glm::vec3(std::cos(angle), 0.3f, std::sin(angle)));
+    glm::vec3 front = t < 0.7f ? -outward : glm::normalize(glm::vec3(-outward.z, 0.2f, outward.x));
+    Camera& camera = programState->camera;
+    camera.Position = planetPosition + outward * distance * planetRadius;
+    camera.Yaw = glm::degrees(std::atan2(front.z, front.x));
+    camera.Pitch = glm::degrees(std::asin(front.y));
+    camera.ProcessMouseMovement(0.0f, 0.0f);
+
+    if (f.frame % FLYTHROUGH_REPORT_FRAMES == 0)
+        std::cout << std::fixed << std::setprecision(2) << std::setw(5) << f.frame << std::setw(10) << distance
+                  << std::setw(13) << resident / (1024.0 * 1024.0) << std::setw(14)
+                  << mipStreamer->residentLevel(planetTexture) << std::setw(11)
+                  << mipStreamer->residentLevel(skybox->texture()) << std::defaultfloat << std::endl;
+    ++f.frame;
+}
+
+static const int JOB_BENCHMARK_SPAWNS = 100000;
+// spawns waited for at a time: a full job pool runs the job inline instead of queueing it
+static const int JOB_BENCHMARK_BATCH = rg::JobSystem::POOL_SIZE / 2;
+static const int JOB_BENCHMARK_CHAIN = 1000;
+static const int JOB_BENCHMARK_THREAD_SPAWNS = 1000;
+static const size_t JOB_BENCHMARK_ELEMENTS = 1 << 20;
+static const size_t JOB_BENCHMARK_GRAIN = 4096;
+static const int JOB_BENCHMARK_REPEATS = 10;
+
+// a little math per element, so the loop is bound by the cores rather than memory
+static void jobBenchmarkBody(const std::vector<float>& input, std::vector<float>& output, size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+        float x = input[i];
+        output[i] = std::sqrt(x) * std::sin(x) + std::cos(x * 0.5f);
+    }
+}
+
+// What a job costs next to a thread per task, and how a parallel-for over JOB_BENCHMARK_ELEMENTS
+// scales with the workers: a temporary rg::JobSystem per worker count, from the main thread
+// alone up to as many as the instance has. Every time is the best of JOB_BENCHMARK_REPEATS.
+void runJobBenchmark() {
+    rg::JobSystem& jobs = rg::JobSystem::instance();
+    std::cout << std::fixed << std::setprecision(1) << "Job system, " << jobs.threadCount() << " threads" << std::endl;
+
+    double spawnMs = 1e30, chainMs = 1e30;
+    for (int repeat = 0; repeat < JOB_BENCHMARK_REPEATS; ++repeat) {
+        auto start = std::chrono::steady_clock::now();
+        rg::JobCounter counter;
+        for (int i = 0; i < JOB_BENCHMARK_SPAWNS; ++i) {
+            jobs.run([]() {}, counter);
+            if ((i + 1) % JOB_BENCHMARK_BATCH == 0)
+                jobs.wait(counter);
+        }
+        jobs.wait(counter);
+        spawnMs = std::min(spawnMs, millisecondsSince(start));
+
+        // every job waits for the one before it through a counter
+        start = std::chrono::steady_clock::now();
+        std::vector<rg::JobCounter> chain(JOB_BENCHMARK_CHAIN);
+        for (int i = 0; i < JOB_BENCHMARK_CHAIN; ++i)
+            jobs.run([]() {}, chain[i], i > 0 ? &chain[i - 1] : nullptr);
+        jobs.wait(chain.back());
+        chainMs = std::min(chainMs, millisecondsSince(start));
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < JOB_BENCHMARK_THREAD_SPAWNS; ++i) {
+        std::thread thread([]() {});
+        thread.join();
+    }
+    double threadMs = millisecondsSince(start);
+    std::cout << "  empty job, spawn to done: " << spawnMs * 1e6 / JOB_BENCHMARK_SPAWNS << " ns" << std::endl
+              << "  dependent job in a chain: " << chainMs * 1e6 / JOB_BENCHMARK_CHAIN << " ns" << std::endl
+              << "  std::thread start and join: " << threadMs * 1e6 / JOB_BENCHMARK_THREAD_SPAWNS << " ns" << std::endl;
+
+    std::vector<float> input(JOB_BENCHMARK_ELEMENTS), output(JOB_BENCHMARK_ELEMENTS);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = (float) i * 0.001f;
+    double serialMs = 1e30;
+    for (int repeat = 0; repeat < JOB_BENCHMARK_REPEATS; ++repeat) {
+        start = std::chrono::steady_clock::now();
+        jobBenchmarkBody(input, output, 0, input.size());
+        serialMs = std::min(serialMs, millisecondsSince(start));
+    }
+    std::cout << "  parallel-for over " << JOB_BENCHMARK_ELEMENTS << " elements, " << JOB_BENCHMARK_GRAIN
+              << " per job; serial " << std::setprecision(3) << serialMs << " ms" << std::endl;
+    for (unsigned int workers = 0; workers < jobs.threadCount(); ++workers) {
+        rg::JobSystem system(workers);
+        auto body = [&](size_t first, size_t last) { jobBenchmarkBody(input, output, first, last); };
+        system.parallelFor(input.size(), JOB_BENCHMARK_GRAIN, body);
+        system.takeExecutedCounts();
+        double best = 1e30;
+        for (int repeat = 0; repeat < JOB_BENCHMARK_REPEATS; ++repeat) {
+            start = std::chrono::steady_clock::now();
+            system.parallelFor(input.size(), JOB_BENCHMARK_GRAIN, body);
+            best = std::min(best, millisecondsSince(start));
+        }
+        std::vector<size_t> executed = system.takeExecutedCounts();
+        size_t total = 0;
+        for (size_t count : executed)
+            total += count;
+        std::cout << std::setw(5) << workers + 1 << " threads " << std::setw(9) << best << " ms, " << std::setw(6)
+                  << std::setprecision(2) << serialMs / best << "x, main thread ran " << std::setprecision(0)
+                  << (total ? 100.0 * executed[0] / total : 100.0) << "% of the jobs" << std::setprecision(3)
+                  << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
+
+// 1000 roots with 9 children each and 10 grandchildren under every child
+static const int TRANSFORM_BENCHMARK_ROOTS = 1000;
+static const int TRANSFORM_BENCHMARK_CHILDREN = 9;
+static const int TRANSFORM_BENCHMARK_GRANDCHILDREN = 10;
+static const int TRANSFORM_BENCHMARK_REPEATS = 10;
+
+// World matrices of 100k nodes in three levels: chained glm::translate/rotate/scale for every
+// node as main() used to, and rg::SceneTransforms scalar, SIMD and SIMD over the job system.
+// The store updates after every root moved, after one in ten leaves turned and after one in a
+// hundred roots moved, which drags its 99 descendants along. Best of TRANSFORM_BENCHMARK_REPEATS.
+void runTransformBenchmark() {
+    rg::SceneTransforms transforms;
+    std::vector<glm::vec3> positions, axes, scales;
+    std::vector<float> angles;
+    std::vector<rg::SceneTransforms::Node> roots, leaves;
+    auto add = [&](rg::SceneTransforms::Node parent, float distance) {
+        rg::SceneTransforms::Node node = transforms.create(parent);
+        float angle = (float) node * 0.618f;
+        positions.push_back(glm::vec3(std::cos(angle) * distance, (float) (node % 7) * 0.1f, std::sin(angle) * distance));
+        axes.push_back(glm::vec3(0.1f * (float) (node % 3), 1.0f, 0.0f));
+        scales.push_back(glm::vec3(0.5f + (float) (node % 5) * 0.25f));
+        angles.push_back(angle);
+        transforms.setPosition(node, positions.back());
+        transforms.setRotation(node, angle, axes.back());
+        transforms.setScale(node, scales.back());
+        return node;
+    };
+    for (int root = 0; root < TRANSFORM_BENCHMARK_ROOTS; ++root) {
+        rg::SceneTransforms::Node rootNode = add(rg::SceneTransforms::NO_PARENT, 500.0f);
+        roots.push_back(rootNode);
+        for (int child = 0; child < TRANSFORM_BENCHMARK_CHILDREN; ++child) {
+            rg::SceneTransforms::Node childNode = add(rootNode, 20.0f);
+            for (int grandchild = 0; grandchild < TRANSFORM_BENCHMARK_GRANDCHILDREN; ++grandchild)
+                leaves.push_back(add(childNode, 2.0f));
+        }
+    }
+    transforms.update();
+
+    std::vector<glm::mat4> world(transforms.size());
+    double chainedMs = 1e30;
+    for (int repeat = 0; repeat < TRANSFORM_BENCHMARK_REPEATS; ++repeat) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t node = 0; node < world.size(); ++node) {
+            glm::mat4 local = glm::translate(glm::mat4(1.0f), positions[node]);
+            local = glm::rotate(local, angles[node], axes[node]);
+            local = glm::scale(local, scales[node]);
+            rg::SceneTransforms::Node parent = transforms.parent((rg::SceneTransforms::Node) node);
+            world[node] = parent == rg::SceneTransforms::NO_PARENT ? local : world[parent] * local;
+        }
+        chainedMs = std::min(chainedMs, millisecondsSince(start));
+    }
+    std::cout << std::fixed << std::setprecision(3) << "Transforms: " << transforms.size() << " nodes, "
+              << transforms.depth() << " levels, " << rg::JobSystem::instance().threadCount() << " threads" << std::endl
+              << "  chained glm, every node: " << chainedMs << " ms" << std::endl;
+
+    struct Change {
+        const char* name;
+        std::vector<rg::SceneTransforms::Node> nodes;
+    };
+    std::vector<Change> changes(3);
+    changes[0].name = "every root moved";
+    changes[0].nodes = roots;
+    changes[1].name = "1 in 10 leaves turned";
+    for (size_t i = 0; i < leaves.size(); i += 10)
+        changes[1].nodes.push_back(leaves[i]);
+    changes[2].name = "1 in 100 roots moved";
+    for (size_t i = 0; i < roots.size(); i += 100)
+        changes[2].nodes.push_back(roots[i]);
+
+    for (const Change& change : changes) {
+        double milliseconds[3] = { 1e30, 1e30, 1e30 };
+        for (int mode = 0; mode < 3; ++mode) {
+            for (int repeat = 0; repeat < TRANSFORM_BENCHMARK_REPEATS; ++repeat) {
+                for (rg::SceneTransforms::Node node : change.nodes) {
+                    angles[node] += 0.01f;
+                    transforms.setRotation(node, angles[node], axes[node]);
+                }
+                auto start = std::chrono::steady_clock::now();
+                transforms.update(mode > 0, mode > 1);
+                milliseconds[mode] = std::min(milliseconds[mode], millisecondsSince(start));
+            }
+        }
+        std::cout << "  " << std::left << std::setw(24) << change.name << std::right << std::setw(7)
+                  << transforms.updatedCount() << " nodes: scalar " << milliseconds[0] << " ms, SIMD "
+                  << milliseconds[1] << " ms, SIMD + jobs " << milliseconds[2] << " ms" << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
+
+// largest scale along the axes of a model matrix, bounding sphere radii get multiplied by it
+float worldScale(const glm::mat4& transform) {
+    return std::max(glm::length(glm::vec3(transform[0])),
+                    std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+}
+
+// the .scene files of a directory, sorted
+std::vector<std::string> listScenes(const std::string& directory) {
+    std::vector<std::string> files;
+    DIR* dir = opendir(directory.c_str());
+    if (!dir)
+        return files;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 6 && name.compare(name.size() - 6, 6, ".scene") == 0)
+            files.push_back(directory + "/" + name);
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Reads a scene file and points the render loop at it. Models and planet textures loaded for an
+// earlier scene are reused; on a broken file the current scene stays.
+bool loadScene(const std::string& path) {
+    if (!sceneFile.load(path, scene))
+        return false;
+
+    SceneBindings bindings;
+    size_t newModels = 0;
+    for (size_t i = 0; i < scene.objects.size(); ++i) {
+        std::string modelPath = scene.modelPath(i);
+        Model* model = nullptr;
+        if (!modelPath.empty()) {
+            Model*& loaded = sceneModels[modelPath];
+            if (!loaded) {
+                loaded = new Model(modelPath);
+                loaded->SetShaderTextureNamePrefix("material.");
+                loaded->SetVertexLayout(modelLayout);
+                loaded->SetCompactIndices(modelCompactIndices);
+                loaded->SetMeshlets(true);
+                vertexBufferBytes += loaded->VertexBufferBytes();
+                indexBufferBytes += loaded->IndexBufferBytes();
+                // every draw of a model reads its whole index buffer, so the sizes are also the index fetch per draw
+                size_t indexCount = 0, ranges = 0;
+                for (const Mesh& mesh : loaded->meshes) {
+                    indexCount += mesh.indices.size();
+                    ranges += mesh.IndexRangeCount();
+                }
+                std::cout << "Indices " << modelPath << ": " << indexCount / 3 << " triangles in "
+                          << loaded->meshes.size() << " meshes, " << ranges << " draws, "
+                          << indexCount * sizeof(unsigned int) / 1024.0 << " KB at 32-bit -> "
+                          << loaded->IndexBufferBytes() / 1024.0 << " KB, " << loaded->MeshletCount() << " meshlets"
+                          << std::endl;
+                ++newModels;
+            }
+            model = loaded;
+        }
+        bindings.models.push_back(model);
+        bindings.bounds.push_back(model ? model->BoundingSphere() : glm::vec4(0.0f));
+        if (model && scene.objects[i].role == rg::SceneObject::PROP)
+            bindings.props.push_back((int) i);
+    }
+    bindings.ship = scene.objectWithRole(rg::SceneObject::SHIP);
+    bindings.planet = scene.objectWithRole(rg::SceneObject::PLANET);
+    bindings.sun = *scene.light(rg::SceneLight::DIRECTIONAL);
+    bindings.engine = *scene.light(rg::SceneLight::POINT);
+    bindings.sunAnchor = scene.object(bindings.sun.anchor);
+    bindings.engineAnchor = scene.object(bindings.engine.anchor);
+
+    // only the ship's shaders read texture arrays
+    Model* ship = bindings.models[bindings.ship];
+    if (sceneBindings.ship >= 0 && sceneBindings.models[sceneBindings.ship] != ship)
+        sceneBindings.models[sceneBindings.ship]->SetTextureArrays(false);
+    ship->SetTextureArrays(modelTextureArrays);
+    shipTextureArrays = ship->TextureArrayCount();
+    shipTriangles.full = ship->TriangleCount();
+    planetTriangles.full = bindings.models[bindings.planet]->TriangleCount();
+
+    const std::string& texturePath = scene.objects[bindings.planet].texture;
+    if (!planetTextures.count(texturePath))
+        planetTextures[texturePath] = mipStreaming ? mipStreamer->load(texturePath, true, false)
+                                                   : loadTexture(texturePath.c_str(), true);
+    planetTex = planetTextures[texturePath];
+
+    PointLight& planetLight = programState->pointLight;
+    planetLight.ambient = bindings.engine.ambient;
+    planetLight.diffuse = bindings.engine.diffuse;
+    planetLight.specular = bindings.engine.specular;
+    planetLight.constant = bindings.engine.attenuation.x;
+    planetLight.linear = bindings.engine.attenuation.y;
+    planetLight.quadratic = bindings.engine.attenuation.z;
+
+    const rg::ScenePost& post = scene.post;
+    hdr = post.hdr;
+    bloom = post.bloom;
+    exposure = post.exposure;
+    iblIntensity = post.iblIntensity;
+    escortLightCount = post.escortLights;
+    for (int i = 0; i < skybox->count(); ++i) {
+        if (skybox->name(i) == post.sky)
+            skyboxIndex = i;
+    }
+
+    scene.build(sceneTransforms);
+    sceneBindings = bindings;
+    std::cout << "Scene " << path << ": " << scene.objects.size() << " objects, " << bindings.props.size()
+              << " props, " << newModels << " models loaded, " << (sceneFile.stats().fromCache ? "cache " : "parsed ")
+              << sceneFile.stats().milliseconds << " ms" << std::endl;
+    return true;
+}
@@ -0,0 +1,64 @@
+// CPU checks of rg::lodError and rg::largestLodError, which Mesh::LodError and
+// Model::LodError return; no GL context needed.
+#include <rg/MeshSimplifier.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+// the part of Mesh that Model::LodError reads, Mesh itself uploads to GL when constructed
+struct LodMesh {
+    std::vector<float> lodErrors;
+
+    float LodError(int level) const {
+        return rg::lodError(lodErrors, level);
+    }
+};
+
+void meshWithoutLods() {
+    for (int level = -1; level < 4; ++level)
+        check(rg::lodError({}, level) == 0.0f, "a mesh without LODs has no error at LOD " + std::to_string(level));
+}
+
+void meshWithLods() {
+    std::vector<float> lodErrors = {0.5f, 1.5f};
+    check(rg::lodError(lodErrors, 0) == 0.0f, "LOD 0 has no error");
+    check(rg::lodError(lodErrors, 1) == 0.5f, "LOD 1 has the first error");
+    check(rg::lodError(lodErrors, 2) == 1.5f, "LOD 2 has the second error");
+    check(rg::lodError(lodErrors, 5) == 1.5f, "levels past the last LOD have the last error");
+}
+
+void mixedModel() {
+    // a model whose meshes were not all simplified, LodCount() is that of the most detailed chain
+    std::vector<LodMesh> meshes = {{{}}, {{0.25f, 0.75f, 2.0f}}, {{}}, {{1.0f}}};
+    const float expected[] = {0.0f, 1.0f, 1.0f, 2.0f, 2.0f};
+    for (int level = 0; level < 5; ++level)
+        check(rg::largestLodError(meshes, level) == expected[level],
+              "a model mixing meshes with and without LODs at LOD " + std::to_string(level));
+
+    std::vector<LodMesh> unsimplified = {{{}}, {{}}};
+    check(rg::largestLodError(unsimplified, 2) == 0.0f, "a model without LODs has no error");
+    check(rg::largestLodError(std::vector<LodMesh>(), 1) == 0.0f, "a model without meshes has no error");
+}
+
+}
+
+int main() {
+    meshWithoutLods();
+    meshWithLods();
+    mixedModel();
+    if (failures)
+        std::cout << failures << " checks failed" << std::endl;
+    return failures ? 1 : 0;
+}
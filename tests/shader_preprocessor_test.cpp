@@ -0,0 +1,149 @@
+// CPU checks of rg::ShaderPreprocessor over an in-memory file system; no GL context needed.
+#include <rg/ShaderPreprocessor.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+rg::ShaderPreprocessor preprocessorFor(const std::map<std::string, std::string>& files) {
+    return rg::ShaderPreprocessor({"shaders"}, [files](const std::string& path, std::string& contents) {
+        auto found = files.find(path);
+        if (found == files.end())
+            return false;
+        contents = found->second;
+        return true;
+    });
+}
+
+size_t occurrences(const std::string& text, const std::string& pattern) {
+    size_t count = 0;
+    for (size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + 1))
+        ++count;
+    return count;
+}
+
+// the source string and line the GLSL 3.30 compiler reports for the first output line containing
+// marker: "#line n s" numbers the line after it n + 1 in source string s
+bool originOf(const std::string& code, const std::string& marker, int& source, int& line) {
+    std::istringstream in(code);
+    std::string text;
+    source = 0;
+    line = 0;
+    while (std::getline(in, text)) {
+        if (text.compare(0, 6, "#line ") == 0) {
+            std::istringstream directive(text.substr(6));
+            directive >> line >> source;
+            continue;
+        }
+        ++line;
+        if (text.find(marker) != std::string::npos)
+            return true;
+    }
+    return false;
+}
+
+void nestedIncludes() {
+    rg::ShaderPreprocessor preprocessor = preprocessorFor({
+            {"shaders/main.fs", "// main 1\n#include \"lib/a.glsl\"\n// main 3\n"},
+            {"shaders/lib/a.glsl", "// a 1\n#include \"b.glsl\"\n// a 3\n"},
+            {"shaders/lib/b.glsl", "// b 1\n"},
+    });
+    rg::PreprocessedSource result = preprocessor.process("shaders/main.fs");
+    check(result.ok, "nested includes resolve: " + result.error);
+    check(result.dependencies == std::vector<std::string>({"shaders/main.fs", "shaders/lib/a.glsl", "shaders/lib/b.glsl"}),
+          "dependencies list every file in include order");
+    check(result.code.find("// a 1") < result.code.find("// b 1")
+          && result.code.find("// b 1") < result.code.find("// a 3")
+          && result.code.find("// a 3") < result.code.find("// main 3"),
+          "included files are pasted where they are included");
+
+    // not next to the includer, found through the include path
+    rg::ShaderPreprocessor fromPath = preprocessorFor({
+            {"other/main.fs", "#include \"lib/b.glsl\"\n"},
+            {"shaders/lib/b.glsl", "// b 1\n"},
+    });
+    result = fromPath.process("other/main.fs");
+    check(result.ok && result.dependencies.back() == "shaders/lib/b.glsl", "includes fall back to the include path");
+}
+
+void includeOnce() {
+    rg::ShaderPreprocessor preprocessor = preprocessorFor({
+            {"shaders/main.fs", "#include \"lib/a.glsl\"\n#include \"lib/b.glsl\"\n#include \"lib/./b.glsl\"\n"},
+            {"shaders/lib/a.glsl", "#include \"../lib/b.glsl\"\n// a 2\n"},
+            {"shaders/lib/b.glsl", "// b 1\n"},
+    });
+    rg::PreprocessedSource result = preprocessor.process("shaders/main.fs");
+    check(result.ok, "include once: " + result.error);
+    check(occurrences(result.code, "// b 1") == 1, "a file included three times is pasted once");
+    check(result.dependencies.size() == 3, "a file included three times is listed once");
+}
+
+void includeCycle() {
+    rg::ShaderPreprocessor preprocessor = preprocessorFor({
+            {"shaders/main.fs", "#include \"lib/a.glsl\"\n"},
+            {"shaders/lib/a.glsl", "#include \"b.glsl\"\n"},
+            {"shaders/lib/b.glsl", "// b 1\n#include \"a.glsl\"\n"},
+    });
+    rg::PreprocessedSource result = preprocessor.process("shaders/main.fs");
+    check(!result.ok, "an include cycle fails");
+    check(result.error == "shaders/lib/b.glsl:2: recursive include of shaders/lib/a.glsl",
+          "the cycle error names the including line: " + result.error);
+
+    rg::ShaderPreprocessor missing = preprocessorFor({{"shaders/main.fs", "// main 1\n#include \"nowhere.glsl\"\n"}});
+    result = missing.process("shaders/main.fs");
+    check(!result.ok && result.error == "shaders/main.fs:2: cannot find \"nowhere.glsl\"",
+          "a missing include fails: " + result.error);
+}
+
+void lineMapping() {
+    rg::ShaderPreprocessor preprocessor = preprocessorFor({
+            {"shaders/main.fs", "// main 1\n// main 2\n#include \"lib/a.glsl\"\n// main 4\n#include \"lib/b.glsl\"\n// main 6\n"},
+            {"shaders/lib/a.glsl", "// a 1\n#include \"b.glsl\"\n// a 3\n"},
+            {"shaders/lib/b.glsl", "// b 1\n// b 2\n"},
+    });
+    rg::PreprocessedSource result = preprocessor.process("shaders/main.fs");
+    check(result.ok, "line mapping: " + result.error);
+    const struct {
+        const char* marker;
+        const char* file;
+        int line;
+    } expected[] = {
+            {"// main 1", "shaders/main.fs", 1},
+            {"// main 2", "shaders/main.fs", 2},
+            {"// a 1", "shaders/lib/a.glsl", 1},
+            {"// b 2", "shaders/lib/b.glsl", 2},
+            {"// a 3", "shaders/lib/a.glsl", 3},
+            {"// main 4", "shaders/main.fs", 4},
+            {"// main 6", "shaders/main.fs", 6},
+    };
+    for (const auto& e : expected) {
+        int source = -1, line = -1;
+        bool found = originOf(result.code, e.marker, source, line);
+        check(found && source >= 0 && source < (int) result.dependencies.size()
+              && result.dependencies[source] == e.file && line == e.line,
+              std::string("#line maps \"") + e.marker + "\" back to " + e.file + ":" + std::to_string(e.line));
+    }
+}
+
+}
+
+int main() {
+    nestedIncludes();
+    includeOnce();
+    includeCycle();
+    lineMapping();
+    if (failures)
+        std::cout << failures << " checks failed" << std::endl;
+    return failures ? 1 : 0;
+}